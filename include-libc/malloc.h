@@ -25,29 +25,137 @@
 #ifndef __MALLOC_H
 #define __MALLOC_H
 
+/* With CONFIG_LIBOS_MALLOC_STATS, the stats entry points record their
+ * return address as the call site.  Every wrapper between them and the
+ * caller, here and in libos/alloc.h, must then be inlined even when
+ * the compiler would rather not.
+ */
+#ifdef CONFIG_LIBOS_MALLOC_STATS
+#define __malloc_inline inline __attribute__((always_inline))
+#else
+#define __malloc_inline inline
+#endif
+
 #ifdef CONFIG_LIBOS_MALLOC
 #include <libos/malloc.h>
 
 extern mspace libos_mspace;
 
-static inline __attribute__((malloc)) void *malloc(size_t size)
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+__attribute__((malloc)) void *malloc_cache_alloc(size_t size);
+void malloc_cache_free(void *ptr);
+
+/** Return the current cpu's cached chunks to libos_mspace. */
+void malloc_cache_flush(void);
+#endif
+
+/* The allocator proper, without instrumentation. */
+static inline __attribute__((malloc)) void *__malloc(size_t size)
 {
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+	return malloc_cache_alloc(size);
+#elif defined(CONFIG_LIBOS_MALLOC_NODES)
+	return malloc_local(size, 0);
+#else
 	return mspace_malloc(libos_mspace, size);
+#endif
+}
+
+static inline __attribute__((malloc))
+void *__memalign(size_t align, size_t size)
+{
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+	return malloc_local(size, align);
+#else
+	return mspace_memalign(libos_mspace, align, size);
+#endif
+}
+
+static inline __attribute__((malloc)) void *__realloc(void *ptr, size_t size)
+{
+	return mspace_realloc(libos_mspace, ptr, size);
+}
+
+/* With CONFIG_LIBOS_MALLOC_NODES, chunks carry footers identifying
+ * their mspace, so libos_mspace can be passed for chunks from any node.
+ */
+static inline void __free(void *ptr)
+{
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+	malloc_cache_free(ptr);
+#else
+	mspace_free(libos_mspace, ptr);
+#endif
+}
+
+#ifdef CONFIG_LIBOS_MALLOC_STATS
+/* These record the caller's return address as the call site, so they
+ * must be called directly from the inline wrappers below.
+ */
+__attribute__((malloc)) void *malloc_stats_alloc(size_t size, size_t align);
+__attribute__((malloc)) void *malloc_stats_zalloc(size_t size);
+void *malloc_stats_realloc(void *ptr, size_t size);
+void malloc_stats_free(void *ptr);
+
+static __malloc_inline __attribute__((malloc)) void *malloc(size_t size)
+{
+	return malloc_stats_alloc(size, 0);
+}
+
+static __malloc_inline __attribute__((malloc))
+void *memalign(size_t align, size_t size)
+{
+	return malloc_stats_alloc(size, align);
+}
+
+static __malloc_inline __attribute__((malloc))
+void *realloc(void *ptr, size_t size)
+{
+	return malloc_stats_realloc(ptr, size);
+}
+
+static __malloc_inline __attribute__((malloc)) void *__calloc(size_t size)
+{
+	return malloc_stats_zalloc(size);
+}
+
+static __malloc_inline void free(void *ptr)
+{
+	malloc_stats_free(ptr);
+}
+#else
+static inline __attribute__((malloc)) void *malloc(size_t size)
+{
+	return __malloc(size);
 }
 
 static inline __attribute__((malloc)) void *memalign(size_t align, size_t size)
 {
-	return mspace_memalign(libos_mspace, size, align);
+	return __memalign(align, size);
 }
 
 static inline __attribute__((malloc)) void *realloc(void *ptr, size_t size)
 {
-	return mspace_realloc(libos_mspace, ptr, size);
+	return __realloc(ptr, size);
+}
+
+static inline __attribute__((malloc)) void *__calloc(size_t size)
+{
+	return malloc_zalloc(size);
 }
 
 static inline void free(void *ptr)
 {
-	mspace_free(libos_mspace, ptr);
+	__free(ptr);
+}
+#endif
+static __malloc_inline __attribute__((malloc))
+void *calloc(size_t nmemb, size_t size)
+{
+	if (size && nmemb > (size_t)-1 / size)
+		return NULL;
+
+	return __calloc(nmemb * size);
 }
 #elif defined(CONFIG_LIBOS_SIMPLE_ALLOC)
 void *simple_alloc(size_t size, size_t align);
@@ -28,6 +28,7 @@
 
 #include <stddef.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 void *memcpy(void *dest, const void *src, size_t len);
 void *memmove(void *dest, const void *src, size_t len);
@@ -49,6 +50,36 @@ char *strstr(const char *s1, const char *s2);
 int sprintf(char *buf, const char *str, ...);
 int snprintf(char *buf, size_t size, const char *str, ...);
 int vsnprintf(char *buf, size_t size, const char *str, va_list args);
+
+/** Save the arguments of a printf-style call for later formatting.
+ *
+ * Each argument is stored in one 64-bit slot of argv, and can be
+ * formatted later with vsnprintf_argv().  Only pointers to strings are
+ * saved, so the caller must copy any strings that may not outlive the
+ * saved arguments; the slots holding them are flagged in strmask.
+ *
+ * @param[in] str the format string
+ * @param[in] args the arguments to save
+ * @param[out] argv array to save arguments in
+ * @param[in] max number of entries in argv, at most 32
+ * @param[out] strmask bit n is set if argv[n] is a %s argument
+ * @return the number of arguments saved, or -1 if more than max.
+ */
+int printf_save_args(const char *str, va_list args, uint64_t *argv,
+                     int max, uint32_t *strmask);
+
+/** Format arguments saved by printf_save_args().
+ *
+ * %n conversions are ignored.
+ *
+ * @param[in] strbase If NULL, %s arguments are pointers.  Otherwise,
+ *   they are offsets from strbase, or PRINTF_NULL_STR for a NULL
+ *   pointer.
+ */
+int vsnprintf_argv(char *buf, size_t size, const char *str,
+                   const uint64_t *argv, const char *strbase);
+
+#define PRINTF_NULL_STR (~0ULL)
 unsigned long long strtoull(const char *restrict str, char **restrict endptr,
                             int base);
 long long strtoll(const char *restrict str, char **restrict endptr, int base);
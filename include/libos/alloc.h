@@ -30,19 +30,32 @@
 
 #include <libos/libos.h>
 
-static inline __attribute__((malloc)) void *alloc(size_t size, size_t align)
+/** Allocate memory without clearing it.
+ *
+ * Use this when the caller overwrites the memory before reading it.
+ */
+static __malloc_inline __attribute__((malloc))
+void *alloc_nozero(size_t size, size_t align)
+{
+	if (__builtin_constant_p(align) && align <= 8)
+		return malloc(size);
+
+	return memalign(align, size);
+}
+
+/** Allocate cleared memory. */
+static __malloc_inline __attribute__((malloc))
+void *alloc(size_t size, size_t align)
 {
 	void *ret;
 
 #ifdef CONFIG_LIBOS_MALLOC
+	/* calloc() skips clearing memory that is already known to be zero. */
 	if (__builtin_constant_p(align) && align <= 8)
-		ret = mspace_malloc(libos_mspace, size);
-	else
-		ret = mspace_memalign(libos_mspace, align, size);
-#else
-	ret = memalign(align, size);
+		return calloc(1, size);
 #endif
 
+	ret = alloc_nozero(size, align);
 	if (likely(ret))
 		memset(ret, 0, size);
 
@@ -52,6 +65,81 @@ static inline __attribute__((malloc)) void *alloc(size_t size, size_t align)
 #define alloc_type(T) alloc(sizeof(T), __alignof__(T))
 #define alloc_type_num(T, n) alloc(sizeof(T) * (n), __alignof__(T))
 
+#ifdef CONFIG_LIBOS_ALLOC_IMPL
+/** A count-up allocator over a fixed region.
+ *
+ * Allocation is lock-free.  Small allocations come from a region of
+ * ARENA_CPU_CHUNK bytes owned by the current cpu, which is refilled
+ * from the shared top with compare-and-swap, so any cpu (or interrupt
+ * handler) can allocate from an arena concurrently.  The first
+ * ARENA_CPU_SLOTS arenas used get these per-cpu regions; later arenas,
+ * and large or very aligned allocations, advance the shared top
+ * directly.
+ *
+ * Nothing is freed individually.  Instead, arena_mark() records the
+ * current top, and arena_release() throws away everything allocated
+ * since a mark, or since arena_init() with arena_reset().  Each of
+ * these retires every cpu's region, so that later allocations come
+ * from above the mark; the unused rest of those regions is lost until
+ * the arena is released past it.
+ *
+ * Releasing must not race with allocation from the same arena, and
+ * the caller must be done with everything released.  Allocations on
+ * other cpus concurrent with arena_mark() may fall on either side of
+ * the mark.
+ */
+typedef struct arena {
+	unsigned long start, top, end;
+
+	/// Bumped by arena_mark() and arena_release(), to retire the
+	/// per-cpu regions.
+	unsigned long gen;
+
+	/// Index into cpu->arena[] plus one, zero if not yet assigned,
+	/// or -1 if there are no free slots.
+	int cpu_slot;
+} arena_t;
+
+typedef unsigned long arena_mark_t;
+
+#define ARENA_CPU_CHUNK 1024
+
+/** Initialize an arena over [start, end). */
+void arena_init(arena_t *a, unsigned long start, unsigned long end);
+
+/** Allocate from an arena.
+ *
+ * @param[in] a the arena to allocate from
+ * @param[in] size number of bytes to allocate, may be zero
+ * @param[in] align alignment, must be a power of two
+ * @return the allocation, or NULL if the arena is exhausted.
+ *         The memory is not cleared.
+ */
+__attribute__((malloc)) void *arena_alloc(arena_t *a, size_t size,
+                                          size_t align);
+
+/** Take a checkpoint for arena_release(). */
+arena_mark_t arena_mark(arena_t *a);
+
+/** Free everything allocated from an arena since mark was taken. */
+void arena_release(arena_t *a, arena_mark_t mark);
+
+/** Free everything allocated from an arena. */
+static inline void arena_reset(arena_t *a)
+{
+	arena_release(a, a->start);
+}
+
+/** Return the number of bytes left in an arena, ignoring alignment.
+ *
+ * Space left in the per-cpu regions is not counted.
+ */
+static inline size_t arena_avail(arena_t *a)
+{
+	return a->end - a->top;
+}
+#endif
+
 #ifdef CONFIG_LIBOS_VIRT_ALLOC
 void valloc_init(unsigned long start, unsigned long end);
 __attribute__((malloc)) void *valloc(unsigned long size, unsigned long align);
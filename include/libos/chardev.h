@@ -28,6 +28,7 @@
 #include <stdint.h>
 
 #include <libos/queue.h>
+#include <libos/errors.h>
 
 struct chardev;
 
@@ -97,8 +98,38 @@ typedef struct {
 	 * interrupt driven receive.  The driver must set @ref chardevrx "dev->rx".
 	 */
 	int (*set_rx_queue)(struct chardev *dev, queue_t *q);
+
+	/** Move received data into the receive queue, with rx interrupts
+	 * masked.
+	 *
+	 * @param[in] dev The character device instance.
+	 * @param[in] budget The maximum number of bytes to move.
+	 *
+	 * @return the number of bytes moved into dev->rx.
+	 *
+	 * Called by chardev_rx_poll() while the device is in polled
+	 * mode.  The driver passes the result to chardev_rx_poll_policy(),
+	 * under the lock that serializes it with its rx interrupt handler,
+	 * and unmasks rx interrupts if that returns nonzero.
+	 *
+	 * This pointer may be NULL if the device does not support
+	 * hybrid interrupt/polled receive.
+	 */
+	size_t (*rx_poll)(struct chardev *dev, size_t budget);
 } chardev_ops;
 
+/// State of hybrid interrupt/polled receive, see chardev_set_rx_poll().
+typedef struct chardev_rx_poll {
+	/// Bytes per rx interrupt that switch to polling, or zero for never.
+	size_t threshold;
+	/// Consecutive empty polls before rx interrupts are unmasked.
+	int idle_limit;
+	/// Consecutive empty polls so far.
+	int idle;
+	/// Rx interrupts are masked, and the device is being polled.
+	int polling;
+} chardev_rx_poll_t;
+
 /// Represents a device which can transmit and receive a byte stream.
 typedef struct chardev {
 	const chardev_ops *ops;
@@ -110,6 +141,105 @@ typedef struct chardev {
 	/// @anchor chardevrx
 	/// The queue to receive data into, if interrupt driven.
 	queue_t *rx;
+
+	chardev_rx_poll_t rxpoll;
 } chardev_t;
 
+/** Enable hybrid interrupt/polled receive.
+ *
+ * When an rx interrupt delivers at least "threshold" bytes, the driver
+ * masks rx interrupts, and further data is received by
+ * chardev_rx_poll() in bursts.  Rx interrupts are unmasked once
+ * "idle_limit" consecutive polls find no data.  This avoids taking an
+ * interrupt for every FIFO's worth of data under load.
+ *
+ * Once this is enabled, the caller must call chardev_rx_poll()
+ * regularly, e.g. from a timer tick or an idle loop.  Nothing in libos
+ * calls it: without a poller, rx interrupts stay masked after the
+ * first burst, and received data backs up in the device (or is lost to
+ * FIFO overrun on a UART).  Setting a threshold of zero disables it;
+ * the device leaves polled mode at the next chardev_rx_poll().
+ *
+ * @param[in] cd the device, which must have a receive queue set
+ * @param[in] threshold bytes per interrupt to start polling at,
+ *   or zero to disable
+ * @param[in] idle_limit empty polls to stop polling after
+ * @return zero on success, ERR_INVALID if the device doesn't support
+ *   polled receive.
+ */
+static inline int chardev_set_rx_poll(chardev_t *cd, size_t threshold,
+                                      int idle_limit)
+{
+	if (!cd->ops->rx_poll)
+		return ERR_INVALID;
+
+	cd->rxpoll.idle_limit = idle_limit;
+	cd->rxpoll.threshold = threshold;
+	return 0;
+}
+
+/** Decide whether to switch from rx interrupts to polling.
+ *
+ * For drivers: call from the rx interrupt handler, with its lock held,
+ * after moving "len" bytes into the receive queue.
+ *
+ * @return nonzero if the driver should mask rx interrupts.
+ */
+static inline int chardev_rx_irq_policy(chardev_t *cd, size_t len)
+{
+	chardev_rx_poll_t *rxpoll = &cd->rxpoll;
+
+	if (!rxpoll->threshold || len < rxpoll->threshold)
+		return 0;
+
+	rxpoll->idle = 0;
+	rxpoll->polling = 1;
+	return 1;
+}
+
+/** Decide whether to switch from polling back to rx interrupts.
+ *
+ * For drivers: call from the rx_poll op, with the lock held, after
+ * moving "len" bytes into the receive queue.
+ *
+ * @return nonzero if the driver should unmask rx interrupts.
+ */
+static inline int chardev_rx_poll_policy(chardev_t *cd, size_t len)
+{
+	chardev_rx_poll_t *rxpoll = &cd->rxpoll;
+
+	if (len > 0)
+		rxpoll->idle = 0;
+	else
+		rxpoll->idle++;
+
+	if (rxpoll->threshold && rxpoll->idle < rxpoll->idle_limit)
+		return 0;
+
+	rxpoll->polling = 0;
+	return 1;
+}
+
+/** Receive data from a device in polled mode.
+ *
+ * Does nothing unless the device has switched to polling.
+ *
+ * @param[in] cd the device
+ * @param[in] budget the maximum number of bytes to receive
+ * @return the number of bytes moved into the receive queue
+ */
+static inline size_t chardev_rx_poll(chardev_t *cd, size_t budget)
+{
+	size_t len;
+
+	if (!cd->rxpoll.polling)
+		return 0;
+
+	len = cd->ops->rx_poll(cd, budget);
+	if (len > 0)
+		queue_notify_consumer(cd->rx, 0);
+
+	return len;
+}
+
 #endif
@@ -33,6 +33,18 @@ void qconsole_init(queue_t *q);
 void console_write_nolock(const char *s, size_t len);
 void console_write(const char *s, size_t len);
 
+#ifdef CONFIG_LIBOS_CONSOLE_FANIN
+/* Longest message printf() formats on the stack for the fan-in */
+#define CONSOLE_FANIN_MSG 256
+
+/** Write to the console without taking console_lock.
+ *
+ * @return zero if the output was queued, or ERR_BUSY if the caller
+ *         must write it under console_lock instead.
+ */
+int console_write_fanin(const char *s, size_t len);
+#endif
+
 extern queue_t consolebuf;
 
 extern uint32_t console_lock;
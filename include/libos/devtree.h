@@ -0,0 +1,95 @@
+/** @file
+ * Device tree address translation
+ */
+
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBOS_DEVTREE_H
+#define LIBOS_DEVTREE_H
+
+#include <libos/types.h>
+
+#define MAX_ADDR_CELLS 4
+#define MAX_SIZE_CELLS 2
+
+/** Get the #address-cells and #size-cells of a node.
+ *
+ * Missing properties default to 2 and 1.
+ *
+ * @return zero on success, or an FDT or ERR_BADTREE error
+ */
+int get_addr_format(const void *tree, int node,
+		    uint32_t *naddr, uint32_t *nsize);
+
+/** Like get_addr_format(), but fails if either value is zero. */
+int get_addr_format_nozero(const void *tree, int node,
+			   uint32_t *naddr, uint32_t *nsize);
+
+/** Copy a naddr-cell value into a MAX_ADDR_CELLS buffer, zero-extended. */
+void copy_val(uint32_t *dest, const uint32_t *src, int naddr);
+
+/** Translate an address through one ranges property.
+ *
+ * @param[in,out] addr MAX_ADDR_CELLS address in the child's space,
+ *                     replaced with the address in the parent's space
+ * @param[out] rangesize if non-NULL, the bytes left in the matching
+ *                       range from addr
+ */
+int xlate_one(uint32_t *addr, const uint32_t *ranges,
+	      int rangelen, uint32_t naddr, uint32_t nsize,
+	      uint32_t prev_naddr, uint32_t prev_nsize,
+	      phys_addr_t *rangesize);
+
+/** Translate a reg entry of a node to a root address.
+ *
+ * @param[in] reg the entry, with naddr address and nsize size cells
+ * @param[out] addrbuf MAX_ADDR_CELLS translated address
+ * @param[out] size if non-NULL, the size from the entry
+ */
+int xlate_reg_raw(const void *tree, int node, const uint32_t *reg,
+		  uint32_t *addrbuf, phys_addr_t *size,
+		  uint32_t naddr, uint32_t nsize);
+
+/** Translate a reg entry of a node to a physical address. */
+int xlate_reg(const void *tree, int node, const uint32_t *reg,
+	      phys_addr_t *addr, phys_addr_t *size);
+
+/** Get the physical address and size of a node's reg entry.
+ *
+ * @param[in] res index of the entry in the reg property
+ * @param[out] size may be NULL
+ */
+int dt_get_reg(const void *tree, int node, int res,
+	       phys_addr_t *addr, phys_addr_t *size);
+
+/** Forget cached parents, address formats and ranges.
+ *
+ * The functions above cache these per node, by tree and offset.
+ * Call this after modifying or moving a tree that has been used for
+ * translation.
+ */
+void dt_cache_flush(void);
+
+#endif
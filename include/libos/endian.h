@@ -45,6 +45,15 @@ static inline uint64_t swap64(uint64_t val)
 	return (uint64_t)swap32(val) | ((uint64_t)swap32(val >> 32) << 32);
 }
 
+/* Given two consecutive aligned words as loaded from memory, return
+ * the word that a load "shift" bits into the first would return.
+ * shift must be nonzero and less than the number of bits in a word.
+ */
+#define MERGE_BE(first, second, shift) \
+	(((first) << (shift)) | ((second) >> (sizeof(second) * 8 - (shift))))
+#define MERGE_LE(first, second, shift) \
+	(((first) >> (shift)) | ((second) << (sizeof(second) * 8 - (shift))))
+
 #ifdef _BIG_ENDIAN
 #define cpu_to_le16 swap16
 #define cpu_to_le32 swap32
@@ -58,6 +67,7 @@ static inline uint64_t swap64(uint64_t val)
 #define cpu_from_be16(x) (x)
 #define cpu_from_be32(x) (x)
 #define cpu_from_be64(x) (x)
+#define MERGE_CPU MERGE_BE
 #elif defined(_LITTLE_ENDIAN)
 #define cpu_to_le16(x) (x)
 #define cpu_to_le32(x) (x)
@@ -71,6 +81,7 @@ static inline uint64_t swap64(uint64_t val)
 #define cpu_from_be16 swap16
 #define cpu_from_be32 swap32
 #define cpu_from_be64 swap64
+#define MERGE_CPU MERGE_LE
 #else
 #error Please specify endianness.
 #endif
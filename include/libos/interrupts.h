@@ -88,4 +88,32 @@ void interrupt_mask(interrupt_t *irq);
 void interrupt_reset(interrupt_t *irq);
 void interrupt_unmask(interrupt_t *irq);
 
+/** Action list walks.
+ *
+ * irq->actions is walked without a lock, between irq_dispatch_enter()
+ * and irq_dispatch_exit().  Walks may nest, e.g. when a critical
+ * interrupt arrives during a normal one.  Writers serialize updates
+ * with their own lock, publish a new action with a barrier before
+ * linking it in, and must call irq_synchronize() between unlinking an
+ * action and freeing it.
+ */
+void irq_dispatch_enter(void);
+void irq_dispatch_exit(void);
+
+/** Wait for all action list walks in progress to finish.
+ *
+ * Must not be called from an interrupt handler, as the caller's own
+ * walk would never finish.
+ */
+void irq_synchronize(void);
+
+/** Unlink the action for devid from irq->actions.
+ *
+ * The caller must hold the lock serializing updates to the list, and
+ * must irq_synchronize() before freeing the returned action.
+ *
+ * @return the unlinked action, or NULL if devid has no action
+ */
+irqaction_t *irq_unlink_action(interrupt_t *irq, void *devid);
+
 #endif
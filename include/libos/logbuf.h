@@ -0,0 +1,95 @@
+/** @file
+ * Per-cpu log buffers for deferred printlog() output.
+ */
+
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBOS_LOGBUF_H
+#define LIBOS_LOGBUF_H
+
+#include <libos/types.h>
+#include <libos/cache.h>
+
+/** Per-cpu ring of log records.
+ *
+ * Only the owning cpu appends to a logbuf, but it may do so from any
+ * trap level, so space is claimed with an atomic update of tail rather
+ * than with interrupts disabled.  A record is marked LOGREC_READY once
+ * it has been filled in.  Records that were interrupted while being
+ * filled in may therefore become ready out of order.
+ *
+ * A single drainer (serialized by a lock, on any cpu) consumes ready
+ * records from head.  It zeroes each record before advancing head, so
+ * that everything outside head..tail is zero.  A record's info word
+ * thus reads as zero until it is committed, wherever the record
+ * starts, and stale bytes are never mistaken for a new record.  The
+ * buffer must start out zeroed, as it does in a static cpu_t.
+ *
+ * Records are LOGREC_ALIGN-aligned and never wrap; a LOGREC_PAD
+ * record fills any space left at the end of the buffer.
+ */
+typedef struct logbuf {
+	/// Written by the drainer.
+	uint32_t head __attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+
+	/// Written by the owning cpu.
+	uint32_t tail __attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+	/// Messages discarded because the buffer was full.
+	uint32_t dropped;
+	/// PIR of the owning cpu, to tag output with.
+	uint32_t pir;
+	/// Next logbuf registered with the drainer.
+	struct logbuf *next;
+	uint32_t registered;
+
+	uint8_t buf[CONFIG_LIBOS_PERCPU_LOG_SIZE]
+		__attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+} logbuf_t;
+
+typedef struct logrec {
+	/// Size of the whole record, plus LOGREC_* flags.
+	uint32_t info;
+	/// Length of the message text.
+	uint16_t len;
+	uint8_t logtype;
+	uint8_t loglevel;
+	/// Timebase at which the message was logged.
+	uint64_t tb;
+	char text[0];
+} logrec_t;
+
+#define LOGREC_READY  0x80000000
+#define LOGREC_PAD    0x40000000
+#define LOGREC_BINARY 0x20000000 /**< Unformatted; see logbuf.c */
+#define LOGREC_SIZE   0x00ffffff
+
+#define LOGREC_ALIGN  8
+
+/** Maximum arguments in a binary record; messages with more are
+ * formatted when logged.
+ */
+#define LOGREC_MAX_ARGS 16
+
+#endif
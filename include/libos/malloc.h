@@ -27,7 +27,11 @@
 
 #define MSPACES 1
 #define ONLY_MSPACES 1
+#ifdef CONFIG_LIBOS_MALLOC_STATS
+#define NO_MALLINFO 0
+#else
 #define NO_MALLINFO 1
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -410,11 +414,50 @@ typedef void* mspace;
 /** Add a segment of memory to be used by malloc_init().
  *
  * To add memory after malloc_init(), use mspace_add_segment().
+ * The segment replaces any overlapping part of a previously added
+ * segment, and is merged with adjacent segments on the same node.
+ *
+ * There is room for 64 separate segments.  When the table is full,
+ * the smallest segment, which may be the new one, is discarded.
+ *
+ * @param start[in] first byte of the segment
+ * @param end[in] last byte of the segment
+ * @return 0, ERR_INVALID if end is below start, or ERR_NOMEM if the
+ *         table was full and memory was discarded
+ */
+int malloc_add_segment(void *start, void *end);
+
+/** Add a segment of memory that is local to a node.
+ *
+ * With CONFIG_LIBOS_MALLOC_NODES, malloc_init() creates a separate
+ * mspace for each node, and allocations prefer the mspace of the
+ * current cpu's node (cpu->node).  Otherwise, the node is ignored.
+ * malloc_add_segment() adds memory to node 0.
+ *
+ * The client must set cpu->node on each cpu itself; libos leaves it
+ * at zero.
  *
  * @param start[in] first byte of the segment
  * @param end[in] last byte of the segment
+ * @param node[in] locality node of the memory
+ * @return as for malloc_add_segment()
  */
-void malloc_add_segment(void *start, void *end);
+int malloc_add_segment_node(void *start, void *end, int node);
+
+/** Add a segment of memory that is known to be zero-filled.
+ *
+ * As malloc_add_segment_node(), but malloc_init() adds these segments
+ * after all others and marks the top chunk as zero, so calloc() and
+ * malloc_zalloc() need not clear memory carved freshly from it.  Use
+ * this when, for example, the loader or head.S cleared the memory.
+ * Only the last such segment on each node benefits.
+ *
+ * @param start[in] first byte of the segment
+ * @param end[in] last byte of the segment
+ * @param node[in] locality node of the memory
+ * @return as for malloc_add_segment()
+ */
+int malloc_add_zeroed_segment(void *start, void *end, int node);
 
 /** Allocate a segment of memory to be excluded from malloc_init().
  *
@@ -430,8 +473,11 @@ void *malloc_alloc_segment(size_t size, size_t align);
  *
  * @param start[in] first byte of the segment
  * @param end[in] last byte of the segment
+ * @return 0, ERR_INVALID if end is below start, or ERR_NOMEM if
+ *         splitting a segment overflowed the table and memory was
+ *         discarded
  */
-void malloc_exclude_segment(void *start, void *end);
+int malloc_exclude_segment(void *start, void *end);
 
 /** Create an mspace, and use it as the default libos allocator
  *
@@ -439,6 +485,84 @@ void malloc_exclude_segment(void *start, void *end);
  */
 mspace malloc_init(void);
 
+/** Declare that the unallocated top of each mspace is zero-filled.
+ *
+ * Segments added with malloc_add_zeroed_segment() are already marked
+ * by malloc_init(); this is for memory found to be zero afterward.
+ * See mspace_assume_zeroed().
+ */
+void malloc_assume_zeroed(void);
+
+/** Allocate cleared memory from the default allocator.
+ *
+ * Memory carved from the known-zero part of an mspace's top chunk is
+ * not cleared again.
+ */
+__attribute__((malloc)) void *malloc_zalloc(size_t size);
+
+#ifdef CONFIG_LIBOS_MALLOC_STATS
+/* Statistics for allocations made through malloc(), memalign(),
+ * realloc(), and alloc().  Sizes are usable sizes as reported by
+ * mspace_usable_size(), so they include rounding.
+ */
+
+/* Class n counts chunks of up to (16 << n) usable bytes; the last
+ * class counts everything larger.
+ */
+#define MALLOC_STATS_CLASSES 16
+
+/* Number of distinct call sites tracked.  Site 0 collects allocations
+ * from call sites that did not fit in the table.
+ */
+#define MALLOC_STATS_SITES 64
+
+typedef struct malloc_class_stats {
+	unsigned long allocs, frees;
+	size_t bytes;
+} malloc_class_stats_t;
+
+typedef struct malloc_site_stats {
+	void *site; /**< Return address of the call to malloc() etc. */
+	unsigned long allocs, frees;
+	size_t bytes, peak;
+} malloc_site_stats_t;
+
+typedef struct malloc_stats {
+	unsigned long allocs, frees, failures;
+	size_t bytes, peak;
+	malloc_class_stats_t classes[MALLOC_STATS_CLASSES];
+} malloc_stats_t;
+
+/** Return a snapshot of the global and per-size-class counters. */
+void malloc_get_stats(malloc_stats_t *stats);
+
+/** Return a snapshot of the per-call-site counters.
+ *
+ * @param[out] sites buffer to fill
+ * @param[in] max number of entries in sites
+ * @return number of entries filled in
+ */
+int malloc_get_site_stats(malloc_site_stats_t *sites, int max);
+
+/** Print statistics and mspace fragmentation with printlog().
+ *
+ * Only call sites that have memory in use are listed.
+ */
+void malloc_dump_stats(int loglevel);
+#endif
+
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+/** Return the mspace for a node, or NULL if it has no memory. */
+mspace malloc_node_mspace(int node);
+
+/** Allocate from the current cpu's node, falling back to other nodes.
+ *
+ * @param size[in] size of allocation in bytes
+ * @param align[in] alignment, or zero for the default
+ */
+__attribute__((malloc)) void *malloc_local(size_t size, size_t align);
+#endif
+
 /*
   create_mspace creates and returns a new independent space with the
   given initial capacity, or, if 0, the default granularity size.  It
@@ -474,6 +598,15 @@ mspace create_mspace_with_base(void* base, size_t capacity, int locked);
 /** Add an independent segment of free space to an existing mspace object. */
 void mspace_add_segment(mspace msp, char *base, size_t size);
 
+/** Declare that the unallocated top of an mspace is zero-filled.
+ *
+ * mspace_calloc() and alloc() skip clearing memory carved from the
+ * zeroed part of the top chunk.  Memory freed back into the top chunk
+ * is no longer treated as zero.  With several segments, only the
+ * top chunk (in the most recently added segment) is affected.
+ */
+void mspace_assume_zeroed(mspace msp);
+
 /*
   mspace_malloc behaves as malloc, but operates within
   the given space.
@@ -533,8 +666,33 @@ void** mspace_independent_comalloc(mspace msp, size_t n_elements,
 */
 size_t mspace_footprint(mspace msp);
 
+/*
+  mspace_usable_size(void* p) behaves as malloc_usable_size, returning
+  the number of usable bytes in the allocated chunk p.
+*/
+size_t mspace_usable_size(const void* mem);
+
 
 #if !NO_MALLINFO
+#if ONLY_MSPACES && !defined(HAVE_USR_INCLUDE_MALLOC_H)
+/* The declaration above is skipped with ONLY_MSPACES. */
+#ifndef MALLINFO_FIELD_TYPE
+#define MALLINFO_FIELD_TYPE size_t
+#endif /* MALLINFO_FIELD_TYPE */
+struct mallinfo {
+  MALLINFO_FIELD_TYPE arena;    /* non-mmapped space allocated from system */
+  MALLINFO_FIELD_TYPE ordblks;  /* number of free chunks */
+  MALLINFO_FIELD_TYPE smblks;   /* always 0 */
+  MALLINFO_FIELD_TYPE hblks;    /* always 0 */
+  MALLINFO_FIELD_TYPE hblkhd;   /* space in mmapped regions */
+  MALLINFO_FIELD_TYPE usmblks;  /* maximum total allocated space */
+  MALLINFO_FIELD_TYPE fsmblks;  /* always 0 */
+  MALLINFO_FIELD_TYPE uordblks; /* total allocated space */
+  MALLINFO_FIELD_TYPE fordblks; /* total free space */
+  MALLINFO_FIELD_TYPE keepcost; /* releasable (via malloc_trim) space */
+};
+#endif /* ONLY_MSPACES && !HAVE_USR_INCLUDE_MALLOC_H */
+
 /*
   mspace_mallinfo behaves as mallinfo, but reports properties of
   the given space.
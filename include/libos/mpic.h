@@ -36,6 +36,14 @@
 #define   MPIC_FRR_NIRQ_SHIFT 16
 #define MPIC_GCR  0x1020
 #define MPIC_PIR  0x1090
+#define MPIC_SPURIOUS_VECTOR 0xffff
+
+/* Global timers, group A */
+#define MPIC_TFRRA  0x10F0
+#define MPIC_GTBCRA 0x1110
+#define MPIC_GTVPRA 0x1120
+#define MPIC_GT_OFFSET 0x40
+#define   MPIC_GTBCR_CI 0x80000000
 
 #define MPIC_EXT_CRIT_SUMMARY 0x3b00
 #define MPIC_INT_CRIT_SUMMARY 0x3b40
@@ -119,6 +127,14 @@ typedef struct error_interrupt {
 #define MPIC_NUM_SRCS (MPIC_NUM_EXTINT_SRCS + 32 + MPIC_NUM_MSG_SRCS + 40 + MPIC_NUM_MSI_SRCS)
 
 #define MPIC_NUM_IPI_SRCS	4
+#define MPIC_NUM_TIMERS		4
+
+/* Vectors dispatched by do_mpic_extint().  Sources other than IPIs and
+ * timers default to their source number; IPIs and timers follow them.
+ */
+#define MPIC_NUM_VECTORS	1024
+#define MPIC_IPI_VECTOR_BASE	MPIC_NUM_SRCS
+#define MPIC_TIMER_VECTOR_BASE	(MPIC_IPI_VECTOR_BASE + MPIC_NUM_IPI_SRCS)
 
 #define MPIC_INT_SRCS_START_OFFSET 16
 #define MPIC_MSI_SRCS_START_OFFSET 0xE0
@@ -138,11 +154,48 @@ void mpic_reset_core(void);
 interrupt_t *mpic_get_ipi_irq(int irq);
 void mpic_set_ipi_dispatch_register(interrupt_t *irq);
 
+/** Reload the cached IVPR, destination and level of every source.
+ *
+ * The MPIC code keeps a copy of these registers so that it doesn't
+ * have to read them back.  Call this after changing them other than
+ * through these functions, e.g. from a debugger or another OS.  The
+ * vector-to-source table used by do_mpic_extint() is rebuilt too.
+ */
+void mpic_refresh_shadows(void);
+
 #define MPIC_EXTERNAL_BASE  0
 #define MPIC_INTERNAL_BASE  16
 
 void do_mpic_critint(void);
 void do_mpic_mcheck(void);
+
+/** Dispatch pending non-critical interrupts.
+ *
+ * Call from the external input exception.  In non-coreint mode, every
+ * source that is pending when the handlers return is acknowledged and
+ * dispatched in the same exception, rather than taking a new one.
+ */
+void do_mpic_extint(void);
+
+/** Set a coalescing window for a non-critical interrupt.
+ *
+ * After its handlers run, the source is masked and one of the MPIC
+ * global timers is started; the source is unmasked when the timer
+ * expires.  Interrupts that arrive during the window are delivered
+ * together afterward, so this is intended for level-sensitive sources
+ * whose handlers drain all pending work.  Only sources dispatched by
+ * do_mpic_extint() are held off.
+ *
+ * A group A timer is claimed the first time it is needed, and kept
+ * for later windows.  Timers that are already counting or unmasked
+ * are left to whatever is using them.
+ *
+ * @param[in] irq the interrupt to coalesce
+ * @param[in] ticks length of the window in global timer ticks (see
+ *   MPIC_TFRRA), or zero to stop coalescing this interrupt
+ * @return zero on success, ERR_BUSY if no timer is free
+ */
+int mpic_irq_set_coalesce(interrupt_t *irq, uint32_t ticks);
 extern int mpic_coreint;
 
 extern int_ops_t mpic_ops;
@@ -0,0 +1,208 @@
+/** @file
+ * Lockless multi-producer, multi-consumer queues.
+ */
+
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBOS_MPMC_QUEUE_H
+#define LIBOS_MPMC_QUEUE_H
+
+#include <libos/types.h>
+#include <libos/cache.h>
+#include <libos/io.h>
+
+/** Lockless multi-producer, multi-consumer byte queue.
+ *
+ * Producers and consumers each claim a range of the ring with an
+ * atomic reservation, fill or drain it without holding any lock, and
+ * then commit it.  Commits on each side are published in reservation
+ * order: a commit spins until every earlier reservation on the same
+ * side has been committed.
+ *
+ * Because of this, a reservation must not be interrupted by code that
+ * reserves on the same side of the same queue (e.g. an interrupt
+ * handler on the same cpu), or the commit will deadlock.  Callers that
+ * produce or consume from interrupt context must disable interrupts
+ * between reserve and commit.
+ *
+ * Indices are free-running and are only wrapped when indexing buf,
+ * so the full size of the buffer is usable.
+ */
+typedef struct mpmc_queue {
+	uint8_t *buf;
+
+	/// Size of queue, must be a power of two.
+	uint32_t size;
+
+	/// Start of the next producer reservation.
+	uint32_t prod_head __attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+	/// End of data committed by producers.
+	uint32_t prod_tail;
+
+	/// Start of the next consumer reservation.
+	uint32_t cons_head __attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+	/// End of data released by consumers.
+	uint32_t cons_tail;
+} __attribute__((aligned(MAX_CACHE_LINE_SIZE))) mpmc_queue_t;
+
+/// A range of a queue claimed by a producer or consumer.
+typedef struct mpmc_resv {
+	uint32_t start;
+	uint32_t len;
+} mpmc_resv_t;
+
+/** Initialize a queue.
+ *
+ * @param[in] q address of the queue to initialize.
+ * @param[in] size size in bytes of the queue, must be a power of two,
+ *                 and not zero.
+ * @return zero on success, ERR_INVALID for a bad size, or ERR_NOMEM.
+ */
+int mpmc_queue_init(mpmc_queue_t *q, size_t size);
+
+void mpmc_queue_destroy(mpmc_queue_t *q);
+
+/** Reserve space to write to.
+ *
+ * Either all of "len" bytes are reserved, or none are.
+ *
+ * @param[in] q address of the queue to write to.
+ * @param[out] resv the reserved range
+ * @param[in] len number of bytes to reserve
+ * @return zero on success, or ERR_BUSY if there is not enough space.
+ */
+int mpmc_queue_reserve_write(mpmc_queue_t *q, mpmc_resv_t *resv, size_t len);
+
+/** Make a filled write reservation visible to consumers.
+ *
+ * Spins until all earlier write reservations have been committed.
+ *
+ * @param[in] q address of the queue that was written to.
+ * @param[in] resv a range returned by mpmc_queue_reserve_write()
+ */
+void mpmc_queue_commit_write(mpmc_queue_t *q, const mpmc_resv_t *resv);
+
+/** Reserve data to read from.
+ *
+ * @param[in] q address of the queue to read from.
+ * @param[out] resv the reserved range
+ * @param[in] len maximum number of bytes to reserve
+ * @return number of bytes reserved, or zero if the queue is empty.
+ *         A zero-length reservation must not be committed.
+ */
+size_t mpmc_queue_reserve_read(mpmc_queue_t *q, mpmc_resv_t *resv, size_t len);
+
+/** Release a drained read reservation back to producers.
+ *
+ * Spins until all earlier read reservations have been committed.
+ *
+ * @param[in] q address of the queue that was read from.
+ * @param[in] resv a range returned by mpmc_queue_reserve_read()
+ */
+void mpmc_queue_commit_read(mpmc_queue_t *q, const mpmc_resv_t *resv);
+
+/** Copy data into a write reservation.
+ *
+ * @param[in] q address of the queue to write to.
+ * @param[in] resv the reserved range
+ * @param[in] off offset from the start of the reservation
+ * @param[in] buf buffer to read from
+ * @param[in] len number of bytes to copy; off + len must not
+ *                exceed the length of the reservation.
+ */
+void mpmc_queue_copy_in(mpmc_queue_t *q, const mpmc_resv_t *resv,
+                        size_t off, const uint8_t *buf, size_t len);
+
+/** Copy data out of a read reservation.
+ *
+ * @param[in] q address of the queue to read from.
+ * @param[in] resv the reserved range
+ * @param[in] off offset from the start of the reservation
+ * @param[out] buf buffer to fill
+ * @param[in] len number of bytes to copy; off + len must not
+ *                exceed the length of the reservation.
+ */
+void mpmc_queue_copy_out(mpmc_queue_t *q, const mpmc_resv_t *resv,
+                         size_t off, uint8_t *buf, size_t len);
+
+/** Write to a queue.
+ *
+ * Writes all of "len" bytes, or nothing.
+ *
+ * @param[in] q address of the queue to write to.
+ * @param[in] buf buffer to read from
+ * @param[in] len number of bytes to write
+ * @return number of bytes written, or ERR_BUSY if there is not
+ *         enough space.
+ */
+ssize_t mpmc_queue_write(mpmc_queue_t *q, const uint8_t *buf, size_t len);
+
+/** Read from a queue.
+ *
+ * @param[in] q address of the queue to read from.
+ * @param[out] buf buffer to fill
+ * @param[in] len maximum number of bytes to read
+ * @return number of bytes read, or zero if queue is empty
+ */
+ssize_t mpmc_queue_read(mpmc_queue_t *q, uint8_t *buf, size_t len);
+
+/** Return non-zero if no committed data is left to reserve. */
+static inline int mpmc_queue_empty(const mpmc_queue_t *q)
+{
+	return raw_in32(&q->prod_tail) == raw_in32(&q->cons_head);
+}
+
+static inline size_t mpmc_queue_wrap(const mpmc_queue_t *q, uint32_t index)
+{
+	return index & (q->size - 1);
+}
+
+/** Return the address of a byte in a reservation.
+ *
+ * The byte at resv->start + off + 1 is not necessarily contiguous
+ * with the returned byte, as the reservation may wrap around the
+ * end of the buffer.
+ */
+static inline uint8_t *mpmc_queue_ptr(const mpmc_queue_t *q,
+                                      const mpmc_resv_t *resv, size_t off)
+{
+	return &q->buf[mpmc_queue_wrap(q, resv->start + off)];
+}
+
+#define DECLARE_MPMC_QUEUE(Q, SIZE) \
+	static uint8_t _##Q##_array[SIZE]; \
+	mpmc_queue_t Q = { \
+	.buf = _##Q##_array, \
+	.size = SIZE, \
+}
+
+#define DECLARE_STATIC_MPMC_QUEUE(Q, SIZE) \
+	static uint8_t _##Q##_array[SIZE]; \
+	static mpmc_queue_t Q = { \
+	.buf = _##Q##_array, \
+	.size = SIZE, \
+}
+
+#endif
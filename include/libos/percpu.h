@@ -33,6 +33,9 @@
 #include <libos/libos.h>
 #include <libos/fsl-booke-tlb.h>
 #include <libos/cache.h>
+#ifdef CONFIG_LIBOS_PERCPU_LOG
+#include <libos/logbuf.h>
+#endif
 #endif
 
 #define CPUSAVE_LEN 2
@@ -48,6 +51,48 @@
 #ifndef _ASM
 typedef uint8_t kstack_t[KSTACK_SIZE] __attribute__((aligned(16)));
 
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+#define MALLOC_CACHE_CLASSES 5
+#define MALLOC_CACHE_DEPTH   16
+
+/** Per-cpu cache of small free chunks, in front of libos_mspace.
+ *
+ * Class n holds chunks with at least (16 << n) usable bytes, linked
+ * through their first word.  Only the owning cpu touches this, with
+ * interrupts disabled.
+ */
+typedef struct malloc_cache {
+	void *head[MALLOC_CACHE_CLASSES];
+	unsigned int count[MALLOC_CACHE_CLASSES];
+} malloc_cache_t;
+#endif
+
+#ifdef CONFIG_LIBOS_SLAB
+#define SLAB_CPU_SLOTS 8
+
+/** Per-cpu free list of one slab cache, see libos/slab.h.
+ *
+ * Only the owning cpu touches this, with interrupts disabled.
+ */
+typedef struct slab_cpu {
+	void *head;
+	unsigned int count;
+} slab_cpu_t;
+#endif
+
+#ifdef CONFIG_LIBOS_ALLOC_IMPL
+#define ARENA_CPU_SLOTS 4
+
+/** Per-cpu region of one arena, see libos/alloc.h.
+ *
+ * Only the owning cpu touches this, with interrupts disabled.
+ */
+typedef struct arena_cpu {
+	unsigned long top, end;
+	unsigned long gen; /**< arena generation the region was carved in */
+} arena_cpu_t;
+#endif
+
 struct libos_thread;
 
 typedef struct cpu {
@@ -61,11 +106,34 @@ typedef struct cpu {
 	struct libos_thread *thread;
 	unsigned int coreid;
 	int console_ok, crashing;
+#ifdef CONFIG_LIBOS_CONSOLE_FANIN
+	int console_fanin_busy; /**< in a console fan-in reservation */
+#endif
 	unsigned int traplevel;
 	int errno; /**< Used for C/POSIX funcitons that set errno */
 #ifdef LIBOS_RET_HOOK
 	int ret_hook;
 #endif
+#ifdef CONFIG_LIBOS_PERCPU_LOG
+	logbuf_t logbuf;
+#endif
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+	malloc_cache_t malloc_cache;
+#endif
+#ifdef CONFIG_LIBOS_SLAB
+	slab_cpu_t slab[SLAB_CPU_SLOTS];
+#endif
+#ifdef CONFIG_LIBOS_ALLOC_IMPL
+	arena_cpu_t arena[ARENA_CPU_SLOTS];
+#endif
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+	int node; /**< Memory locality node, set by the client */
+#endif
+	/** Nesting depth of irq action list walks, see irq_synchronize() */
+	uint32_t irq_depth;
+	/** Incremented each time irq_depth returns to zero */
+	uint32_t irq_exits;
+	int irq_registered;
 	/* Move the kstacks at the end to allow kstack scaling */
 	kstack_t debugstack, critstack, mcheckstack;
 } cpu_t;
@@ -97,6 +97,65 @@
 extern uint8_t loglevels[NUM_LOGTYPES];
 extern void invalid_logtype(void);
 
+#ifdef CONFIG_LIBOS_PRINTLOG_RATELIMIT
+/** Check a message against its logtype's rate limit.
+ *
+ * Also counts the message as emitted or suppressed.  Messages are
+ * never suppressed while crashing.
+ *
+ * @return non-zero if the message should be emitted
+ */
+int printlog_ratelimit(unsigned int logtype);
+
+/** Limit the rate of messages of a logtype.
+ *
+ * @param[in] logtype the logtype to limit
+ * @param[in] interval minimum average number of timebase ticks between
+ *   messages, or zero for no limit.  The granularity is
+ *   1 << PRINTLOG_RATELIMIT_SHIFT ticks.
+ * @param[in] burst number of messages that may be emitted back to back,
+ *   at least 1.
+ */
+void printlog_set_ratelimit(unsigned int logtype, uint32_t interval,
+                            unsigned int burst);
+
+/** Get the number of messages emitted and suppressed for a logtype. */
+void printlog_get_stats(unsigned int logtype, unsigned long *emitted,
+                        unsigned long *suppressed);
+
+#define PRINTLOG_RATELIMIT_SHIFT 8
+
+#define printlog_allowed(logtype) printlog_ratelimit(logtype)
+#else
+#define printlog_allowed(logtype) 1
+#endif
+
+#ifdef CONFIG_LIBOS_PERCPU_LOG
+/** Queue a message in the current cpu's log buffer.
+ *
+ * This neither takes a lock nor disables interrupts.  Messages are
+ * written to the console by printlog_drain(), which is called here if
+ * not in an interrupt handler.
+ */
+void printlog_deferred(unsigned int logtype, unsigned int loglevel,
+                       const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/** Write queued messages from all cpus to the console, oldest first.
+ *
+ * Returns immediately if another cpu is already draining.  Clients
+ * that log mainly from interrupt handlers should call this
+ * periodically, e.g. from an idle loop.
+ */
+void printlog_drain(void);
+
+#define __printlog(logtype, loglevel, fmt, args...) \
+	printlog_deferred(logtype, loglevel, fmt, ##args)
+#else
+#define __printlog(logtype, loglevel, fmt, args...) \
+	printf("[%ld] " fmt, mfspr(SPR_PIR), ##args)
+#endif
+
 /* Unfortunately, GCC will not inline a varargs function.
  *
  * The separate > and == comparisons are to shut up the
@@ -110,8 +169,9 @@ extern void invalid_logtype(void);
 	if ((!__builtin_constant_p(loglevel) || \
 	     loglevel <= CONFIG_LIBOS_MAX_BUILD_LOGLEVEL) && \
 	    __builtin_expect(loglevels[logtype] == loglevel || \
-	                     loglevels[logtype] > loglevel, 0)) \
-		printf("[%ld] " fmt, mfspr(SPR_PIR), ##args); \
+	                     loglevels[logtype] > loglevel, 0) && \
+	    printlog_allowed(logtype)) \
+		__printlog(logtype, loglevel, fmt, ##args); \
 } while (0)
 
 #endif
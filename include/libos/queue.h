@@ -31,12 +31,15 @@
 
 #include <libos/types.h>
 #include <libos/io.h>
+#include <libos/cache.h>
 #include <string.h>
 
 /// Lockless single-producer, single-consumer queue.
 typedef struct queue {
 	uint8_t *buf;
+#ifndef CONFIG_LIBOS_QUEUE_PADDED
 	uint32_t head, tail;
+#endif
 	
 	/// Size of queue, must be a power of two.
 	uint32_t size;
@@ -73,7 +76,37 @@ typedef struct queue {
 
 	/// Private data for the producer.
 	void *producer;
+
+#ifdef CONFIG_LIBOS_QUEUE_PADDED
+	/* Each side's index shares a cache line only with that side's
+	 * copy of the other index, which is refreshed only when the copy
+	 * says the queue is too full or too empty.
+	 */
+
+	/// Written by the consumer.
+	uint32_t head __attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+	/// Consumer's last observed value of tail.
+	uint32_t tail_cache;
+
+	/// Written by the producer.
+	uint32_t tail __attribute__((aligned(MAX_CACHE_LINE_SIZE)));
+	/// Producer's last observed value of head.
+	uint32_t head_cache;
+} __attribute__((aligned(MAX_CACHE_LINE_SIZE))) queue_t;
+#else
 } queue_t;
+#endif
+
+/** Up to two contiguous regions of a queue's buffer.
+ *
+ * A range of a queue can wrap around the end of the buffer, in which
+ * case the second region starts at the beginning of the buffer.  Unused
+ * regions have a length of zero.
+ */
+typedef struct queue_span {
+	uint8_t *buf[2];
+	size_t len[2];
+} queue_span_t;
 
 /** Initialize a queue.
  *
@@ -155,6 +188,73 @@ ssize_t queue_write(queue_t *q, const uint8_t *buf, size_t len);
  */
 ssize_t queue_write_blocking(queue_t *q, const uint8_t *buf, size_t len);
 
+/** Get direct access to free space in a queue.
+ *
+ * This requires producer synchronization.  The caller fills the
+ * returned regions in place and then makes the data visible with
+ * queue_commit_write().  The queue is not modified.
+ *
+ * @param[in] q address of the queue to write to.
+ * @param[out] span regions of the buffer that may be written
+ * @param[in] len maximum number of bytes to reserve
+ * @return number of bytes reserved, or zero if queue is full
+ */
+size_t queue_reserve_write(queue_t *q, queue_span_t *span, size_t len);
+
+/** Publish data written into a reservation.
+ *
+ * @param[in] q address of the queue that was written to.
+ * @param[in] len number of bytes to publish, no more than the
+ *                amount returned by the last queue_reserve_write().
+ */
+void queue_commit_write(queue_t *q, size_t len);
+
+/** Get direct access to data in a queue.
+ *
+ * This requires consumer synchronization.  The caller reads the
+ * returned regions in place and then removes the data with
+ * queue_consume().  The queue is not modified.
+ *
+ * @param[in] q address of the queue to read from.
+ * @param[out] span regions of the buffer holding data
+ * @param[in] len maximum number of bytes to return
+ * @return number of bytes available in span, or zero if queue is empty
+ */
+size_t queue_peek_span(queue_t *q, queue_span_t *span, size_t len);
+
+/** Remove data from a queue after reading it in place.
+ *
+ * @param[in] q address of the queue that was read from.
+ * @param[in] len number of bytes to remove, no more than the
+ *                amount returned by the last queue_peek_span().
+ */
+void queue_consume(queue_t *q, size_t len);
+
+/** Write to a queue, expanding newlines to CR/LF.
+ *
+ * This requires producer synchronization.  Writes as much of "buf" as
+ * fits, inserting a '\r' before each '\n', and publishes the new tail
+ * once.  A CR/LF pair is never split.
+ *
+ * @param[in] q address of the queue to write to.
+ * @param[in] buf buffer to read from
+ * @param[in] len maximum number of bytes to consume from buf
+ * @return number of bytes consumed from buf, or zero if queue is full
+ */
+ssize_t queue_write_crlf(queue_t *q, const uint8_t *buf, size_t len);
+
+/** Write to a queue, expanding newlines, blocking until all are written.
+ *
+ * This requires producer synchronization.  This must be called from a
+ * thread context which can block.
+ *
+ * @param[in] q address of the queue to write to.
+ * @param[in] buf buffer to read from
+ * @param[in] len number of bytes to consume from buf
+ * @return number of bytes consumed from buf
+ */
+ssize_t queue_write_crlf_blocking(queue_t *q, const uint8_t *buf, size_t len);
+
 int queue_readchar(queue_t *q, int peek);
 int queue_readchar_blocking(queue_t *q, int peek);
 int queue_writechar(queue_t *q, uint8_t c);
@@ -230,7 +330,12 @@ static inline ssize_t queue_writestr(queue_t *q, const char *str)
  */
 static inline void queue_purge(queue_t *q)
 {
-	raw_out32(&q->head, raw_in32(&q->tail));
+	uint32_t tail = raw_in32(&q->tail);
+
+#ifdef CONFIG_LIBOS_QUEUE_PADDED
+	q->tail_cache = tail;
+#endif
+	raw_out32(&q->head, tail);
 }
 
 struct chardev;
@@ -0,0 +1,179 @@
+/** @file
+ * Caches of fixed-size objects.
+ */
+
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBOS_SLAB_H
+#define LIBOS_SLAB_H
+
+#include <libos/alloc.h>
+
+#ifdef CONFIG_LIBOS_SLAB
+#include <libos/percpu.h>
+
+/** A cache of objects of one size.
+ *
+ * Objects are carved from slabs of at least SLAB_SIZE bytes, which are
+ * obtained with memalign() and are never returned, so this works on
+ * top of either dlmalloc or simple_alloc.  There is no per-object
+ * header; a free object is linked through its first word.
+ *
+ * The first SLAB_CPU_SLOTS caches used get a free list on each cpu,
+ * which is refilled from and drained to the shared list in batches of
+ * SLAB_BATCH objects.  Later caches use the shared list directly.
+ *
+ * Objects are not constructed or cleared on reuse; slab_zalloc() and
+ * slab_alloc_type() clear them like alloc() does.
+ */
+typedef struct slab_cache {
+	const char *name;
+	size_t objsize, align;
+
+	/// Index into cpu->slab[] plus one, zero if not yet assigned,
+	/// or -1 if there are no free slots.
+	int cpu_slot;
+
+	uint32_t lock;
+
+	/// Shared free list, protected by lock.
+	void *free;
+	unsigned int nfree;
+
+	/// Unused part of the most recent slab, protected by lock.
+	uint8_t *carve, *carve_end;
+
+	unsigned long slabs;
+} slab_cache_t;
+
+#define SLAB_SIZE  4096
+#define SLAB_BATCH 8
+
+#define __SLAB_ALIGN(align) \
+	((align) > sizeof(void *) ? (align) : sizeof(void *))
+
+#define SLAB_CACHE_INIT(NAME, SIZE, ALIGN) { \
+	.name = NAME, \
+	.objsize = ((SIZE) + __SLAB_ALIGN(ALIGN) - 1) & ~(__SLAB_ALIGN(ALIGN) - 1), \
+	.align = __SLAB_ALIGN(ALIGN), \
+}
+
+/** Define a cache for objects of type T.
+ *
+ * May be preceded by "static".
+ */
+#define DEFINE_SLAB_CACHE(C, T) \
+	slab_cache_t C = SLAB_CACHE_INIT(#T, sizeof(T), __alignof__(T))
+
+/** Initialize a cache at runtime.
+ *
+ * @param[in] c the cache to initialize
+ * @param[in] name name of the cache, for diagnostics
+ * @param[in] size size in bytes of each object
+ * @param[in] align alignment of each object, must be a power of two
+ */
+void slab_cache_init(slab_cache_t *c, const char *name,
+                     size_t size, size_t align);
+
+/** Allocate an object, without clearing it.
+ *
+ * @return the object, or NULL if out of memory.
+ */
+__attribute__((malloc)) void *slab_alloc(slab_cache_t *c);
+
+/** Return an object to the cache it was allocated from.
+ *
+ * @param[in] c the cache that obj was allocated from
+ * @param[in] obj the object to free, or NULL
+ */
+void slab_free(slab_cache_t *c, void *obj);
+
+/** Move the current cpu's free objects to the shared list.
+ *
+ * Call this before taking a cpu offline, so its objects can be
+ * reused by other cpus.
+ */
+void slab_cache_flush(slab_cache_t *c);
+
+static inline __attribute__((malloc)) void *slab_zalloc(slab_cache_t *c)
+{
+	void *ret = slab_alloc(c);
+
+	if (likely(ret))
+		memset(ret, 0, c->objsize);
+
+	return ret;
+}
+#else
+/* Without CONFIG_LIBOS_SLAB, caches are thin wrappers around alloc()
+ * and free(), so that users need not be conditional.
+ */
+typedef struct slab_cache {
+	size_t objsize, align;
+} slab_cache_t;
+
+#define SLAB_CACHE_INIT(NAME, SIZE, ALIGN) { \
+	.objsize = (SIZE), \
+	.align = (ALIGN), \
+}
+
+#define DEFINE_SLAB_CACHE(C, T) \
+	slab_cache_t C = SLAB_CACHE_INIT(#T, sizeof(T), __alignof__(T))
+
+static inline void slab_cache_init(slab_cache_t *c, const char *name,
+                                   size_t size, size_t align)
+{
+	c->objsize = size;
+	c->align = align;
+}
+
+static inline __attribute__((malloc)) void *slab_alloc(slab_cache_t *c)
+{
+	return alloc(c->objsize, c->align);
+}
+
+static inline __attribute__((malloc)) void *slab_zalloc(slab_cache_t *c)
+{
+	return alloc(c->objsize, c->align);
+}
+
+static inline void slab_free(slab_cache_t *c, void *obj)
+{
+	free(obj);
+}
+
+static inline void slab_cache_flush(slab_cache_t *c)
+{
+}
+#endif
+
+/** Allocate a cleared object of type T from cache C.
+ *
+ * This is the slab counterpart of alloc_type().  C must have been
+ * defined for T, or for a type at least as large and as aligned.
+ */
+#define slab_alloc_type(C, T) ((T *)slab_zalloc(C))
+
+#endif
@@ -1,6 +1,7 @@
 /** @file character device driver for byte channel hcalls
  *
- * Polling only, no interrupt support yet.
+ * Transmit is polled.  Receive is polled, or interrupt driven with
+ * optional hybrid interrupt/polled operation (see chardev_set_rx_poll()).
  */
 /*
  * Copyright (C) 2009,2010 Freescale Semiconductor, Inc.
@@ -37,6 +38,10 @@ typedef struct byte_chan {
 	chardev_t cd;
 	interrupt_t *rxirq, *txirq;
 	int handle;
+	int rx_registered;
+	/// Rx is masked until the consumer makes room in cd.rx.
+	int rx_full;
+	uint32_t lock;
 } byte_chan_t;
 
 static ssize_t byte_chan_rx(chardev_t *cd, uint8_t *buf,
@@ -90,9 +95,186 @@ static ssize_t byte_chan_tx(chardev_t *cd, const uint8_t *buf,
 		return total;
 }
 
+#if defined(INTERRUPTS) && defined(CONFIG_LIBOS_QUEUE)
+/* Most bytes received per rx interrupt.  Any more are left for the
+ * interrupt to be taken again, so other work can run in between.
+ */
+#define BYTE_CHAN_RX_BUDGET 256
+
+/** Move received data into the rx queue.
+ *
+ * Receives at most "budget" bytes.  Bytes that don't fit in the queue
+ * are dropped.  Call with priv->lock held.
+ *
+ * @return the number of bytes added to the queue
+ */
+static size_t byte_chan_rx_drain(byte_chan_t *priv, size_t budget)
+{
+	size_t total = 0, len = 0;
+	char buf[16];
+
+	while (total < budget) {
+		unsigned int count = min(budget - total, sizeof(buf));
+
+		if (ev_byte_channel_receive(priv->handle, &count, buf) ||
+		    count == 0)
+			break;
+
+		total += count;
+		len += queue_write(priv->cd.rx, (const uint8_t *)buf, count);
+	}
+
+	return len;
+}
+
+/* The rx queue's space_avail callback: unmask rx if it was masked
+ * because the queue filled up.
+ */
+static void byte_chan_rx_space(queue_t *q)
+{
+	byte_chan_t *priv = q->producer;
+
+	register_t saved = spin_lock_intsave(&priv->lock);
+
+	if (priv->rx_full && priv->cd.rx == q && queue_get_space(q) > 0) {
+		priv->rx_full = 0;
+
+		if (!priv->cd.rxpoll.polling)
+			priv->rxirq->ops->enable(priv->rxirq);
+	}
+
+	spin_unlock_intsave(&priv->lock, saved);
+}
+
+static int byte_chan_rx_isr(void *arg)
+{
+	byte_chan_t *priv = arg;
+	queue_t *q;
+	size_t len = 0;
+
+	spin_lock(&priv->lock);
+
+	q = priv->cd.rx;
+	if (q) {
+		size_t space = queue_get_space(q);
+
+		len = byte_chan_rx_drain(priv,
+		                         min(space, (size_t)BYTE_CHAN_RX_BUDGET));
+
+		if (len == space) {
+			/* Leave the rest in the channel, rather than taking
+			 * the interrupt again and again, until the consumer
+			 * makes room.
+			 */
+			priv->rx_full = 1;
+			priv->rxirq->ops->disable(priv->rxirq);
+		} else if (chardev_rx_irq_policy(&priv->cd, len)) {
+			/* Under load, leave the rest to chardev_rx_poll(). */
+			priv->rxirq->ops->disable(priv->rxirq);
+		}
+	}
+
+	spin_unlock(&priv->lock);
+
+	if (len > 0)
+		queue_notify_consumer(q, 0);
+
+	/* A consumer that reads from data_avail, such as readline,
+	 * doesn't call space_avail.
+	 */
+	if (q && priv->rx_full)
+		byte_chan_rx_space(q);
+
+	return 0;
+}
+
+static int byte_chan_set_rx_queue(chardev_t *cd, queue_t *q)
+{
+	byte_chan_t *priv = to_container(cd, byte_chan_t, cd);
+	interrupt_t *irq = priv->rxirq;
+	int ret = 0;
+
+	if (!irq || !irq->ops->register_irq)
+		return ERR_INVALID;
+
+	register_t saved = spin_lock_intsave(&priv->lock);
+
+	if (q && cd->rx) {
+		ret = ERR_BUSY;
+		goto out;
+	}
+
+	if (cd->rx)
+		cd->rx->space_avail = NULL;
+
+	cd->rx = q;
+	cd->rxpoll.polling = 0;
+	priv->rx_full = 0;
+
+	if (q) {
+		q->producer = priv;
+		q->space_avail = byte_chan_rx_space;
+	}
+
+	if (!q) {
+		irq->ops->disable(irq);
+	} else if (priv->rx_registered) {
+		irq->ops->enable(irq);
+	} else {
+		/* Register on first use, so that data isn't taken away
+		 * from polled readers before there is a queue for it.
+		 */
+		ret = irq->ops->register_irq(irq, byte_chan_rx_isr,
+		                             priv, TYPE_NORM);
+		if (ret == 0) {
+			priv->rx_registered = 1;
+		} else {
+			q->space_avail = NULL;
+			cd->rx = NULL;
+		}
+	}
+
+out:
+	spin_unlock_intsave(&priv->lock, saved);
+	return ret;
+}
+
+/* Only called through chardev_rx_poll(), which libos never calls
+ * itself.  A client that enables polled mode must call it, or rx stays
+ * masked after the first burst over the threshold.
+ */
+static size_t byte_chan_rx_poll(chardev_t *cd, size_t budget)
+{
+	byte_chan_t *priv = to_container(cd, byte_chan_t, cd);
+	size_t len = 0;
+
+	register_t saved = spin_lock_intsave(&priv->lock);
+
+	if (!cd->rxpoll.polling || !cd->rx)
+		goto out;
+
+	/* Leave what doesn't fit in the channel, rather than dropping it. */
+	len = byte_chan_rx_drain(priv, min(budget, queue_get_space(cd->rx)));
+
+	if (queue_get_space(cd->rx) > 0)
+		priv->rx_full = 0;
+
+	if (chardev_rx_poll_policy(cd, len) && !priv->rx_full)
+		priv->rxirq->ops->enable(priv->rxirq);
+
+out:
+	spin_unlock_intsave(&priv->lock, saved);
+	return len;
+}
+#endif
+
 static const chardev_ops ops = {
 	.tx = byte_chan_tx,
 	.rx = byte_chan_rx,
+#if defined(INTERRUPTS) && defined(CONFIG_LIBOS_QUEUE)
+	.set_rx_queue = byte_chan_set_rx_queue,
+	.rx_poll = byte_chan_rx_poll,
+#endif
 };
 
 chardev_t *byte_chan_init(int handle, interrupt_t *rxirq, interrupt_t *txirq)
@@ -26,6 +26,8 @@
 
 #include <libos/console.h>
 #include <libos/percpu.h> 
+#include <libos/mpmc-queue.h>
+#include <libos/errors.h>
 
 static chardev_t *console;
 #ifdef CONFIG_LIBOS_QUEUE
@@ -78,6 +80,131 @@ static void drain_consolebuf(void)
 }
 #endif
 
+#ifdef CONFIG_LIBOS_CONSOLE_FANIN
+/* Output queued by console_write_fanin(), already CR/LF expanded.  It
+ * is only consumed with console_lock held, so it has one consumer at
+ * a time.
+ */
+DECLARE_STATIC_MPMC_QUEUE(console_fanin, 4096);
+
+/* Move fan-in output into consolebuf.  Call with console_lock held. */
+static void fanin_drain(void)
+{
+	mpmc_resv_t resv;
+
+	while (!mpmc_queue_empty(&console_fanin)) {
+		size_t space = queue_get_space(&consolebuf);
+		size_t len, first;
+
+		if (space == 0) {
+			drain_consolebuf();
+			space = queue_get_space(&consolebuf);
+		}
+
+		/* Still full -- drop it, as console_write_nolock() does. */
+		if (space == 0) {
+			len = mpmc_queue_reserve_read(&console_fanin, &resv,
+			                              console_fanin.size);
+			mpmc_queue_commit_read(&console_fanin, &resv);
+			break;
+		}
+
+		len = mpmc_queue_reserve_read(&console_fanin, &resv, space);
+		first = min(len, console_fanin.size -
+		                 mpmc_queue_wrap(&console_fanin, resv.start));
+
+		queue_write(&consolebuf, mpmc_queue_ptr(&console_fanin, &resv, 0),
+		            first);
+		queue_write(&consolebuf, console_fanin.buf, len - first);
+		mpmc_queue_commit_read(&console_fanin, &resv);
+	}
+
+	queue_notify_consumer(&consolebuf, 0);
+
+	if (queue_get_space(&consolebuf) < consolebuf.size / 2)
+		drain_consolebuf();
+}
+
+/* Drain the fan-in if no one else is.  Call with interrupts disabled. */
+static void fanin_flush(void)
+{
+	while (1) {
+		/* Order the commit of our output before the check of the
+		 * lock, and the holder's unlock before its check of the
+		 * queue.  One of the two then sees the other's update,
+		 * so output is never left behind.
+		 */
+		smp_sync();
+
+		if (!spin_trylock(&console_lock))
+			return;
+
+		fanin_drain();
+		spin_unlock(&console_lock);
+		smp_sync();
+
+		if (mpmc_queue_empty(&console_fanin))
+			return;
+	}
+}
+
+int console_write_fanin(const char *s, size_t len)
+{
+	mpmc_resv_t resv;
+	size_t i, nl = 0, off = 0;
+	int ret;
+
+	len = strnlen(s, len);
+	for (i = 0; i < len; i++)
+		nl += s[i] == '\n';
+
+	register_t saved = disable_int_save();
+
+	/* A commit waits for every earlier reservation, so a critical or
+	 * machine check handler must not reserve while the code it
+	 * interrupted holds a reservation on the same cpu.
+	 */
+	if (cpu->console_fanin_busy) {
+		restore_int(saved);
+		return ERR_BUSY;
+	}
+
+	cpu->console_fanin_busy = 1;
+
+	ret = mpmc_queue_reserve_write(&console_fanin, &resv, len + nl);
+	if (ret == 0) {
+		while (len > 0) {
+			const char *end = memchr(s, '\n', len);
+			size_t run = end ? (size_t)(end - s) : len;
+
+			mpmc_queue_copy_in(&console_fanin, &resv, off,
+			                   (const uint8_t *)s, run);
+			off += run;
+
+			if (end) {
+				mpmc_queue_copy_in(&console_fanin, &resv, off,
+				                   (const uint8_t *)"\r\n", 2);
+				off += 2;
+				run++;
+			}
+
+			s += run;
+			len -= run;
+		}
+
+		mpmc_queue_commit_write(&console_fanin, &resv);
+	}
+
+	cpu->console_fanin_busy = 0;
+
+	if (ret == 0)
+		fanin_flush();
+
+	restore_int(saved);
+	return ret;
+}
+#endif
+
 void console_init(chardev_t *cd)
 {
 #ifdef CONFIG_LIBOS_QUEUE
@@ -129,13 +256,46 @@ void console_write_nolock(const char *s, size_t len)
 #ifdef CONFIG_LIBOS_QUEUE
 	queue_t *q = &consolebuf;
 
+#ifdef CONFIG_LIBOS_CONSOLE_FANIN
+	/* Keep this cpu's earlier fan-in output ahead of this write.
+	 * A crashing cpu may have interrupted a fan-in reservation of its
+	 * own, so it leaves the fan-in alone.
+	 */
+	if (likely(!cpu->crashing))
+		fanin_drain();
+#endif
+
 	if (unlikely(cpu->crashing) && qconsole) {
 		q = qconsole;
 		queue_notify_consumer(q, 1);
 	}
 
-	while (*s && len--)
-		putchar_nolock(q, *s++);
+	/* If we're crashing and we have a direct console device,
+	 * putchar_nolock() will bypass the queue.
+	 */
+	if (unlikely(cpu->crashing) && console && cpu->console_ok) {
+		while (*s && len--)
+			putchar_nolock(q, *s++);
+	} else {
+		len = strnlen(s, len);
+
+		while (len > 0) {
+			ssize_t ret = queue_write_crlf(q, (const uint8_t *)s, len);
+
+			if (ret == 0) {
+				/* Queue full -- try to make room once, and
+				 * drop the rest if that doesn't help.
+				 */
+				drain_consolebuf();
+				ret = queue_write_crlf(q, (const uint8_t *)s, len);
+				if (ret == 0)
+					break;
+			}
+
+			s += ret;
+			len -= ret;
+		}
+	}
 
 	queue_notify_consumer(q, cpu->crashing);
 
@@ -165,6 +325,11 @@ void console_write(const char *s, size_t len)
 		lock = 0;
 	}
 
+#ifdef CONFIG_LIBOS_CONSOLE_FANIN
+	if (lock && console_write_fanin(s, len) == 0)
+		return;
+#endif
+
 	register_t saved = disable_int_save();
 
 	if (lock)
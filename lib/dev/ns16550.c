@@ -42,6 +42,12 @@
 // FIXME -- get clock from device tree
 #define get_system_clock() 266
 
+/* Maximum number of IIR conditions serviced per interrupt */
+#define NS16550_ISR_BUDGET 8
+
+/* Bytes of rx queue reserved at a time; the depth of the rx FIFO */
+#define NS16550_RX_BURST 16
+
 typedef struct {
 	chardev_t cd;
 	uint8_t *reg;
@@ -64,21 +70,24 @@ typedef struct {
 
 static void __ns16550_tx_callback(ns16550 *priv)
 {
-	int i;
+	queue_span_t span;
+	size_t len, i, j;
 
 	if (in8(&priv->reg[NS16550_LSR]) & NS16550_LSR_THRE) {
-		for (i = 0; i < priv->txfifo; i++) {
-			int c = queue_readchar(priv->cd.tx, 0);
-			if (c < 0) {
-				out8(&priv->reg[NS16550_IER],
-				     in8(&priv->reg[NS16550_IER]) & ~NS16550_IER_ETHREI);
-			
-				return;
-			}
-	
-			priv->tx_counter++;
-			out8(&priv->reg[NS16550_THR], c);
+		len = queue_peek_span(priv->cd.tx, &span, priv->txfifo);
+		if (len == 0) {
+			out8(&priv->reg[NS16550_IER],
+			     in8(&priv->reg[NS16550_IER]) & ~NS16550_IER_ETHREI);
+		
+			return;
 		}
+
+		for (i = 0; i < 2; i++)
+			for (j = 0; j < span.len[i]; j++)
+				out8(&priv->reg[NS16550_THR], span.buf[i][j]);
+
+		priv->tx_counter += len;
+		queue_consume(priv->cd.tx, len);
 	}
 
 	out8(&priv->reg[NS16550_IER],
@@ -110,6 +119,57 @@ static void ns16550_tx_callback(queue_t *q, int blocking)
 	restore_int(saved);
 }
 
+/** Move received data into the rx queue.
+ *
+ * Reads at most "budget" bytes.  Bytes that don't fit in the queue
+ * are dropped.  Call with priv->lock held.
+ *
+ * The queue is reserved one FIFO's worth at a time rather than all at
+ * once, so that with CONFIG_LIBOS_QUEUE_PADDED the cached consumer
+ * index is only reloaded when the queue is nearly full.
+ *
+ * @return the number of bytes added to the queue
+ */
+static size_t ns16550_rx_drain(ns16550 *priv, size_t budget)
+{
+	queue_span_t span;
+	size_t space = 0, len = 0, count = 0, total = 0;
+
+	while (count < budget &&
+	       (in8(&priv->reg[NS16550_LSR]) & NS16550_LSR_DR)) {
+		uint8_t data = in8(&priv->reg[NS16550_RBR]);
+		priv->rx_counter++;
+		count++;
+
+		if (len == space && priv->cd.rx) {
+			if (len > 0)
+				queue_commit_write(priv->cd.rx, len);
+
+			total += len;
+			len = 0;
+			space = queue_reserve_write(priv->cd.rx, &span,
+			                            NS16550_RX_BURST);
+		}
+
+		if (len < space) {
+			if (len < span.len[0])
+				span.buf[0][len] = data;
+			else
+				span.buf[1][len - span.len[0]] = data;
+
+			len++;
+		} else {
+			/* Queue full, or no queue (should never happen) */
+			priv->err_counter++;
+		}
+	}
+
+	if (len > 0)
+		queue_commit_write(priv->cd.rx, len);
+
+	return total + len;
+}
+
 /*!
 
     @brief UART ISR for tx and rx
@@ -129,6 +189,7 @@ static int ns16550_isr(void *arg)
 	ns16550 *priv = arg;
 	uint8_t iir, lsr;
 	int rx_notify = 0, tx_notify = 0;
+	int budget = NS16550_ISR_BUDGET;
 
 	spin_lock(&priv->lock);
 
@@ -137,46 +198,56 @@ static int ns16550_isr(void *arg)
 		spin_unlock(&priv->lock);
 		return -1;
 	}
-	
-	iir &= NS16550_IIR_IID;
 
-	if (iir == NS16550_IIR_MSI)
-		in8(&priv->reg[NS16550_MSR]);
+	/* Service every pending condition before returning, rather than
+	 * taking a separate interrupt for each one.  The budget keeps a
+	 * condition that won't clear from holding the cpu forever.
+	 */
+	do {
+		iir &= NS16550_IIR_IID;
 
-	/* Receiver Line Status Error */
-	if (iir == NS16550_IIR_RLSI) {
-		lsr = in8(&priv->reg[NS16550_LSR]);
-		if (lsr & NS16550_LSR_OE)
-			priv->err_counter++;
-		if (lsr & NS16550_LSR_RFE)
-			priv->err_counter++;
-	}
+		if (iir == NS16550_IIR_MSI)
+			in8(&priv->reg[NS16550_MSR]);
 
-	/* Either receiver data available or receiver timeout, call store */
-	if (iir == NS16550_IIR_RDAI || iir == NS16550_IIR_RXTIME) {
-		while (in8(&priv->reg[NS16550_LSR]) & NS16550_LSR_DR) {
-			uint8_t data = in8(&priv->reg[NS16550_RBR]);
-			priv->rx_counter++;
-
-			if (priv->cd.rx) {
-				int ret = queue_writechar(priv->cd.rx, data);
-				if (ret < 0)
-					priv->err_counter++; 
-				else
-					rx_notify = 1;
-			} else {
-				/* Should never happen... */
+		/* Receiver Line Status Error */
+		if (iir == NS16550_IIR_RLSI) {
+			lsr = in8(&priv->reg[NS16550_LSR]);
+			if (lsr & NS16550_LSR_OE)
 				priv->err_counter++;
+			if (lsr & NS16550_LSR_RFE)
+				priv->err_counter++;
+		}
+
+		/* Either receiver data available or receiver timeout, call store */
+		if (iir == NS16550_IIR_RDAI || iir == NS16550_IIR_RXTIME) {
+			size_t len = ns16550_rx_drain(priv, ~0UL);
+
+			if (len > 0)
+				rx_notify = 1;
+
+			/* Under load, leave the rest to chardev_rx_poll(). */
+			if (chardev_rx_irq_policy(&priv->cd, len)) {
+				uint8_t ier = in8(&priv->reg[NS16550_IER]);
+				ier &= ~NS16550_IER_ERDAI;
+				out8(&priv->reg[NS16550_IER], ier);
 			}
 		}
-	}
 
-	/* Transmitter holding register empty */
-	/* Try to transmit data - if no data available desactivate ISR */
-	if (iir == NS16550_IIR_THREI && priv->cd.tx) {
-		__ns16550_tx_callback(priv);
-		tx_notify = 1;
-	}
+		/* Transmitter holding register empty */
+		/* Try to transmit data - if no data available desactivate ISR */
+		if (iir == NS16550_IIR_THREI && priv->cd.tx) {
+			__ns16550_tx_callback(priv);
+			tx_notify = 1;
+		}
+
+		/* Check the budget first: reading IIR clears a THRE
+		 * indication, which must not be read and then dropped.
+		 */
+		if (--budget == 0)
+			break;
+
+		iir = in8(&priv->reg[NS16550_IIR]);
+	} while (!(iir & NS16550_IIR_NOIRQ));
 
 	spin_unlock(&priv->lock);
 
@@ -252,6 +323,7 @@ static int ns16550_set_rx_queue(chardev_t *cd, queue_t *q)
 	}
 
 	cd->rx = q;
+	cd->rxpoll.polling = 0;
 
 	if (q)
 		out8(&priv->reg[NS16550_IER],
@@ -264,6 +336,34 @@ out:
 	spin_unlock_intsave(&priv->lock, saved);
 	return ret;
 }
+
+/* Only called through chardev_rx_poll(), which libos never calls
+ * itself.  A client that enables polled mode must call it, or the
+ * receive interrupt stays disabled after the first burst over the
+ * threshold, and the FIFO overruns.
+ */
+static size_t ns16550_rx_poll(chardev_t *cd, size_t budget)
+{
+	ns16550 *priv = to_container(cd, ns16550, cd);
+	size_t len = 0;
+
+	/* The rx interrupt is delivered as a critical interrupt. */
+	register_t saved = spin_lock_critsave(&priv->lock);
+
+	if (!cd->rxpoll.polling || !cd->rx)
+		goto out;
+
+	/* Leave what doesn't fit in the FIFO, rather than dropping it. */
+	len = ns16550_rx_drain(priv, min(budget, queue_get_space(cd->rx)));
+
+	if (chardev_rx_poll_policy(cd, len))
+		out8(&priv->reg[NS16550_IER],
+		     in8(&priv->reg[NS16550_IER]) | NS16550_IER_ERDAI);
+
+out:
+	spin_unlock_critsave(&priv->lock, saved);
+	return len;
+}
 #endif
 
 static ssize_t ns16550_tx(chardev_t *cd, const uint8_t *buf,
@@ -305,6 +405,7 @@ static const chardev_ops ops = {
 #if defined(INTERRUPTS) && defined(CONFIG_LIBOS_QUEUE)
 	.set_tx_queue = ns16550_set_tx_queue,
 	.set_rx_queue = ns16550_set_rx_queue,
+	.rx_poll = ns16550_rx_poll,
 #endif
 };
 
@@ -27,32 +27,188 @@
 
 #include <libos/libos.h>
 #include <libos/errors.h>
+#include <libos/bitops.h>
 #include <string.h>
 
 extern driver_t driver_begin, driver_end;
 
+/* Every compatible string of every driver, hashed, so that binding a
+ * device takes one lookup per string in its compatible list rather
+ * than a scan of every driver.  The index is built on first use.  If
+ * the drivers have more compatibles than it can hold, binding falls
+ * back to the scan.
+ */
+#define COMPAT_HASH_BUCKETS 128
+#define COMPAT_HASH_ENTRIES 256
+
+/* Most drivers a single device can match before falling back */
+#define BIND_MAX_CANDIDATES 16
+
+typedef struct compat_entry {
+	driver_t *drv;
+	const dev_compat_t *compat;
+	uint32_t hash;
+	uint16_t next; /* index + 1 of the next entry in the bucket, or 0 */
+} compat_entry_t;
+
+typedef struct bind_candidate {
+	driver_t *drv;
+	const dev_compat_t *compat;
+} bind_candidate_t;
+
+static compat_entry_t compat_entries[COMPAT_HASH_ENTRIES];
+static uint16_t compat_buckets[COMPAT_HASH_BUCKETS];
+static uint32_t compat_index_lock;
+
+/* 0 if not built yet, 1 if built, -1 if there were too many entries */
+static int compat_index_state;
+
+/* FNV-1a */
+static uint32_t compat_hash(const char *str)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (uint8_t)*str++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+/* Entries are added in reverse, at the head of each bucket, so that
+ * each bucket ends up in driver order and then compatible-list order.
+ */
+static int build_compat_index(void)
+{
+	int num = 0, i;
+
+	for (driver_t *drv = &driver_begin; drv < &driver_end; drv++)
+		for (i = 0; drv->compatibles[i].compatible; i++)
+			num++;
+
+	if (num > COMPAT_HASH_ENTRIES)
+		return -1;
+
+	for (driver_t *drv = &driver_end - 1; drv >= &driver_begin; drv--) {
+		for (i = 0; drv->compatibles[i].compatible; i++)
+			;
+
+		while (--i >= 0) {
+			compat_entry_t *ent = &compat_entries[--num];
+			unsigned int bucket;
+
+			ent->drv = drv;
+			ent->compat = &drv->compatibles[i];
+			ent->hash = compat_hash(ent->compat->compatible);
+
+			bucket = ent->hash % COMPAT_HASH_BUCKETS;
+			ent->next = compat_buckets[bucket];
+			compat_buckets[bucket] = num + 1;
+		}
+	}
+
+	return 1;
+}
+
+/* Find the drivers matching a compatible list, in driver order, each
+ * with the compatible entry that match_compat() would return.
+ *
+ * @return the number of candidates, or -1 if the index can't be used
+ */
+static int find_candidates(const char *strlist, size_t len,
+                           bind_candidate_t *cand)
+{
+	size_t pos = 0;
+	const char *str;
+	int num = 0, i;
+
+	register_t saved = spin_lock_intsave(&compat_index_lock);
+
+	if (!compat_index_state)
+		compat_index_state = build_compat_index();
+
+	spin_unlock_intsave(&compat_index_lock, saved);
+
+	if (compat_index_state < 0)
+		return -1;
+
+	while ((str = strlist_iterate(strlist, len, &pos))) {
+		uint32_t hash = compat_hash(str);
+		unsigned int idx = compat_buckets[hash % COMPAT_HASH_BUCKETS];
+
+		while (idx) {
+			compat_entry_t *ent = &compat_entries[idx - 1];
+			idx = ent->next;
+
+			if (ent->hash != hash || strcmp(str, ent->compat->compatible))
+				continue;
+
+			/* An earlier string already matched this driver. */
+			for (i = 0; i < num; i++)
+				if (cand[i].drv == ent->drv)
+					break;
+
+			if (i < num)
+				continue;
+
+			if (num == BIND_MAX_CANDIDATES)
+				return -1;
+
+			for (i = num++; i > 0 && cand[i - 1].drv > ent->drv; i--)
+				cand[i] = cand[i - 1];
+
+			cand[i].drv = ent->drv;
+			cand[i].compat = ent->compat;
+		}
+	}
+
+	return num;
+}
+
+static int probe_driver(device_t *dev, driver_t *drv,
+                        const dev_compat_t *compat_id)
+{
+	int ret;
+
+	dev->driver = drv;
+
+	ret = drv->probe(dev, compat_id);
+
+	if (ret)
+		dev->driver = NULL;
+
+	return ret;
+}
+
 int libos_bind_driver(device_t *dev, const char *compat_strlist, size_t compat_len)
 {
+	bind_candidate_t cand[BIND_MAX_CANDIDATES];
 	const dev_compat_t *compat_id;
-	int ret;
+	int num, ret;
+
+	num = find_candidates(compat_strlist, compat_len, cand);
+
+	if (num >= 0) {
+		for (int i = 0; i < num; i++) {
+			ret = probe_driver(dev, cand[i].drv, cand[i].compat);
+			if (ret != ERR_UNHANDLED)
+				return ret;
+		}
+
+		return ERR_UNHANDLED;
+	}
 
 	for (driver_t *drv = &driver_begin; drv < &driver_end; drv++) {
 		compat_id = match_compat(compat_strlist, compat_len, drv->compatibles);
 		if (!compat_id)
 			continue;
 
-		dev->driver = drv;
-
-		ret = drv->probe(dev, compat_id);
-
-		if (ret)
-			dev->driver = NULL;
-
+		ret = probe_driver(dev, drv, compat_id);
 		if (ret ==  ERR_UNHANDLED)
 			continue;
 
 		return ret;
-
 	}
 
 	return ERR_UNHANDLED;
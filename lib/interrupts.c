@@ -23,6 +23,8 @@
  */
 
 #include <libos/interrupts.h>
+#include <libos/percpu.h>
+#include <libos/io.h>
 
 void interrupt_reset(interrupt_t *irq)
 {
@@ -52,3 +54,94 @@ void interrupt_unmask(interrupt_t *irq)
 
 	spin_unlock_mchksave(&irq->lock, save);
 }
+
+/* Cpus that have ever walked an action list.  A cpu that isn't here
+ * yet will see any update made before it registers, because both
+ * sides order their store and load with a sync.
+ */
+static cpu_t *irq_cpus[CONFIG_LIBOS_MAX_CPUS];
+static int irq_num_cpus;
+static uint32_t irq_cpus_lock;
+
+static void irq_register_cpu(void)
+{
+	register_t saved = spin_lock_mchksave(&irq_cpus_lock);
+
+	if (!cpu->irq_registered) {
+		assert(irq_num_cpus < CONFIG_LIBOS_MAX_CPUS);
+		irq_cpus[irq_num_cpus] = cpu;
+		smp_lwsync();
+		irq_num_cpus++;
+		cpu->irq_registered = 1;
+	}
+
+	spin_unlock_mchksave(&irq_cpus_lock, saved);
+}
+
+void irq_dispatch_enter(void)
+{
+	if (unlikely(!cpu->irq_registered))
+		irq_register_cpu();
+
+	/* A nested interrupt between the load and store of irq_depth
+	 * restores it before returning, so no atomic is needed.
+	 */
+	cpu->irq_depth++;
+
+	/* Order the depth store before the loads of the list. */
+	smp_sync();
+}
+
+void irq_dispatch_exit(void)
+{
+	/* Finish the loads of the list before saying we're done. */
+	smp_lwsync();
+
+	if (!--cpu->irq_depth)
+		cpu->irq_exits++;
+}
+
+void irq_synchronize(void)
+{
+	int num;
+
+	assert(!cpu->irq_depth);
+
+	/* Order the caller's unlink before the loads of irq_depth. */
+	smp_sync();
+
+	num = raw_in32((uint32_t *)&irq_num_cpus);
+	smp_lwsync();
+
+	for (int i = 0; i < num; i++) {
+		cpu_t *c = irq_cpus[i];
+		uint32_t exits = raw_in32(&c->irq_exits);
+
+		smp_lwsync();
+
+		while (raw_in32(&c->irq_depth) &&
+		       raw_in32(&c->irq_exits) == exits)
+			;
+	}
+
+	smp_sync();
+}
+
+irqaction_t *irq_unlink_action(interrupt_t *irq, void *devid)
+{
+	irqaction_t **prev, *action;
+
+	for (prev = &irq->actions; *prev; prev = &(*prev)->next) {
+		action = *prev;
+
+		/* Walks already on this action still follow its next
+		 * pointer, which is left intact.
+		 */
+		if (action->devid == devid) {
+			*prev = action->next;
+			return action;
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,383 @@
+/** @file
+ * Per-cpu log buffers for deferred printlog() output.
+ */
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <libos/logbuf.h>
+#include <libos/printlog.h>
+#include <libos/percpu.h>
+#include <libos/bitops.h>
+#include <libos/io.h>
+#include <libos/errors.h>
+
+/* Longest message text stored; anything longer is truncated.  Text
+ * messages are formatted on the stack first, so this is kept small.
+ */
+#define LOGBUF_MAX_TEXT (CONFIG_LIBOS_PERCPU_LOG_SIZE / 4 < 256 ? \
+                         CONFIG_LIBOS_PERCPU_LOG_SIZE / 4 : 256)
+
+/* List of registered logbufs, holding a logbuf_t pointer. */
+static unsigned long logbuf_list;
+static uint32_t drain_lock;
+
+static logbuf_t *logbuf_first(void)
+{
+	logbuf_t *lb = (logbuf_t *)*(volatile unsigned long *)&logbuf_list;
+
+	smp_lwsync();
+	return lb;
+}
+
+static void logbuf_register(logbuf_t *lb)
+{
+	unsigned long old;
+
+	/* An interrupt may get here first, on the same cpu. */
+	if (!compare_and_swap32(&lb->registered, 0, 1))
+		return;
+
+	lb->pir = mfspr(SPR_PIR);
+
+	do {
+		old = *(volatile unsigned long *)&logbuf_list;
+		lb->next = (logbuf_t *)old;
+		smp_lwsync();
+	} while (!compare_and_swap(&logbuf_list, old, (unsigned long)lb));
+}
+
+static logrec_t *logbuf_reserve(logbuf_t *lb, size_t size)
+{
+	uint32_t head, tail, off, pad;
+	logrec_t *rec;
+
+	size = align(size, LOGREC_ALIGN);
+
+	do {
+		tail = raw_in32(&lb->tail);
+		head = raw_in32(&lb->head);
+
+		off = tail & (sizeof(lb->buf) - 1);
+		pad = sizeof(lb->buf) - off < size ? sizeof(lb->buf) - off : 0;
+
+		if (tail + pad + size - head > sizeof(lb->buf))
+			return NULL;
+	} while (!compare_and_swap32(&lb->tail, tail, tail + pad + size));
+
+	/* Don't write the record until the drainer is done with it. */
+	smp_lwsync();
+
+	if (pad) {
+		rec = (logrec_t *)&lb->buf[off];
+		raw_out32(&rec->info, LOGREC_READY | LOGREC_PAD | pad);
+		off = 0;
+	}
+
+	rec = (logrec_t *)&lb->buf[off];
+	rec->tb = get_tb();
+	return rec;
+}
+
+static void logbuf_commit(logrec_t *rec, size_t size, uint32_t flags)
+{
+	smp_lwsync();
+	raw_out32(&rec->info, LOGREC_READY | flags | align(size, LOGREC_ALIGN));
+}
+
+/* Clear the whole record, not just its info word: the next record
+ * reserved here may start anywhere inside it, and the drainer reads
+ * that record's info before the writer has stored it.
+ */
+static void logbuf_consume(logbuf_t *lb, logrec_t *rec)
+{
+	uint32_t size = raw_in32(&rec->info) & LOGREC_SIZE;
+
+	memset(rec, 0, size);
+	smp_lwsync();
+	raw_out32(&lb->head, lb->head + size);
+}
+
+static logrec_t *logbuf_head(logbuf_t *lb)
+{
+	return (logrec_t *)&lb->buf[lb->head & (sizeof(lb->buf) - 1)];
+}
+
+/* Return the oldest ready record, skipping over padding.
+ * This must only be called by the drainer.
+ */
+static logrec_t *logbuf_peek(logbuf_t *lb)
+{
+	while (lb->head != raw_in32(&lb->tail)) {
+		logrec_t *rec;
+		uint32_t info;
+
+		rec = logbuf_head(lb);
+		info = raw_in32(&rec->info);
+		if (!(info & LOGREC_READY))
+			return NULL;
+
+		/* Order loads of the record after the load of info. */
+		smp_lwsync();
+
+		if (!(info & LOGREC_PAD))
+			return rec;
+
+		logbuf_consume(lb, rec);
+	}
+
+	return NULL;
+}
+
+static int logbuf_append(logbuf_t *lb, unsigned int logtype,
+                         unsigned int loglevel, const char *fmt, va_list args)
+{
+	char text[LOGBUF_MAX_TEXT + 1];
+	logrec_t *rec;
+	size_t len, size;
+
+	len = vsnprintf(text, sizeof(text), fmt, args);
+	if (len > LOGBUF_MAX_TEXT)
+		len = LOGBUF_MAX_TEXT;
+
+	size = sizeof(logrec_t) + len + 1;
+
+	rec = logbuf_reserve(lb, size);
+	if (!rec)
+		return ERR_BUSY;
+
+	rec->len = len;
+	rec->logtype = logtype;
+	rec->loglevel = loglevel;
+	memcpy(rec->text, text, len + 1);
+
+	logbuf_commit(rec, size, 0);
+	return 0;
+}
+
+#ifdef CONFIG_LIBOS_PERCPU_LOG_BINARY
+/* Binary records hold the format string pointer and the saved
+ * arguments in 64-bit words, followed by copies of any %s strings.
+ * rec->len is the number of arguments.  Returns ERR_RANGE if the
+ * message is not suitable for a binary record.
+ */
+static int logbuf_append_binary(logbuf_t *lb, unsigned int logtype,
+                                unsigned int loglevel, const char *fmt,
+                                va_list args)
+{
+	uint64_t argv[LOGREC_MAX_ARGS];
+	size_t strlens[LOGREC_MAX_ARGS];
+	size_t strsize = 0, size, off = 0;
+	va_list args_copy;
+	uint32_t strmask;
+	uint64_t *words;
+	logrec_t *rec;
+	char *strbase;
+	int argc, i;
+
+	va_copy(args_copy, args);
+	argc = printf_save_args(fmt, args_copy, argv, LOGREC_MAX_ARGS, &strmask);
+	va_end(args_copy);
+
+	if (argc < 0)
+		return ERR_RANGE;
+
+	for (i = 0; i < argc; i++) {
+		const char *str = (const char *)(uintptr_t)argv[i];
+
+		if ((strmask & (1U << i)) && str) {
+			strlens[i] = strnlen(str, LOGBUF_MAX_TEXT);
+			strsize += strlens[i] + 1;
+		}
+	}
+
+	if (strsize > LOGBUF_MAX_TEXT)
+		return ERR_RANGE;
+
+	size = sizeof(logrec_t) + (argc + 1) * sizeof(uint64_t) + strsize;
+
+	rec = logbuf_reserve(lb, size);
+	if (!rec)
+		return ERR_BUSY;
+
+	rec->len = argc;
+	rec->logtype = logtype;
+	rec->loglevel = loglevel;
+
+	words = (uint64_t *)rec->text;
+	strbase = (char *)&words[argc + 1];
+	words[0] = (uintptr_t)fmt;
+
+	for (i = 0; i < argc; i++) {
+		const char *str = (const char *)(uintptr_t)argv[i];
+
+		if (!(strmask & (1U << i))) {
+			words[i + 1] = argv[i];
+		} else if (!str) {
+			words[i + 1] = PRINTF_NULL_STR;
+		} else {
+			memcpy(&strbase[off], str, strlens[i]);
+			strbase[off + strlens[i]] = 0;
+			words[i + 1] = off;
+			off += strlens[i] + 1;
+		}
+	}
+
+	logbuf_commit(rec, size, LOGREC_BINARY);
+	return 0;
+}
+
+static void logbuf_print_binary(logbuf_t *lb, logrec_t *rec)
+{
+	/* Only used by the drainer, which is serialized. */
+	static char buf[LOGBUF_MAX_TEXT + 1];
+	const uint64_t *words = (const uint64_t *)rec->text;
+
+	vsnprintf_argv(buf, sizeof(buf), (const char *)(uintptr_t)words[0],
+	               &words[1], (const char *)&words[rec->len + 1]);
+
+	printf("[%u] %s", lb->pir, buf);
+}
+#endif
+
+static int logbufs_pending(void)
+{
+	logbuf_t *lb;
+
+	for (lb = logbuf_first(); lb; lb = lb->next) {
+		if (raw_in32(&lb->dropped))
+			return 1;
+
+		if (raw_in32(&lb->head) != raw_in32(&lb->tail) &&
+		    (raw_in32(&logbuf_head(lb)->info) & LOGREC_READY))
+			return 1;
+	}
+
+	return 0;
+}
+
+void printlog_drain(void)
+{
+	do {
+		/* Whoever holds the lock will recheck for our output
+		 * after releasing it.
+		 *
+		 * The lock is held with interrupts enabled, so that
+		 * interrupt handlers never wait for the console.
+		 */
+		if (!raw_spin_trylock(&drain_lock))
+			return;
+
+		while (1) {
+			logbuf_t *lb, *oldest = NULL;
+			logrec_t *rec, *oldest_rec = NULL;
+
+			for (lb = logbuf_first(); lb; lb = lb->next) {
+				uint32_t dropped;
+
+				rec = logbuf_peek(lb);
+				if (rec) {
+					if (!oldest_rec || rec->tb < oldest_rec->tb) {
+						oldest = lb;
+						oldest_rec = rec;
+					}
+
+					continue;
+				}
+
+				/* Report drops once the messages logged
+				 * before them have been printed.
+				 */
+				do {
+					dropped = raw_in32(&lb->dropped);
+				} while (!compare_and_swap32(&lb->dropped, dropped, 0));
+
+				if (dropped)
+					printf("[%u] %u log messages dropped\n",
+					       lb->pir, dropped);
+			}
+
+			if (!oldest)
+				break;
+
+#ifdef CONFIG_LIBOS_PERCPU_LOG_BINARY
+			if (oldest_rec->info & LOGREC_BINARY)
+				logbuf_print_binary(oldest, oldest_rec);
+			else
+#endif
+				printf("[%u] %.*s", oldest->pir,
+				       (int)oldest_rec->len, oldest_rec->text);
+
+			logbuf_consume(oldest, oldest_rec);
+		}
+
+		spin_unlock(&drain_lock);
+	} while (logbufs_pending());
+}
+
+void printlog_deferred(unsigned int logtype, unsigned int loglevel,
+                       const char *fmt, ...)
+{
+	logbuf_t *lb = &cpu->logbuf;
+	va_list args;
+	int ret;
+
+	va_start(args, fmt);
+
+	/* Don't count on anyone draining the buffers after a crash,
+	 * and keep earlier output ahead of the crash output.
+	 */
+	if (unlikely(cpu->crashing)) {
+		printlog_drain();
+		printf("[%ld] ", mfspr(SPR_PIR));
+		vprintf(fmt, args);
+		goto out;
+	}
+
+	if (unlikely(!lb->registered))
+		logbuf_register(lb);
+
+#ifdef CONFIG_LIBOS_PERCPU_LOG_BINARY
+	ret = logbuf_append_binary(lb, logtype, loglevel, fmt, args);
+	if (ret == ERR_RANGE)
+#endif
+		ret = logbuf_append(lb, logtype, loglevel, fmt, args);
+
+	if (ret < 0) {
+		uint32_t dropped;
+
+		do {
+			dropped = raw_in32(&lb->dropped);
+		} while (!compare_and_swap32(&lb->dropped, dropped, dropped + 1));
+	}
+
+	if (cpu->traplevel == TRAPLEVEL_THREAD)
+		printlog_drain();
+
+out:
+	va_end(args);
+}
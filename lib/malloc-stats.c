@@ -0,0 +1,306 @@
+/** @file
+ * Allocation statistics and call-site profiling.
+ */
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <libos/malloc.h>
+#include <libos/printlog.h>
+#include <libos/bitops.h>
+#include <libos/libos.h>
+#include <malloc.h>
+
+/* Each chunk stores the index of its call site in its last usable byte,
+ * so one extra byte is requested for every allocation.
+ */
+#define SITE_TAG_SIZE 1
+
+static uint32_t stats_lock;
+static malloc_stats_t stats;
+static malloc_site_stats_t sites[MALLOC_STATS_SITES];
+
+static int size_class(size_t size)
+{
+	if (size <= 16)
+		return 0;
+
+	return min(ilog2_roundup(size) - 4, MALLOC_STATS_CLASSES - 1);
+}
+
+/* Find or create the table entry for a call site.  Entries are never
+ * removed, so an open-addressed table with linear probing is enough.
+ * Called with stats_lock held.
+ */
+static int find_site(void *site)
+{
+	unsigned long hash = (unsigned long)site >> 2;
+	int i, idx;
+
+	for (i = 0; i < MALLOC_STATS_SITES - 1; i++) {
+		idx = (hash + i) % (MALLOC_STATS_SITES - 1) + 1;
+
+		if (sites[idx].site == site)
+			return idx;
+
+		if (!sites[idx].site) {
+			sites[idx].site = site;
+			return idx;
+		}
+	}
+
+	return 0;
+}
+
+static void account_alloc(void *ptr, void *site)
+{
+	size_t size = mspace_usable_size(ptr);
+	malloc_class_stats_t *class;
+	malloc_site_stats_t *s;
+	register_t saved;
+	int idx;
+
+	saved = spin_lock_intsave(&stats_lock);
+
+	idx = find_site(site);
+	((uint8_t *)ptr)[size - SITE_TAG_SIZE] = idx;
+
+	s = &sites[idx];
+	s->allocs++;
+	s->bytes += size;
+	s->peak = max(s->peak, s->bytes);
+
+	class = &stats.classes[size_class(size)];
+	class->allocs++;
+	class->bytes += size;
+
+	stats.allocs++;
+	stats.bytes += size;
+	stats.peak = max(stats.peak, stats.bytes);
+
+	spin_unlock_intsave(&stats_lock, saved);
+}
+
+static void account_free(void *ptr)
+{
+	size_t size = mspace_usable_size(ptr);
+	malloc_class_stats_t *class;
+	malloc_site_stats_t *s;
+	register_t saved;
+	int idx = ((uint8_t *)ptr)[size - SITE_TAG_SIZE];
+
+	saved = spin_lock_intsave(&stats_lock);
+
+	s = &sites[idx < MALLOC_STATS_SITES ? idx : 0];
+	s->frees++;
+	s->bytes -= size;
+
+	class = &stats.classes[size_class(size)];
+	class->frees++;
+	class->bytes -= size;
+
+	stats.frees++;
+	stats.bytes -= size;
+
+	spin_unlock_intsave(&stats_lock, saved);
+}
+
+static void account_failure(void)
+{
+	register_t saved = spin_lock_intsave(&stats_lock);
+	stats.failures++;
+	spin_unlock_intsave(&stats_lock, saved);
+}
+
+static void *stats_alloc(size_t size, size_t align, int zero, void *site)
+{
+	void *ret = NULL;
+
+	if (likely(size + SITE_TAG_SIZE > size)) {
+		if (zero)
+			ret = malloc_zalloc(size + SITE_TAG_SIZE);
+		else if (align > 8)
+			ret = __memalign(align, size + SITE_TAG_SIZE);
+		else
+			ret = __malloc(size + SITE_TAG_SIZE);
+	}
+
+	if (unlikely(!ret)) {
+		account_failure();
+		return NULL;
+	}
+
+	account_alloc(ret, site);
+	return ret;
+}
+
+void *malloc_stats_alloc(size_t size, size_t align)
+{
+	return stats_alloc(size, align, 0, __builtin_return_address(0));
+}
+
+void *malloc_stats_zalloc(size_t size)
+{
+	return stats_alloc(size, 0, 1, __builtin_return_address(0));
+}
+
+void *malloc_stats_realloc(void *ptr, size_t size)
+{
+	void *ret;
+
+	if (!ptr)
+		return stats_alloc(size, 0, 0, __builtin_return_address(0));
+
+	if (size == 0) {
+		malloc_stats_free(ptr);
+		return NULL;
+	}
+
+	if (unlikely(size + SITE_TAG_SIZE < size)) {
+		account_failure();
+		return NULL;
+	}
+
+	account_free(ptr);
+
+	ret = __realloc(ptr, size + SITE_TAG_SIZE);
+	if (unlikely(!ret)) {
+		/* The old chunk is untouched; its tag is still in place,
+		 * but re-account it against this call site.
+		 */
+		account_alloc(ptr, __builtin_return_address(0));
+		account_failure();
+		return NULL;
+	}
+
+	account_alloc(ret, __builtin_return_address(0));
+	return ret;
+}
+
+void malloc_stats_free(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	account_free(ptr);
+	__free(ptr);
+}
+
+void malloc_get_stats(malloc_stats_t *out)
+{
+	register_t saved = spin_lock_intsave(&stats_lock);
+	*out = stats;
+	spin_unlock_intsave(&stats_lock, saved);
+}
+
+int malloc_get_site_stats(malloc_site_stats_t *out, int max)
+{
+	register_t saved;
+	int i, num = 0;
+
+	saved = spin_lock_intsave(&stats_lock);
+
+	for (i = 0; i < MALLOC_STATS_SITES && num < max; i++)
+		if (sites[i].allocs)
+			out[num++] = sites[i];
+
+	spin_unlock_intsave(&stats_lock, saved);
+	return num;
+}
+
+static void dump_mspace(int loglevel, mspace msp, int node)
+{
+	struct mallinfo mi = mspace_mallinfo(msp);
+
+	/* Free space outside the top chunk can only satisfy requests
+	 * that fit in the holes, so report it as fragmentation.
+	 */
+	printlog(LOGTYPE_MALLOC, loglevel,
+	         "mspace %d: footprint %zu (max %zu), in use %zu, "
+	         "free %zu in %zu chunks, %zu%% fragmented\n",
+	         node, mi.arena, mi.usmblks, mi.uordblks,
+	         mi.fordblks, mi.ordblks,
+	         mi.fordblks ? (mi.fordblks - mi.keepcost) * 100 / mi.fordblks : 0);
+}
+
+void malloc_dump_stats(int loglevel)
+{
+	static malloc_site_stats_t site_buf[MALLOC_STATS_SITES];
+	static uint32_t dump_lock;
+	malloc_stats_t st;
+	register_t saved;
+	int i, num;
+
+	/* printlog() needs to see that the level is in range. */
+	if (loglevel > MAX_LOGLEVEL)
+		loglevel = MAX_LOGLEVEL;
+
+	/* site_buf is too large for the stack. */
+	saved = spin_lock_intsave(&dump_lock);
+
+	malloc_get_stats(&st);
+	num = malloc_get_site_stats(site_buf, MALLOC_STATS_SITES);
+
+	printlog(LOGTYPE_MALLOC, loglevel,
+	         "malloc: %lu allocs, %lu frees, %lu failures, "
+	         "%zu bytes in use, peak %zu\n",
+	         st.allocs, st.frees, st.failures, st.bytes, st.peak);
+
+	for (i = 0; i < MALLOC_STATS_CLASSES; i++) {
+		malloc_class_stats_t *c = &st.classes[i];
+
+		if (!c->allocs)
+			continue;
+
+		printlog(LOGTYPE_MALLOC, loglevel,
+		         "  %s%7u: %lu allocs, %lu frees, %zu bytes in use\n",
+		         i == MALLOC_STATS_CLASSES - 1 ? ">" : "<=",
+		         i == MALLOC_STATS_CLASSES - 1 ? 16U << (i - 1) : 16U << i,
+		         c->allocs, c->frees, c->bytes);
+	}
+
+	for (i = 0; i < num; i++) {
+		malloc_site_stats_t *s = &site_buf[i];
+
+		if (!s->bytes)
+			continue;
+
+		printlog(LOGTYPE_MALLOC, loglevel,
+		         "  %p: %lu allocs, %lu frees, %zu bytes in use, peak %zu\n",
+		         s->site, s->allocs, s->frees, s->bytes, s->peak);
+	}
+
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+	for (i = 0; i < CONFIG_LIBOS_MALLOC_NODES; i++) {
+		mspace msp = malloc_node_mspace(i);
+
+		if (msp)
+			dump_mspace(loglevel, msp, i);
+	}
+#else
+	if (libos_mspace)
+		dump_mspace(loglevel, libos_mspace, 0);
+#endif
+
+	spin_unlock_intsave(&dump_lock, saved);
+}
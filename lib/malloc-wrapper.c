@@ -25,15 +25,217 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <string.h>
+
+#include <libos/errors.h>
 #include <libos/io.h>
 #include <libos/printlog.h>
 #include <libos/libos.h>
+#include <libos/percpu.h>
 #include <malloc.h>
 
 mspace libos_mspace;
 
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+static mspace node_mspaces[CONFIG_LIBOS_MALLOC_NODES];
+
+mspace malloc_node_mspace(int node)
+{
+	if (node < 0 || node >= CONFIG_LIBOS_MALLOC_NODES)
+		return NULL;
+
+	return node_mspaces[node];
+}
+
+void *malloc_local(size_t size, size_t align)
+{
+	int node = cpu->node;
+	void *ret;
+
+	for (int i = 0; i < CONFIG_LIBOS_MALLOC_NODES; i++) {
+		mspace msp = node_mspaces[(node + i) % CONFIG_LIBOS_MALLOC_NODES];
+		if (!msp)
+			continue;
+
+		if (align > 8)
+			ret = mspace_memalign(msp, align, size);
+		else
+			ret = mspace_malloc(msp, size);
+
+		if (ret)
+			return ret;
+	}
+
+	return NULL;
+}
+
+#define malloc_small(size) malloc_local(size, 0)
+#else
+#define malloc_small(size) mspace_malloc(libos_mspace, size)
+#endif
+
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+#define MALLOC_CACHE_MIN 16
+#define MALLOC_CACHE_MAX (MALLOC_CACHE_MIN << (MALLOC_CACHE_CLASSES - 1))
+
+void *malloc_cache_alloc(size_t size)
+{
+	malloc_cache_t *mc;
+	register_t saved;
+	void *ret;
+	int class;
+
+	if (size > MALLOC_CACHE_MAX)
+		return malloc_small(size);
+
+	class = size <= MALLOC_CACHE_MIN ? 0 :
+	        ilog2_roundup(size) - ilog2(MALLOC_CACHE_MIN);
+
+	saved = disable_int_save();
+	mc = &cpu->malloc_cache;
+
+	ret = mc->head[class];
+	if (ret) {
+		mc->head[class] = *(void **)ret;
+		mc->count[class]--;
+	}
+
+	restore_int(saved);
+
+	if (ret)
+		return ret;
+
+	/* Allocate the full class size, so the chunk can be cached
+	 * in the same class when freed.
+	 */
+	ret = malloc_small(MALLOC_CACHE_MIN << class);
+	if (unlikely(!ret)) {
+		malloc_cache_flush();
+		ret = malloc_small(MALLOC_CACHE_MIN << class);
+	}
+
+	return ret;
+}
+
+void malloc_cache_free(void *ptr)
+{
+	malloc_cache_t *mc;
+	register_t saved;
+	size_t size;
+	int class;
+
+	if (!ptr)
+		return;
+
+	/* Only cache chunks that are not much bigger than their
+	 * class, so that large chunks aren't hoarded.
+	 */
+	size = mspace_usable_size(ptr);
+	if (size < MALLOC_CACHE_MIN || size >= MALLOC_CACHE_MAX * 2)
+		goto out;
+
+	class = min(ilog2(size) - ilog2(MALLOC_CACHE_MIN),
+	            MALLOC_CACHE_CLASSES - 1);
+	if (size >= (MALLOC_CACHE_MIN << class) * 2)
+		goto out;
+
+	saved = disable_int_save();
+	mc = &cpu->malloc_cache;
+
+	if (mc->count[class] < MALLOC_CACHE_DEPTH) {
+		*(void **)ptr = mc->head[class];
+		mc->head[class] = ptr;
+		mc->count[class]++;
+		ptr = NULL;
+	}
+
+	restore_int(saved);
+
+out:
+	if (ptr)
+		mspace_free(libos_mspace, ptr);
+}
+
+void malloc_cache_flush(void)
+{
+	malloc_cache_t *mc;
+	register_t saved;
+	void *list;
+	int class;
+
+	for (class = 0; class < MALLOC_CACHE_CLASSES; class++) {
+		saved = disable_int_save();
+		mc = &cpu->malloc_cache;
+
+		list = mc->head[class];
+		mc->head[class] = NULL;
+		mc->count[class] = 0;
+
+		restore_int(saved);
+
+		while (list) {
+			void *next = *(void **)list;
+
+			mspace_free(libos_mspace, list);
+			list = next;
+		}
+	}
+}
+#endif
+
+void *malloc_zalloc(size_t size)
+{
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+	/* Cached chunks are dirty, but small enough to clear cheaply. */
+	if (size <= MALLOC_CACHE_MAX) {
+		void *ret = malloc_cache_alloc(size);
+		if (likely(ret))
+			memset(ret, 0, size);
+
+		return ret;
+	}
+#endif
+
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+	int node = cpu->node;
+
+	for (int i = 0; i < CONFIG_LIBOS_MALLOC_NODES; i++) {
+		mspace msp = node_mspaces[(node + i) % CONFIG_LIBOS_MALLOC_NODES];
+		void *ret;
+
+		if (!msp)
+			continue;
+
+		ret = mspace_calloc(msp, 1, size);
+		if (ret)
+			return ret;
+	}
+
+	return NULL;
+#else
+	return mspace_calloc(libos_mspace, 1, size);
+#endif
+}
+
+void malloc_assume_zeroed(void)
+{
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+	for (int i = 0; i < CONFIG_LIBOS_MALLOC_NODES; i++)
+		if (node_mspaces[i])
+			mspace_assume_zeroed(node_mspaces[i]);
+#else
+	if (libos_mspace)
+		mspace_assume_zeroed(libos_mspace);
+#endif
+}
+
+/* Segments are kept sorted by address, without overlap.  Adjacent
+ * segments on the same node, and equally known to be zero, are merged.
+ */
 typedef struct {
-	void *start, *end;
+	uintptr_t start, end;
+	int node;
+	int zeroed;
 } segment_t;
 
 #define NUM_SEGMENTS 64
@@ -41,22 +243,100 @@ typedef struct {
 static segment_t segments[NUM_SEGMENTS];
 static int nextseg = 0;
 
+/* Return the index of the first segment that ends at or after addr. */
+static int find_segment(uintptr_t addr)
+{
+	int lo = 0, hi = nextseg;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (segments[mid].end < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void remove_segments(int i, int num)
+{
+	memmove(&segments[i], &segments[i + num],
+	        (nextseg - i - num) * sizeof(segment_t));
+	nextseg -= num;
+}
+
+static int smallest_segment(void)
+{
+	int ret = 0;
+
+	for (int i = 1; i < nextseg; i++)
+		if (segments[i].end - segments[i].start <
+		    segments[ret].end - segments[ret].start)
+			ret = i;
+
+	return ret;
+}
+
+/* Insert a segment at index i, which must keep the array sorted.
+ * If the array is full, the smallest segment, possibly the new one,
+ * is discarded, and ERR_NOMEM is returned.
+ */
+static int insert_segment(int i, uintptr_t start, uintptr_t end,
+                          int node, int zeroed)
+{
+	int ret = 0;
+
+	if (nextseg == NUM_SEGMENTS) {
+		int victim = smallest_segment();
+		segment_t *s = &segments[victim];
+
+		if (end - start <= s->end - s->start) {
+			printlog(LOGTYPE_MALLOC, LOGLEVEL_ERROR,
+			         "malloc_add_segment: discarded %zu bytes at 0x%lx\n",
+			         (size_t)(end - start + 1), (unsigned long)start);
+			return ERR_NOMEM;
+		}
+
+		printlog(LOGTYPE_MALLOC, LOGLEVEL_ERROR,
+		         "malloc_add_segment: discarded %zu bytes at 0x%lx\n",
+		         (size_t)(s->end - s->start + 1), (unsigned long)s->start);
+
+		remove_segments(victim, 1);
+		if (victim < i)
+			i--;
+
+		ret = ERR_NOMEM;
+	}
+
+	memmove(&segments[i + 1], &segments[i],
+	        (nextseg - i) * sizeof(segment_t));
+	nextseg++;
+
+	segments[i].start = start;
+	segments[i].end = end;
+	segments[i].node = node;
+	segments[i].zeroed = zeroed;
+	return ret;
+}
+
 void *malloc_alloc_segment(size_t size, size_t align)
 {
 	for (int i = 0; i < nextseg; i++) {
 		segment_t *s = &segments[i];
-		uintptr_t start = (uintptr_t)s->start;
-		uintptr_t end = (uintptr_t)s->end;
+		uintptr_t start = s->start;
+		uintptr_t end = s->end;
 
 		if (align) {
 			start += align - 1;
 			start &= ~(align - 1);
 
-			if (start < (uintptr_t)s->start)
+			if (start < s->start)
 				continue;
 		}
 
-		if (start + size > end || start + size < start)
+		if (start + size - 1 > end || start + size < start)
 			continue;
 
 		malloc_exclude_segment((void *)start,
@@ -68,46 +348,119 @@ void *malloc_alloc_segment(size_t size, size_t align)
 	return NULL;
 }
 
-void malloc_add_segment(void *start, void *end)
+static int add_segment(void *startp, void *endp, int node, int zeroed)
 {
-	if (nextseg < NUM_SEGMENTS) {
-		segments[nextseg].start = start;
-		segments[nextseg].end = end;
-		nextseg++;
-	} else {
+	uintptr_t start = (uintptr_t)startp, end = (uintptr_t)endp;
+	segment_t *prev, *next;
+	int i, ret;
+
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+	if (node < 0 || node >= CONFIG_LIBOS_MALLOC_NODES) {
 		printlog(LOGTYPE_MALLOC, LOGLEVEL_ERROR,
-		         "malloc_add_segment: discarded %zd bytes at 0x%p\n",
-		         end - start + 1, start);
+		         "malloc_add_segment: bad node %d for 0x%p\n", node, startp);
+		node = 0;
+	}
+#endif
+
+	if (end < start)
+		return ERR_INVALID;
+
+	/* The new segment replaces any overlap, so that its node wins.
+	 * That can split a segment, and so fill the table.
+	 */
+	ret = malloc_exclude_segment(startp, endp);
+
+	i = find_segment(start);
+	prev = i > 0 ? &segments[i - 1] : NULL;
+	next = i < nextseg ? &segments[i] : NULL;
+
+	if (prev && prev->node == node && prev->zeroed == zeroed &&
+	    prev->end + 1 == start) {
+		prev->end = end;
+
+		if (next && next->node == node && next->zeroed == zeroed &&
+		    end + 1 == next->start) {
+			prev->end = next->end;
+			remove_segments(i, 1);
+		}
+
+		return ret;
 	}
+
+	if (next && next->node == node && next->zeroed == zeroed &&
+	    end + 1 == next->start) {
+		next->start = start;
+		return ret;
+	}
+
+	if (insert_segment(i, start, end, node, zeroed))
+		ret = ERR_NOMEM;
+
+	return ret;
 }
 
-void malloc_exclude_segment(void *start, void *end)
+int malloc_add_segment_node(void *start, void *end, int node)
 {
-	for (int i = 0; i < nextseg; i++) {
-		segment_t *s = &segments[i];
+	return add_segment(start, end, node, 0);
+}
 
-		if (start > s->end)
-			continue;
+int malloc_add_zeroed_segment(void *start, void *end, int node)
+{
+	return add_segment(start, end, node, 1);
+}
 
-		if (end < s->start)
-			continue;
+int malloc_add_segment(void *start, void *end)
+{
+	return malloc_add_segment_node(start, end, 0);
+}
+
+int malloc_exclude_segment(void *startp, void *endp)
+{
+	uintptr_t start = (uintptr_t)startp, end = (uintptr_t)endp;
+	segment_t *s;
+	int i, j;
+
+	if (end < start)
+		return ERR_INVALID;
+
+	i = find_segment(start);
+	if (i == nextseg || segments[i].start > end)
+		return 0;
+
+	s = &segments[i];
+
+	if (s->start < start) {
+		if (s->end > end) {
+			uintptr_t old_end = s->end;
 
-		if (start > s->start) {
-			if (s->end > end)
-				malloc_add_segment(end + 1, s->end);
-		
 			s->end = start - 1;
-		} else if (end < s->end) {
-			s->start = end + 1;
-		} else {
-			*s = segments[--nextseg];
+			return insert_segment(i + 1, end + 1, old_end,
+			                      s->node, s->zeroed);
 		}
+
+		s->end = start - 1;
+		i++;
 	}
+
+	for (j = i; j < nextseg && segments[j].end <= end; j++)
+		;
+
+	if (j < nextseg && segments[j].start <= end)
+		segments[j].start = end + 1;
+
+	remove_segments(i, j - i);
+	return 0;
 }
 
-static int next_usable_segment(int next, ssize_t *size)
+/* Find the next segment, at or after index next, that is large enough
+ * to use and is (or is not) known to be zero.
+ */
+static int next_usable_segment(int next, ssize_t *size, int zeroed)
 {
-	while (next < nextseg) {
+	for (; next < nextseg; next++) {
+		if (segments[next].zeroed != zeroed)
+			continue;
+
 		*size = segments[next].end - segments[next].start + 1;
 	
 		if (*size >= 1024) {
@@ -117,42 +470,96 @@ static int next_usable_segment(int next, ssize_t *size)
 			            (*size + 512 * 1024) / (1024 * 1024) :
 			            (*size + 512) / 1024,
 			         *size >= 16 * 1024 * 1024 ? 'M' : 'K',
-			         segments[next].start, segments[next].end);
+			         (void *)segments[next].start,
+			         (void *)segments[next].end);
 
 			return next;
 		}
 
 		printlog(LOGTYPE_MALLOC, LOGLEVEL_NORMAL,
 		         "malloc_init: discarded %ld bytes at 0x%p (too small)\n",
-		         *size, segments[next].start);
-
-		next++;
+		         *size, (void *)segments[next].start);
 	}
 	
 	return -1;
 }
 
+/* Zeroed segments are added last, so that the top chunk, which is
+ * always in the most recently added segment, is known to be zero if
+ * any segment is.
+ */
+#ifdef CONFIG_LIBOS_MALLOC_NODES
 mspace malloc_init(void)
 {
 	ssize_t size;
-	int next;
-	
-	next = next_usable_segment(0, &size);
-	if (next < 0) {
+
+	for (int zeroed = 0; zeroed < 2; zeroed++) {
+		int next = -1;
+
+		while ((next = next_usable_segment(next + 1, &size, zeroed)) >= 0) {
+			int node = segments[next].node;
+
+			if (node_mspaces[node]) {
+				mspace_add_segment(node_mspaces[node],
+				                   (void *)segments[next].start, size);
+			} else {
+				node_mspaces[node] =
+					create_mspace_with_base((void *)segments[next].start,
+					                        size, 1);
+				if (!node_mspaces[node]) {
+					printlog(LOGTYPE_MALLOC, LOGLEVEL_ERROR,
+					         "malloc_init: Failed to create mspace for node %d.\n",
+					         node);
+					continue;
+				}
+
+				if (!libos_mspace)
+					libos_mspace = node_mspaces[node];
+			}
+
+			if (zeroed)
+				mspace_assume_zeroed(node_mspaces[node]);
+		}
+	}
+
+	if (!libos_mspace)
 		printlog(LOGTYPE_MALLOC, LOGLEVEL_ALWAYS,
 		         "malloc_init: No suitable memory\n");
-		return NULL;
-	}
 
-	libos_mspace = create_mspace_with_base(segments[next].start, size, 1);
-	if (!libos_mspace) {
-		printlog(LOGTYPE_MALLOC, LOGLEVEL_ERROR,
-		         "malloc_init: Failed to create mspace.\n");
-		return NULL;
+	return libos_mspace;
+}
+#else
+mspace malloc_init(void)
+{
+	mspace msp = NULL;
+	ssize_t size;
+
+	for (int zeroed = 0; zeroed < 2; zeroed++) {
+		int next = -1;
+
+		while ((next = next_usable_segment(next + 1, &size, zeroed)) >= 0) {
+			if (msp) {
+				mspace_add_segment(msp, (void *)segments[next].start, size);
+			} else {
+				msp = create_mspace_with_base((void *)segments[next].start,
+				                              size, 1);
+				if (!msp) {
+					printlog(LOGTYPE_MALLOC, LOGLEVEL_ERROR,
+					         "malloc_init: Failed to create mspace.\n");
+					return NULL;
+				}
+			}
+
+			if (zeroed)
+				mspace_assume_zeroed(msp);
+		}
 	}
 
-	while ((next = next_usable_segment(next + 1, &size)) >= 0)
-		mspace_add_segment(libos_mspace, segments[next].start, size);
+	if (!msp)
+		printlog(LOGTYPE_MALLOC, LOGLEVEL_ALWAYS,
+		         "malloc_init: No suitable memory\n");
 
-	return libos_mspace;
+	libos_mspace = msp;
+	return msp;
 }
+#endif
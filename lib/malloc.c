@@ -473,6 +473,13 @@ DEFAULT_MMAP_THRESHOLD       default: 256K
 #define USE_LOCKS 1
 #define DEBUG
 
+#ifdef CONFIG_LIBOS_MALLOC_NODES
+/* Record each chunk's mspace, so it can be freed without knowing
+ * which node it came from.
+ */
+#define FOOTERS 1
+#endif
+
 #ifndef WIN32
 #ifdef _WIN32
 #define WIN32 1
@@ -647,7 +654,7 @@ DEFAULT_MMAP_THRESHOLD       default: 256K
 
 #ifdef HAVE_USR_INCLUDE_MALLOC_H
 #include "/usr/include/malloc.h"
-#else /* HAVE_USR_INCLUDE_MALLOC_H */
+#elif !defined(MALLOC_280_H) /* already declared by libos/malloc.h */
 
 struct mallinfo {
   MALLINFO_FIELD_TYPE arena;    /* non-mmapped space allocated from system */
@@ -1125,6 +1132,12 @@ size_t mspace_footprint(mspace msp);
 */
 size_t mspace_max_footprint(mspace msp);
 
+/*
+  mspace_usable_size(void* p) behaves as malloc_usable_size, returning
+  the number of usable bytes in the allocated chunk p.
+*/
+size_t mspace_usable_size(const void* mem);
+
 
 #if !NO_MALLINFO
 /*
@@ -1180,7 +1193,7 @@ int mspace_mallopt(int, int);
 #ifndef LACKS_ERRNO_H
 #include <errno.h>       /* for MALLOC_FAILURE_ACTION */
 #endif /* LACKS_ERRNO_H */
-#if FOOTERS
+#if FOOTERS && !defined(LIBOS_MALLOC)
 #include <time.h>        /* for magic initialization */
 #endif /* FOOTERS */
 #ifndef LACKS_STDLIB_H
@@ -2058,6 +2071,11 @@ struct malloc_state {
   size_t     footprint;
   size_t     max_footprint;
   flag_t     mflags;
+#ifdef LIBOS_MALLOC
+  /* Memory in the top chunk at or above zero_base is known to be
+     zero, apart from the top chunk's own header. */
+  char*      zero_base;
+#endif
 #if USE_LOCKS
   MLOCK_T    mutex;     /* locate lock among fields that rarely change */
 #endif /* USE_LOCKS */
@@ -2502,7 +2520,11 @@ static int init_mparams(void) {
       }
       else
 #endif /* USE_DEV_RANDOM */
+#ifdef LIBOS_MALLOC
+        s = (size_t)(get_tb() ^ (size_t)0x55555555U);
+#else
         s = (size_t)(time(0) ^ (size_t)0x55555555U);
+#endif
 
       s |= (size_t)8U;    /* ensure nonzero */
       s &= ~(size_t)7U;   /* improve chances of fault for bad values */
@@ -3265,6 +3287,10 @@ static void init_top(mstate m, mchunkptr p, size_t psize) {
   p->head = psize | PINUSE_BIT;
   /* set size of fake trailing chunk holding overhead space only once */
   chunk_plus_offset(p, psize)->head = TOP_FOOT_SIZE;
+#ifdef LIBOS_MALLOC
+  /* Nothing is known about the contents of new top space */
+  m->zero_base = (char*)p + psize;
+#endif
   m->trim_check = mparams.trim_threshold; /* reset on each update */
 }
 
@@ -3315,6 +3341,10 @@ static void* prepend_alloc(mstate m, char* newbase, char* oldbase,
   /* consolidate remainder with first chunk of old base */
   if (oldfirst == m->top) {
     size_t tsize = m->topsize += qsize;
+#ifdef LIBOS_MALLOC
+    if ((char*)oldfirst + TWO_SIZE_T_SIZES > m->zero_base)
+      m->zero_base = (char*)oldfirst + TWO_SIZE_T_SIZES;
+#endif
     m->top = q;
     q->head = tsize | PINUSE_BIT;
     check_top_chunk(m, q);
@@ -4294,6 +4324,11 @@ void dlfree(void* mem) {
           if (!cinuse(next)) {  /* consolidate forward */
             if (next == fm->top) {
               size_t tsize = fm->topsize += psize;
+#ifdef LIBOS_MALLOC
+              /* The old top's header is now inside the top chunk */
+              if ((char*)next + TWO_SIZE_T_SIZES > fm->zero_base)
+                fm->zero_base = (char*)next + TWO_SIZE_T_SIZES;
+#endif
               fm->top = p;
               p->head = tsize | PINUSE_BIT;
               if (p == fm->dv) {
@@ -4527,6 +4562,16 @@ void mspace_add_segment(mspace msp, char *base, size_t size)
 	POSTACTION(ms);
 }
 
+void mspace_assume_zeroed(mspace msp)
+{
+	mstate ms = (mstate)msp;
+	if (PREACTION(ms))
+		return;
+
+	ms->zero_base = (char *)chunk2mem(ms->top);
+	POSTACTION(ms);
+}
+
 size_t destroy_mspace(mspace msp) {
   size_t freed = 0;
   mstate ms = (mstate)msp;
@@ -4556,7 +4601,19 @@ size_t destroy_mspace(mspace msp) {
 */
 
 
+#ifdef LIBOS_MALLOC
+static void* malloc_zeroed(mspace msp, size_t bytes, int* zeroed);
+
+void* mspace_malloc(mspace msp, size_t bytes) {
+  return malloc_zeroed(msp, bytes, 0);
+}
+
+/* As mspace_malloc, but if zeroed is non-null, set *zeroed if the
+   returned memory is known to be zero. */
+static void* malloc_zeroed(mspace msp, size_t bytes, int* zeroed) {
+#else /* LIBOS_MALLOC */
 void* mspace_malloc(mspace msp, size_t bytes) {
+#endif /* LIBOS_MALLOC */
   mstate ms = (mstate)msp;
   if (!ok_magic(ms)) {
     USAGE_ERROR_ACTION(ms,ms);
@@ -4655,6 +4712,10 @@ void* mspace_malloc(mspace msp, size_t bytes) {
       r->head = rsize | PINUSE_BIT;
       set_size_and_pinuse_of_inuse_chunk(ms, p, nb);
       mem = chunk2mem(p);
+#ifdef LIBOS_MALLOC
+      if (zeroed != 0 && (char*)mem >= ms->zero_base)
+        *zeroed = 1;
+#endif
       check_top_chunk(ms, ms->top);
       check_malloced_chunk(ms, mem, nb);
       goto postaction;
@@ -4719,6 +4780,11 @@ void mspace_free(mspace msp, void* mem) {
           if (!cinuse(next)) {  /* consolidate forward */
             if (next == fm->top) {
               size_t tsize = fm->topsize += psize;
+#ifdef LIBOS_MALLOC
+              /* The old top's header is now inside the top chunk */
+              if ((char*)next + TWO_SIZE_T_SIZES > fm->zero_base)
+                fm->zero_base = (char*)next + TWO_SIZE_T_SIZES;
+#endif
               fm->top = p;
               p->head = tsize | PINUSE_BIT;
               if (p == fm->dv) {
@@ -4775,9 +4841,18 @@ void* mspace_calloc(mspace msp, size_t n_elements, size_t elem_size) {
         (req / n_elements != elem_size))
       req = MAX_SIZE_T; /* force downstream failure on overflow */
   }
+#ifdef LIBOS_MALLOC
+  {
+    int zeroed = 0;
+    mem = malloc_zeroed(ms, req, &zeroed);
+    if (mem != 0 && !zeroed)
+      memset(mem, 0, req);
+  }
+#else /* LIBOS_MALLOC */
   mem = internal_malloc(ms, req);
   if (mem != 0 && calloc_must_clear(mem2chunk(mem)))
     memset(mem, 0, req);
+#endif /* LIBOS_MALLOC */
   return mem;
 }
 
@@ -4881,6 +4956,15 @@ size_t mspace_max_footprint(mspace msp) {
   return result;
 }
 
+size_t mspace_usable_size(const void* mem) {
+  if (mem != 0) {
+    mchunkptr p = mem2chunk(mem);
+    if (cinuse(p))
+      return chunksize(p) - overhead_for(p);
+  }
+  return 0;
+}
+
 
 #if !NO_MALLINFO
 struct mallinfo mspace_mallinfo(mspace msp) {
@@ -31,6 +31,7 @@
 #include <libos/io.h>
 #include <libos/core-regs.h>
 #include <libos/alloc.h>
+#include <libos/slab.h>
 #include <libos/errors.h>
 
 typedef struct mpic_interrupt {
@@ -41,12 +42,44 @@ typedef struct mpic_interrupt {
 	ipi_hwirq_t ipi;
 	error_interrupt_t err;
 	int config_done; /**< indicates that config of this int is done */
+	/** Serializes read-modify-write of hw->vecpri, and config_done.
+	 * Taken with mchksave: critical and machine check dispatch mask
+	 * sources that have no handlers left.
+	 */
+	uint32_t lock;
+
+	/* Shadows of the hw registers, so that getters and read-modify-write
+	 * don't read CCSR.  The activity bit of vecpri is set by hardware,
+	 * so it is left out of the shadow and always read from hw.  IPI
+	 * sources only have vecpri, and timers have no intlevel.
+	 */
+	uint32_t vecpri, destcpu, intlevel;
+
+	/* Interrupt coalescing, protected by coalesce_lock.  A source
+	 * points to the global timer that holds it off, and the timer
+	 * points back to the source.
+	 */
+	struct mpic_interrupt *timer, *held;
+	uint32_t *gtbcr; /**< timer only: base count register */
+	uint32_t window; /**< timer only: window length in ticks */
 } mpic_interrupt_t;
 
 static mpic_interrupt_t mpic_irqs[MPIC_NUM_SRCS];
 static mpic_interrupt_t mpic_ipi_irqs[MPIC_NUM_IPI_SRCS];
+static mpic_interrupt_t mpic_timer_irqs[MPIC_NUM_TIMERS];
+static irqaction_t mpic_timer_actions[MPIC_NUM_TIMERS];
+static uint32_t coalesce_lock;
+
+/* Source for each vector, for do_mpic_extint().  Kept up to date by
+ * mpic_write_vecpri(), and rebuilt by mpic_map_vectors().
+ */
+static interrupt_t *mpic_vectors[MPIC_NUM_VECTORS];
+/* Serializes updates to action lists; hardware registers of each
+ * source are protected by mpic_interrupt_t.lock.
+ */
 static uint32_t mpic_lock, error_int_lock;
 static error_sub_int_t error_subints[MPIC_NUM_ERR_SRCS];
+static DEFINE_SLAB_CACHE(irqaction_cache, irqaction_t);
 
 int mpic_coreint;
 
@@ -70,14 +103,79 @@ uint16_t mpic_iack(void)
 	return mpic_read(MPIC_IACK);
 }
 
+static void mpic_write_vecpri(mpic_interrupt_t *mirq, uint32_t vecpri)
+{
+	vpr_t old = { .data = mirq->vecpri }, new = { .data = vecpri };
+
+	if (old.vector != new.vector && old.vector < MPIC_NUM_VECTORS &&
+	    mpic_vectors[old.vector] == &mirq->irq)
+		mpic_vectors[old.vector] = NULL;
+
+	if (new.vector < MPIC_NUM_VECTORS)
+		mpic_vectors[new.vector] = &mirq->irq;
+
+	mirq->vecpri = vecpri & ~MPIC_IVPR_ACTIVE;
+	out32(&mirq->hw->vecpri, vecpri);
+}
+
+static void mpic_load_shadow(mpic_interrupt_t *mirq, int ipi)
+{
+	mirq->vecpri = in32(&mirq->hw->vecpri) & ~MPIC_IVPR_ACTIVE;
+
+	if (!ipi) {
+		mirq->destcpu = in32(&mirq->hw->destcpu);
+
+		if (!mirq->gtbcr)
+			mirq->intlevel = in32(&mirq->hw->intlevel);
+	}
+}
+
+static void mpic_map_source(mpic_interrupt_t *mirq)
+{
+	vpr_t vpr = { .data = mirq->vecpri };
+
+	if (mirq->hw && vpr.vector < MPIC_NUM_VECTORS)
+		mpic_vectors[vpr.vector] = &mirq->irq;
+}
+
+/* Rebuild mpic_vectors[] from the vecpri shadows.  Stale entries are
+ * dropped first, so that the entry of a source whose vector did not
+ * change is never cleared, even briefly.
+ */
+static void mpic_map_vectors(void)
+{
+	int i;
+
+	for (i = 0; i < MPIC_NUM_VECTORS; i++) {
+		mpic_interrupt_t *mirq;
+		vpr_t vpr;
+
+		if (!mpic_vectors[i])
+			continue;
+
+		mirq = to_container(mpic_vectors[i], mpic_interrupt_t, irq);
+		vpr.data = mirq->vecpri;
+
+		if (vpr.vector != i)
+			mpic_vectors[i] = NULL;
+	}
+
+	for (i = 0; i < MPIC_NUM_SRCS; i++)
+		mpic_map_source(&mpic_irqs[i]);
+	for (i = 0; i < MPIC_NUM_IPI_SRCS; i++)
+		mpic_map_source(&mpic_ipi_irqs[i]);
+	for (i = 0; i < MPIC_NUM_TIMERS; i++)
+		mpic_map_source(&mpic_timer_irqs[i]);
+}
+
 /* Non-critical interrupts only */
 static void mpic_irq_mask(interrupt_t *irq)
 {
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 	
-	register_t saved = spin_lock_intsave(&mpic_lock);
-	out32(&mirq->hw->vecpri, in32(&mirq->hw->vecpri) | MPIC_IVPR_MASK);
-	spin_unlock_intsave(&mpic_lock, saved);
+	register_t saved = spin_lock_mchksave(&mirq->lock);
+	mpic_write_vecpri(mirq, mirq->vecpri | MPIC_IVPR_MASK);
+	spin_unlock_mchksave(&mirq->lock, saved);
 }
 
 /* Non-critical interrupts only */
@@ -85,15 +183,15 @@ static void mpic_irq_unmask(interrupt_t *irq)
 {
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 
-	register_t saved = spin_lock_intsave(&mpic_lock);
-	out32(&mirq->hw->vecpri, in32(&mirq->hw->vecpri) & ~MPIC_IVPR_MASK);
-	spin_unlock_intsave(&mpic_lock, saved);
+	register_t saved = spin_lock_mchksave(&mirq->lock);
+	mpic_write_vecpri(mirq, mirq->vecpri & ~MPIC_IVPR_MASK);
+	spin_unlock_mchksave(&mirq->lock, saved);
 }
 
 static int mpic_irq_get_mask(interrupt_t *irq)
 {
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
-	return !!(in32(&mirq->hw->vecpri) & MPIC_IVPR_MASK);
+	return !!(mirq->vecpri & MPIC_IVPR_MASK);
 }
 
 void mpic_irq_set_vector(interrupt_t *irq, uint32_t vector)
@@ -101,11 +199,11 @@ void mpic_irq_set_vector(interrupt_t *irq, uint32_t vector)
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 	vpr_t vpr;
 
-	register_t saved = spin_lock_intsave(&mpic_lock);
-	vpr.data = in32(&mirq->hw->vecpri);
+	register_t saved = spin_lock_mchksave(&mirq->lock);
+	vpr.data = mirq->vecpri;
 	vpr.vector = vector;
-	out32(&mirq->hw->vecpri, vpr.data);
-	spin_unlock_intsave(&mpic_lock, saved);
+	mpic_write_vecpri(mirq, vpr.data);
+	spin_unlock_mchksave(&mirq->lock, saved);
 }
 
 uint16_t mpic_irq_get_vector(interrupt_t *irq)
@@ -113,7 +211,7 @@ uint16_t mpic_irq_get_vector(interrupt_t *irq)
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 	vpr_t vpr;
 
-	vpr.data = in32(&mirq->hw->vecpri);
+	vpr.data = mirq->vecpri;
 	return vpr.vector;
 }
 
@@ -142,13 +240,13 @@ static int mpic_irq_set_priority(interrupt_t *irq, int priority)
 	if (mpic_irq_get_activity(irq))
 		return ERR_INVALID;
 
-	register_t saved = spin_lock_intsave(&mpic_lock);
+	register_t saved = spin_lock_mchksave(&mirq->lock);
 
-	vpr.data = in32(&mirq->hw->vecpri);
+	vpr.data = mirq->vecpri;
 	vpr.priority = priority;
-	out32(&mirq->hw->vecpri, vpr.data);
+	mpic_write_vecpri(mirq, vpr.data);
 
-	spin_unlock_intsave(&mpic_lock, saved);
+	spin_unlock_mchksave(&mirq->lock, saved);
 
 	return 0;
 }
@@ -158,7 +256,7 @@ static int mpic_irq_get_priority(interrupt_t *irq)
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 	vpr_t vpr;
 
-	vpr.data = in32(&mirq->hw->vecpri);
+	vpr.data = mirq->vecpri;
 	return vpr.priority;
 }
 
@@ -167,21 +265,23 @@ static void __mpic_irq_set_config(interrupt_t *irq, int config)
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 	vpr_t vpr;
 
-	vpr.data = in32(&mirq->hw->vecpri);
+	vpr.data = mirq->vecpri;
 	vpr.polarity = !!(config & IRQ_HIGH);
 	vpr.sense = !!(config & IRQ_LEVEL);
-	out32(&mirq->hw->vecpri, vpr.data);
+	mpic_write_vecpri(mirq, vpr.data);
 }
 
 static int mpic_irq_set_config(interrupt_t *irq, int config)
 {
+	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
+
 	/* do not allow changing the interrupt configuration while the interrupt is active */
 	if (mpic_irq_get_activity(irq))
 		return ERR_INVALID;
 
-	register_t saved = spin_lock_intsave(&mpic_lock);
+	register_t saved = spin_lock_mchksave(&mirq->lock);
 	__mpic_irq_set_config(irq, config);
-	spin_unlock_intsave(&mpic_lock, saved);
+	spin_unlock_mchksave(&mirq->lock, saved);
 	return 0;
 }
 
@@ -190,7 +290,7 @@ static int mpic_irq_get_config(interrupt_t *irq)
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
 	vpr_t vpr;
 
-	vpr.data = in32(&mirq->hw->vecpri);
+	vpr.data = mirq->vecpri;
 
 	return vpr.polarity | (vpr.sense << 1);
 }
@@ -203,14 +303,17 @@ static int mpic_irq_set_destcpu(interrupt_t *irq, uint32_t destcpu)
 	if (mpic_irq_get_activity(irq))
 		return ERR_INVALID;
 
+	register_t saved = spin_lock_mchksave(&mirq->lock);
+	mirq->destcpu = destcpu;
 	out32(&mirq->hw->destcpu, destcpu);
+	spin_unlock_mchksave(&mirq->lock, saved);
 	return 0;
 }
 
 static uint32_t mpic_irq_get_destcpu(interrupt_t *irq)
 {
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
-	return in32(&mirq->hw->destcpu);
+	return mirq->destcpu;
 }
 
 /*
@@ -231,14 +334,17 @@ static int mpic_irq_set_delivery_type(interrupt_t *irq, int inttype)
 	if (mpic_irq_get_activity(irq))
 		return ERR_INVALID;
 
+	register_t saved = spin_lock_mchksave(&mirq->lock);
+	mirq->intlevel = inttype;
 	out32(&mirq->hw->intlevel, inttype);
+	spin_unlock_mchksave(&mirq->lock, saved);
 	return 0;
 }
 
 static int mpic_irq_get_delivery_type(interrupt_t *irq)
 {
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
-	return in32(&mirq->hw->intlevel);
+	return mirq->intlevel;
 }
 
 static uint32_t mpic_msi_get_msir(interrupt_t *irq)
@@ -262,7 +368,7 @@ void mpic_reset_core(void)
 		if (!mpic_coreint) {
 			vector = mpic_iack();
 		
-			if (vector == 0xffff)
+			if (vector == MPIC_SPURIOUS_VECTOR)
 				return;
 		}
 
@@ -297,7 +403,7 @@ static int error_int_p4080_rev1(void *arg)
 static int mpic_register(interrupt_t *irq, int_handler_t handler,
                          void *devid, int flags)
 {
-	irqaction_t *action = alloc_type(irqaction_t);
+	irqaction_t *action = slab_alloc_type(&irqaction_cache, irqaction_t);
 	if (!action)
 		return ERR_NOMEM;
 
@@ -315,7 +421,9 @@ static int mpic_register(interrupt_t *irq, int_handler_t handler,
 		if (!irq->actions) {
 			action->handler = error_int_p4080_rev1;
 			action->devid = irq;
+			action->next = NULL;
 
+			smp_lwsync();
 			irq->actions = action;
 			spin_unlock_intsave(&mpic_lock, saved);
 
@@ -323,7 +431,7 @@ static int mpic_register(interrupt_t *irq, int_handler_t handler,
 			mpic_irq_unmask(irq);
 		} else {
 			spin_unlock_intsave(&mpic_lock, saved);
-			free(action);
+			slab_free(&irqaction_cache, action);
 		}
 
 		return ERR_BUSY;
@@ -336,6 +444,7 @@ static int mpic_register(interrupt_t *irq, int_handler_t handler,
 	
 	register_t saved = spin_lock_intsave(&mpic_lock);
 	action->next = irq->actions;
+	smp_lwsync();
 	irq->actions = action;
 	spin_unlock_intsave(&mpic_lock, saved);
 
@@ -345,16 +454,45 @@ static int mpic_register(interrupt_t *irq, int_handler_t handler,
 	return 0;
 }
 
+static int mpic_unregister(interrupt_t *irq, void *devid)
+{
+	irqaction_t *action;
+	int last;
+
+	register_t saved = spin_lock_intsave(&mpic_lock);
+	action = irq_unlink_action(irq, devid);
+	last = !irq->actions;
+	spin_unlock_intsave(&mpic_lock, saved);
+
+	if (!action)
+		return ERR_NOTFOUND;
+
+	if (last)
+		mpic_irq_mask(irq);
+
+	irq_synchronize();
+	slab_free(&irqaction_cache, action);
+	return 0;
+}
+
 static void call_irq_handler(interrupt_t *irq)
 {
-	irqaction_t *action = irq->actions;
+	irqaction_t *action;
+
+	irq_dispatch_enter();
 
-	assert(action);
+	action = irq->actions;
+
+	/* The last handler may have just been unregistered. */
+	if (unlikely(!action))
+		irq->ops->disable(irq);
 
 	while (action) {
 		action->handler(action->devid);
 		action = action->next;
 	}
+
+	irq_dispatch_exit();
 }
 
 static int get_internal_int(uint32_t reg)
@@ -400,12 +538,8 @@ void do_mpic_critint(void)
 {
 	interrupt_t *irq;
 	
-	while ((irq = mpic_get_critint())) {
-		/* FIXME: race against unregistration without holding
-		 * a global IRQ lock.
-		 */
+	while ((irq = mpic_get_critint()))
 		call_irq_handler(irq);
-	}
 }
 
 static int __mpic_get_mcheckint(void)
@@ -432,11 +566,199 @@ void do_mpic_mcheck(void)
 {
 	interrupt_t *irq;
 
-	while ((irq = mpic_get_mcheckint())) {
-		/* FIXME: race against unregistration without holding
-		 * a global IRQ lock.
-		 */
+	while ((irq = mpic_get_mcheckint()))
 		call_irq_handler(irq);
+}
+
+/* Mask a coalesced source and start its timer.  The source is
+ * unmasked again by mpic_coalesce_expire().
+ */
+static void mpic_coalesce_hold(mpic_interrupt_t *mirq)
+{
+	mpic_interrupt_t *timer;
+
+	if (!mirq->timer)
+		return;
+
+	spin_lock(&coalesce_lock);
+
+	timer = mirq->timer;
+	if (timer) {
+		mpic_irq_mask(&mirq->irq);
+
+		/* The timer starts counting when CI goes from one to zero. */
+		out32(timer->gtbcr, MPIC_GTBCR_CI | timer->window);
+		out32(timer->gtbcr, timer->window);
+	}
+
+	spin_unlock(&coalesce_lock);
+}
+
+extern int_ops_t mpic_timer_ops;
+static int mpic_coalesce_expire(void *arg);
+
+/* Take global timer i for coalescing on first use, unless it is
+ * already counting or unmasked, i.e. in use by something else.
+ * Called with coalesce_lock held.
+ */
+static int mpic_claim_timer(int i)
+{
+	mpic_interrupt_t *mirq = &mpic_timer_irqs[i];
+	mpic_hwirq_t *hw;
+	uint32_t *gtbcr;
+	vpr_t vpr;
+
+	if (mirq->hw)
+		return 0;
+
+	hw = (mpic_hwirq_t *)(CCSRBAR_VA + MPIC + MPIC_GTVPRA +
+	                      i * MPIC_GT_OFFSET);
+	gtbcr = (uint32_t *)(CCSRBAR_VA + MPIC + MPIC_GTBCRA +
+	                     i * MPIC_GT_OFFSET);
+
+	if (!(in32(gtbcr) & MPIC_GTBCR_CI) ||
+	    !(in32(&hw->vecpri) & MPIC_IVPR_MASK))
+		return ERR_BUSY;
+
+	vpr.data = 0;
+	vpr.vector = MPIC_TIMER_VECTOR_BASE + i;
+	vpr.msk = 1;
+	vpr.priority = 0;
+
+	/* interrupt_reset() writes the shadow back with the mask set,
+	 * so set it first, rather than map the timer's reset vector.
+	 */
+	mirq->hw = hw;
+	mirq->gtbcr = gtbcr;
+	mirq->vecpri = vpr.data;
+	mirq->destcpu = in32(&hw->destcpu);
+	mirq->irq.ops = &mpic_timer_ops;
+	interrupt_reset(&mirq->irq);
+
+	mpic_timer_actions[i].handler = mpic_coalesce_expire;
+	mpic_timer_actions[i].devid = mirq;
+	mirq->irq.actions = &mpic_timer_actions[i];
+	return 0;
+}
+
+static int mpic_coalesce_expire(void *arg)
+{
+	mpic_interrupt_t *timer = arg;
+
+	spin_lock(&coalesce_lock);
+
+	/* The timer reloads on expiry, so stop it to make it one-shot. */
+	out32(timer->gtbcr, MPIC_GTBCR_CI);
+
+	if (timer->held)
+		mpic_irq_unmask(&timer->held->irq);
+
+	spin_unlock(&coalesce_lock);
+	return 0;
+}
+
+int mpic_irq_set_coalesce(interrupt_t *irq, uint32_t ticks)
+{
+	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
+	mpic_interrupt_t *timer;
+	register_t saved;
+	int i, running;
+
+	if (mirq < mpic_irqs || mirq >= &mpic_irqs[MPIC_NUM_SRCS])
+		return ERR_INVALID;
+
+	if (ticks & MPIC_GTBCR_CI)
+		return ERR_RANGE;
+
+	saved = spin_lock_intsave(&coalesce_lock);
+
+	timer = mirq->timer;
+
+	if (!ticks) {
+		if (timer) {
+			running = !(in32(timer->gtbcr) & MPIC_GTBCR_CI);
+			out32(timer->gtbcr, MPIC_GTBCR_CI);
+
+			mirq->timer = NULL;
+			timer->held = NULL;
+
+			if (running)
+				mpic_irq_unmask(irq);
+		}
+
+		spin_unlock_intsave(&coalesce_lock, saved);
+
+		if (timer)
+			mpic_irq_mask(&timer->irq);
+
+		return 0;
+	}
+
+	if (timer) {
+		timer->window = ticks;
+		spin_unlock_intsave(&coalesce_lock, saved);
+		return 0;
+	}
+
+	for (i = 0; i < MPIC_NUM_TIMERS; i++) {
+		if (!mpic_timer_irqs[i].held && !mpic_claim_timer(i)) {
+			timer = &mpic_timer_irqs[i];
+			break;
+		}
+	}
+
+	if (!timer) {
+		spin_unlock_intsave(&coalesce_lock, saved);
+		return ERR_BUSY;
+	}
+
+	timer->window = ticks;
+	timer->held = mirq;
+	mirq->timer = timer;
+
+	spin_unlock_intsave(&coalesce_lock, saved);
+
+	/* Deliver the timer like the source it is holding off. */
+	mpic_irq_set_destcpu(&timer->irq, mirq->destcpu);
+	mpic_irq_set_priority(&timer->irq, mpic_irq_get_priority(irq));
+	mpic_irq_unmask(&timer->irq);
+	return 0;
+}
+
+void do_mpic_extint(void)
+{
+	interrupt_t *irq;
+	unsigned int vector;
+
+	if (mpic_coreint)
+		vector = mfspr(SPR_EPR);
+	else
+		vector = mpic_iack();
+
+	while (vector != MPIC_SPURIOUS_VECTOR) {
+		irq = NULL;
+		if (vector < MPIC_NUM_VECTORS)
+			irq = mpic_vectors[vector];
+
+		if (irq) {
+			call_irq_handler(irq);
+			mpic_coalesce_hold(to_container(irq, mpic_interrupt_t, irq));
+		} else {
+			printlog(LOGTYPE_IRQ, LOGLEVEL_ERROR,
+			         "%s: unexpected vector %u\n", __func__, vector);
+		}
+
+		mpic_eoi(irq);
+
+		/* Each acknowledge needs its own EOI, but sources that became
+		 * pending meanwhile can be picked up without taking another
+		 * exception.  With coreint, the MPIC delivers the next one
+		 * to the core directly, so it can't be polled for here.
+		 */
+		if (mpic_coreint)
+			break;
+
+		vector = mpic_iack();
 	}
 }
 
@@ -454,6 +776,7 @@ static interrupt_t *get_mpic_irq(device_t *dev,
 int_ops_t mpic_ops = {
 	.get_irq = get_mpic_irq,
 	.register_irq = mpic_register,
+	.unregister_irq = mpic_unregister,
 	.eoi = mpic_eoi,
 	.enable = mpic_irq_unmask,
 	.disable = mpic_irq_mask,
@@ -472,6 +795,7 @@ int_ops_t mpic_ops = {
 int_ops_t mpic_msi_ops = {
 	.get_irq = get_mpic_irq,
 	.register_irq = mpic_register,
+	.unregister_irq = mpic_unregister,
 	.eoi = mpic_eoi,
 	.enable = mpic_irq_unmask,
 	.disable = mpic_irq_mask,
@@ -551,7 +875,7 @@ static int error_int_register(interrupt_t *irq, int_handler_t handler,
 						err, TYPE_MCHK);
 	}
 
-	irqaction_t *action = alloc_type(irqaction_t);
+	irqaction_t *action = slab_alloc_type(&irqaction_cache, irqaction_t);
 	if (!action) {
 		spin_unlock_intsave(&error_int_lock, saved);
 		return ERR_NOMEM;
@@ -561,6 +885,7 @@ static int error_int_register(interrupt_t *irq, int_handler_t handler,
 	action->devid = devid;
 
 	action->next = irq->actions;
+	smp_lwsync();
 	irq->actions = action;
 	spin_unlock_intsave(&error_int_lock, saved);
 
@@ -571,8 +896,30 @@ static int error_int_register(interrupt_t *irq, int_handler_t handler,
 	return 0;
 }
 
+static int error_int_unregister(interrupt_t *irq, void *devid)
+{
+	irqaction_t *action;
+	int last;
+
+	register_t saved = spin_lock_mchksave(&error_int_lock);
+	action = irq_unlink_action(irq, devid);
+	last = !irq->actions;
+	spin_unlock_mchksave(&error_int_lock, saved);
+
+	if (!action)
+		return ERR_NOTFOUND;
+
+	if (last)
+		interrupt_mask(irq);
+
+	irq_synchronize();
+	slab_free(&irqaction_cache, action);
+	return 0;
+}
+
 int_ops_t error_int_ops = {
 	.register_irq = error_int_register,
+	.unregister_irq = error_int_unregister,
 	.enable = error_int_unmask,
 	.disable = error_int_mask,
 	.is_disabled = error_int_get_mask,
@@ -580,10 +927,11 @@ int_ops_t error_int_ops = {
 
 static int ipi_irq_set_destcpu(interrupt_t *irq, uint32_t destcpu)
 {
-	register_t saved = spin_lock_intsave(&mpic_lock);
 	mpic_interrupt_t *mirq = to_container(irq, mpic_interrupt_t, irq);
+
+	register_t saved = spin_lock_mchksave(&mirq->lock);
 	mirq->ipi.dispatch_cpu_mask |= destcpu;
-	spin_unlock_intsave(&mpic_lock, saved);
+	spin_unlock_mchksave(&mirq->lock, saved);
 	return 0;
 }
 
@@ -604,6 +952,18 @@ int_ops_t mpic_ipi_ops = {
 	.is_active = mpic_irq_get_activity,
 };
 
+int_ops_t mpic_timer_ops = {
+	.eoi = mpic_eoi,
+	.enable = mpic_irq_unmask,
+	.disable = mpic_irq_mask,
+	.is_disabled = mpic_irq_get_mask,
+	.set_cpu_dest_mask = mpic_irq_set_destcpu,
+	.get_cpu_dest_mask = mpic_irq_get_destcpu,
+	.set_priority = mpic_irq_set_priority,
+	.get_priority = mpic_irq_get_priority,
+	.is_active = mpic_irq_get_activity,
+};
+
 interrupt_t *mpic_get_ipi_irq(int irq)
 {
 	mpic_interrupt_t *ipi = &mpic_ipi_irqs[irq];
@@ -683,7 +1043,7 @@ static interrupt_t *get_mpic_irq(device_t *dev,
 		irq = &mirq->irq;
 	}
 
-	register_t saved = spin_lock_intsave(&mpic_lock);
+	register_t saved = spin_lock_mchksave(&mirq->lock);
 	if (!mirq->config_done) {
 		mirq->irq.config = mpic_intspec_to_config[intspec[1]] |
 					 IRQ_TYPE_MPIC_DIRECT;
@@ -694,11 +1054,52 @@ static interrupt_t *get_mpic_irq(device_t *dev,
 
 		mirq->config_done = 1;
 	}
-	spin_unlock_intsave(&mpic_lock, saved);
+	spin_unlock_mchksave(&mirq->lock, saved);
 
 	return irq;
 }
 
+void mpic_refresh_shadows(void)
+{
+	register_t saved;
+	int i;
+
+	for (i = 0; i < MPIC_NUM_SRCS; i++) {
+		mpic_interrupt_t *mirq = &mpic_irqs[i];
+
+		if (!mirq->hw)
+			continue;
+
+		saved = spin_lock_mchksave(&mirq->lock);
+		mpic_load_shadow(mirq, 0);
+		spin_unlock_mchksave(&mirq->lock, saved);
+	}
+
+	for (i = 0; i < MPIC_NUM_IPI_SRCS; i++) {
+		mpic_interrupt_t *mirq = &mpic_ipi_irqs[i];
+
+		if (!mirq->hw)
+			continue;
+
+		saved = spin_lock_mchksave(&mirq->lock);
+		mpic_load_shadow(mirq, 1);
+		spin_unlock_mchksave(&mirq->lock, saved);
+	}
+
+	for (i = 0; i < MPIC_NUM_TIMERS; i++) {
+		mpic_interrupt_t *mirq = &mpic_timer_irqs[i];
+
+		if (!mirq->hw)
+			continue;
+
+		saved = spin_lock_mchksave(&mirq->lock);
+		mpic_load_shadow(mirq, 0);
+		spin_unlock_mchksave(&mirq->lock, saved);
+	}
+
+	mpic_map_vectors();
+}
+
 /** Global MPIC initialization routine */
 void mpic_init(int coreint)
 {
@@ -726,6 +1127,7 @@ void mpic_init(int coreint)
 		mirq->hw = (mpic_hwirq_t *)(CCSRBAR_VA + MPIC + MPIC_IRQ_BASE);
 		mirq->hw += i;
 		mirq->irq.ops = &mpic_ops;
+		mpic_load_shadow(mirq, 0);
 
 		mpic_irq_set_destcpu(&mirq->irq, 1);
 
@@ -741,7 +1143,7 @@ void mpic_init(int coreint)
 
 		interrupt_reset(&mirq->irq);
 
-		out32(&mirq->hw->vecpri, vpr.data);
+		mpic_write_vecpri(mirq, vpr.data);
 	}
 
 	/* Next, init MSI interrupt sources */
@@ -754,6 +1156,7 @@ void mpic_init(int coreint)
 		mirq->msi += (i / MPIC_NUM_REGS_MSI_BANK);
 		mirq->msi_reg = (i % MPIC_NUM_REGS_MSI_BANK);
 		mirq->irq.ops = &mpic_msi_ops;
+		mpic_load_shadow(mirq, 0);
 
 		mpic_irq_set_destcpu(&mirq->irq, 1);
 
@@ -764,7 +1167,7 @@ void mpic_init(int coreint)
 
 		interrupt_reset(&mirq->irq);
 
-		out32(&mirq->hw->vecpri, vpr.data);
+		mpic_write_vecpri(mirq, vpr.data);
 	}
 
 	/* IPI interrupt sources */
@@ -780,15 +1183,24 @@ void mpic_init(int coreint)
 		mirq->ipi.dr += i * MPIC_IPIDR_OFFSET / sizeof(uint32_t);
 		mirq->ipi.dispatch_cpu_mask = 0;
 		mirq->irq.ops = &mpic_ipi_ops;
+		mpic_load_shadow(mirq, 1);
 
 		vpr.data = 0;
+		vpr.vector = MPIC_IPI_VECTOR_BASE + i;
 		vpr.msk = 1;
 		vpr.priority = 0;
 
 		interrupt_reset(&mirq->irq);
 
-		out32(&mirq->hw->vecpri, vpr.data);
+		mpic_write_vecpri(mirq, vpr.data);
 	}
 
+	/* Global timers are claimed by mpic_irq_set_coalesce().
+	 *
+	 * interrupt_reset() above masked each source at its reset
+	 * vector, which may have displaced another source's entry.
+	 */
+	mpic_map_vectors();
+
 	mpic_reset_core();
 }
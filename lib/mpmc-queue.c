@@ -0,0 +1,186 @@
+/** @file
+ * Lockless multi-producer, multi-consumer queues.
+ */
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <libos/mpmc-queue.h>
+#include <libos/alloc.h>
+#include <libos/io.h>
+#include <libos/errors.h>
+#include <libos/bitops.h>
+#include <libos/libos.h>
+
+int mpmc_queue_init(mpmc_queue_t *q, size_t size)
+{
+	if (size == 0 || (size & (size - 1)))
+		return ERR_INVALID;
+
+	q->buf = alloc_nozero(size, 1);
+	if (!q->buf)
+		return ERR_NOMEM;
+
+	q->prod_head = 0;
+	q->prod_tail = 0;
+	q->cons_head = 0;
+	q->cons_tail = 0;
+	q->size = size;
+
+	return 0;
+}
+
+void mpmc_queue_destroy(mpmc_queue_t *q)
+{
+	free(q->buf);
+	q->buf = NULL;
+}
+
+int mpmc_queue_reserve_write(mpmc_queue_t *q, mpmc_resv_t *resv, size_t len)
+{
+	uint32_t head, tail;
+
+	do {
+		head = raw_in32(&q->prod_head);
+		tail = raw_in32(&q->cons_tail);
+
+		if (len > q->size - (head - tail))
+			return ERR_BUSY;
+	} while (!compare_and_swap32(&q->prod_head, head, head + len));
+
+	/* Don't let stores into the reservation pass the load of
+	 * cons_tail that says the consumers are done with it.
+	 */
+	smp_lwsync();
+
+	resv->start = head;
+	resv->len = len;
+	return 0;
+}
+
+void mpmc_queue_commit_write(mpmc_queue_t *q, const mpmc_resv_t *resv)
+{
+	if (resv->len == 0)
+		return;
+
+	/* Wait for earlier producers, so that prod_tail never covers
+	 * a reservation that is still being filled.
+	 */
+	while (raw_in32(&q->prod_tail) != resv->start)
+		;
+
+	smp_lwsync();
+	raw_out32(&q->prod_tail, resv->start + resv->len);
+}
+
+size_t mpmc_queue_reserve_read(mpmc_queue_t *q, mpmc_resv_t *resv, size_t len)
+{
+	uint32_t head, tail;
+	size_t avail;
+
+	/* Clamp into avail, not len: a failed compare-and-swap must
+	 * retry with the caller's limit, not the previous attempt's.
+	 */
+	do {
+		head = raw_in32(&q->cons_head);
+		tail = raw_in32(&q->prod_tail);
+
+		avail = min(len, (size_t)(tail - head));
+		if (avail == 0)
+			break;
+	} while (!compare_and_swap32(&q->cons_head, head, head + avail));
+
+	/* Order loads of the data after the load of prod_tail. */
+	smp_lwsync();
+
+	resv->start = head;
+	resv->len = avail;
+	return avail;
+}
+
+void mpmc_queue_commit_read(mpmc_queue_t *q, const mpmc_resv_t *resv)
+{
+	if (resv->len == 0)
+		return;
+
+	while (raw_in32(&q->cons_tail) != resv->start)
+		;
+
+	smp_lwsync();
+	raw_out32(&q->cons_tail, resv->start + resv->len);
+}
+
+void mpmc_queue_copy_in(mpmc_queue_t *q, const mpmc_resv_t *resv,
+                        size_t off, const uint8_t *buf, size_t len)
+{
+	size_t pos = mpmc_queue_wrap(q, resv->start + off);
+	size_t first = min(len, q->size - pos);
+
+	memcpy(&q->buf[pos], buf, first);
+	len -= first;
+
+	if (len > 0)
+		memcpy(&q->buf[0], buf + first, len);
+}
+
+void mpmc_queue_copy_out(mpmc_queue_t *q, const mpmc_resv_t *resv,
+                         size_t off, uint8_t *buf, size_t len)
+{
+	size_t pos = mpmc_queue_wrap(q, resv->start + off);
+	size_t first = min(len, q->size - pos);
+
+	memcpy(buf, &q->buf[pos], first);
+	len -= first;
+
+	if (len > 0)
+		memcpy(buf + first, &q->buf[0], len);
+}
+
+ssize_t mpmc_queue_write(mpmc_queue_t *q, const uint8_t *buf, size_t len)
+{
+	mpmc_resv_t resv;
+	int ret;
+
+	ret = mpmc_queue_reserve_write(q, &resv, len);
+	if (ret < 0)
+		return ret;
+
+	mpmc_queue_copy_in(q, &resv, 0, buf, len);
+	mpmc_queue_commit_write(q, &resv);
+	return len;
+}
+
+ssize_t mpmc_queue_read(mpmc_queue_t *q, uint8_t *buf, size_t len)
+{
+	mpmc_resv_t resv;
+
+	len = mpmc_queue_reserve_read(q, &resv, len);
+	if (len == 0)
+		return 0;
+
+	mpmc_queue_copy_out(q, &resv, 0, buf, len);
+	mpmc_queue_commit_read(q, &resv);
+	return len;
+}
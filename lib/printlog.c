@@ -24,6 +24,79 @@
 
 #include <stdint.h>
 #include <libos/printlog.h>
+#include <libos/percpu.h>
+#include <libos/bitops.h>
 
 uint8_t loglevels[NUM_LOGTYPES] = 
 	{ [0 ... NUM_LOGTYPES - 1] = CONFIG_LIBOS_DEFAULT_LOGLEVEL };
+
+#ifdef CONFIG_LIBOS_PRINTLOG_RATELIMIT
+/* Generic cell rate algorithm: a message is allowed if it would not
+ * push the logtype's theoretical arrival time (tat) more than
+ * "limit" past now.  Time is the timebase shifted down by
+ * PRINTLOG_RATELIMIT_SHIFT, so that tat fits in a word that can be
+ * updated with compare_and_swap32().
+ */
+static struct {
+	uint32_t tat;
+	uint32_t interval;
+	uint32_t limit;
+} ratelimits[NUM_LOGTYPES];
+
+static unsigned long emitted[NUM_LOGTYPES], suppressed[NUM_LOGTYPES];
+
+int printlog_ratelimit(unsigned int logtype)
+{
+	uint32_t interval = ratelimits[logtype].interval;
+	uint32_t limit = ratelimits[logtype].limit;
+	uint32_t now, old, tat;
+
+	if (interval == 0 || unlikely(cpu->crashing))
+		goto emit;
+
+	now = get_tb() >> PRINTLOG_RATELIMIT_SHIFT;
+
+	do {
+		old = raw_in32(&ratelimits[logtype].tat);
+
+		/* A tat in the past (or implausibly far in the future, after
+		 * the shifted timebase wraps) means the logtype has been idle.
+		 */
+		tat = old - now > limit ? now : old;
+		tat += interval;
+
+		if (tat - now > limit) {
+			atomic_add(&suppressed[logtype], 1);
+			return 0;
+		}
+	} while (!compare_and_swap32(&ratelimits[logtype].tat, old, tat));
+
+emit:
+	atomic_add(&emitted[logtype], 1);
+	return 1;
+}
+
+void printlog_set_ratelimit(unsigned int logtype, uint32_t interval,
+                            unsigned int burst)
+{
+	if (interval != 0)
+		interval = max(interval >> PRINTLOG_RATELIMIT_SHIFT, 1U);
+
+	if (burst == 0)
+		burst = 1;
+
+	ratelimits[logtype].interval = 0;
+	smp_mbar();
+	ratelimits[logtype].limit = interval * burst;
+	ratelimits[logtype].tat = 0;
+	smp_mbar();
+	ratelimits[logtype].interval = interval;
+}
+
+void printlog_get_stats(unsigned int logtype, unsigned long *emitted_ret,
+                        unsigned long *suppressed_ret)
+{
+	*emitted_ret = emitted[logtype];
+	*suppressed_ret = suppressed[logtype];
+}
+#endif
@@ -40,12 +40,16 @@ int queue_init(queue_t *q, size_t size)
 	if (size & (size - 1))
 		return ERR_INVALID;
 
-	q->buf = alloc(size, 1);
+	q->buf = alloc_nozero(size, 1);
 	if (!q->buf)
 		return ERR_NOMEM;
 
 	q->head = 0;
 	q->tail = 0;
+#ifdef CONFIG_LIBOS_QUEUE_PADDED
+	q->head_cache = 0;
+	q->tail_cache = 0;
+#endif
 	q->size = size;
 
 	return 0;
@@ -57,6 +61,39 @@ void queue_destroy(queue_t *q)
 	q->buf = NULL;
 }
 
+/* Consumer's view of the data available.  With CONFIG_LIBOS_QUEUE_PADDED,
+ * the producer's cache line is only touched if the cached tail does not
+ * show at least "want" bytes.
+ */
+static size_t queue_cons_avail(queue_t *q, size_t want)
+{
+#ifdef CONFIG_LIBOS_QUEUE_PADDED
+	size_t avail = queue_wrap(q, q->tail_cache - q->head);
+	if (avail >= want)
+		return avail;
+
+	q->tail_cache = raw_in32(&q->tail);
+	return queue_wrap(q, q->tail_cache - q->head);
+#else
+	return queue_wrap(q, raw_in32(&q->tail) - q->head);
+#endif
+}
+
+/* Producer's view of the space available, as above. */
+static size_t queue_prod_space(queue_t *q, size_t want)
+{
+#ifdef CONFIG_LIBOS_QUEUE_PADDED
+	size_t space = queue_wrap(q, q->head_cache - q->tail - 1);
+	if (space >= want)
+		return space;
+
+	q->head_cache = raw_in32(&q->head);
+	return queue_wrap(q, q->head_cache - q->tail - 1);
+#else
+	return queue_wrap(q, raw_in32(&q->head) - q->tail - 1);
+#endif
+}
+
 void queue_read_at(queue_t *q, uint8_t *buf, size_t off, size_t len)
 {
 	off = queue_wrap(q, q->head + off);
@@ -69,19 +106,45 @@ void queue_read_at(queue_t *q, uint8_t *buf, size_t off, size_t len)
 		memcpy(buf + first, &q->buf[0], len);
 }
 
+static void queue_span_at(queue_t *q, queue_span_t *span,
+                          size_t start, size_t len)
+{
+	size_t first = min(len, q->size - start);
+
+	span->buf[0] = &q->buf[start];
+	span->len[0] = first;
+	span->buf[1] = &q->buf[0];
+	span->len[1] = len - first;
+}
+
+size_t queue_peek_span(queue_t *q, queue_span_t *span, size_t len)
+{
+	len = min(queue_cons_avail(q, len), len);
+
+	/* Order loads of the data after the load of tail. */
+	smp_lwsync();
+
+	queue_span_at(q, span, q->head, len);
+	return len;
+}
+
+void queue_consume(queue_t *q, size_t len)
+{
+	smp_lwsync();
+	raw_out32(&q->head, queue_wrap(q, q->head + len));
+}
+
 ssize_t queue_read(queue_t *q, uint8_t *buf, size_t len, int peek)
 {
-	size_t head = q->head;
-	size_t tail = raw_in32(&q->tail);
-	size_t avail = queue_wrap(q, tail - head);
+	queue_span_t span;
 
-	len = min(avail, len);
-	queue_read_at(q, buf, 0, len);
+	len = queue_peek_span(q, &span, len);
 
-	if (!peek) {
-		smp_lwsync();
-		raw_out32(&q->head, queue_wrap(q, head + len));
-	}
+	memcpy(buf, span.buf[0], span.len[0]);
+	memcpy(buf + span.len[0], span.buf[1], span.len[1]);
+
+	if (!peek)
+		queue_consume(q, len);
 
 	return len;	
 }
@@ -130,7 +193,7 @@ int queue_readchar_blocking(queue_t *q, int peek)
 
 int queue_readchar(queue_t *q, int peek)
 {
-	if (q->head == raw_in32(&q->tail))
+	if (queue_cons_avail(q, 1) == 0)
 		/* queue is empty */
 		return ERR_WOULDBLOCK;
 
@@ -144,33 +207,79 @@ int queue_readchar(queue_t *q, int peek)
 	return ret;
 }
 
-static void queue_write_at(queue_t *q, const uint8_t *buf,
-                           size_t off, size_t len)
+size_t queue_reserve_write(queue_t *q, queue_span_t *span, size_t len)
 {
-	size_t first = min(len, q->size - off);
-
-	memcpy(&q->buf[off], buf, first);
-	len -= first;
+	len = min(queue_prod_space(q, len), len);
+	queue_span_at(q, span, q->tail, len);
+	return len;
+}
 
-	if (len > 0)
-		memcpy(&q->buf[0], buf + first, len);
+void queue_commit_write(queue_t *q, size_t len)
+{
+	smp_lwsync();
+	raw_out32(&q->tail, queue_wrap(q, q->tail + len));
 }
 
 ssize_t queue_write(queue_t *q, const uint8_t *buf, size_t len)
 {
-	size_t tail = q->tail;
-	size_t head = raw_in32(&q->head);
-	size_t space = queue_wrap(q, head - tail - 1);
+	queue_span_t span;
 
-	len = min(space, len);
-	queue_write_at(q, buf, tail, len);
+	len = queue_reserve_write(q, &span, len);
 
-	smp_lwsync();
-	raw_out32(&q->tail, queue_wrap(q, tail + len));
+	memcpy(span.buf[0], buf, span.len[0]);
+	memcpy(span.buf[1], buf + span.len[0], span.len[1]);
 
+	queue_commit_write(q, len);
 	return len;	
 }
 
+/* Copy into a span, starting "off" bytes into it. */
+static void queue_span_copy(queue_span_t *span, size_t off,
+                            const uint8_t *buf, size_t len)
+{
+	if (off < span->len[0]) {
+		size_t first = min(len, span->len[0] - off);
+
+		memcpy(span->buf[0] + off, buf, first);
+		buf += first;
+		len -= first;
+		off = 0;
+	} else {
+		off -= span->len[0];
+	}
+
+	memcpy(span->buf[1] + off, buf, len);
+}
+
+ssize_t queue_write_crlf(queue_t *q, const uint8_t *buf, size_t len)
+{
+	queue_span_t span;
+	size_t space, pos = 0, out = 0;
+
+	space = queue_reserve_write(q, &span, len * 2);
+
+	while (pos < len) {
+		const uint8_t *nl = memchr(&buf[pos], '\n', len - pos);
+		size_t chunk = nl ? (size_t)(nl - &buf[pos]) : len - pos;
+
+		chunk = min(chunk, space - out);
+		queue_span_copy(&span, out, &buf[pos], chunk);
+		out += chunk;
+		pos += chunk;
+
+		/* Done, or out of space before the newline */
+		if (pos == len || buf[pos] != '\n' || space - out < 2)
+			break;
+
+		queue_span_copy(&span, out, (const uint8_t *)"\r\n", 2);
+		out += 2;
+		pos++;
+	}
+
+	queue_commit_write(q, out);
+	return pos;
+}
+
 #ifdef CONFIG_LIBOS_SCHED_API
 ssize_t queue_write_blocking(queue_t *q, const uint8_t *buf, size_t len)
 {
@@ -194,9 +303,33 @@ ssize_t queue_write_blocking(queue_t *q, const uint8_t *buf, size_t len)
 }
 #endif
 
+#ifdef CONFIG_LIBOS_SCHED_API
+ssize_t queue_write_crlf_blocking(queue_t *q, const uint8_t *buf, size_t len)
+{
+	ssize_t orig_len = len;
+
+	while (len > 0) {
+		libos_prepare_to_block();
+
+		ssize_t ret = queue_write_crlf(q, buf, len);
+		if (ret > 0) {
+			buf += ret;
+			len -= ret;
+			queue_notify_consumer(q, 0);
+			continue;
+		}
+
+		libos_block();
+	}
+
+	libos_unblock(cpu->thread);
+	return orig_len;
+}
+#endif
+
 int queue_writechar(queue_t *q, uint8_t c)
 {
-	if (q->tail == queue_wrap(q, raw_in32(&q->head) - 1))
+	if (queue_prod_space(q, 1) == 0)
 		/* queue is full */
 		return ERR_BUSY;
 
@@ -233,7 +366,6 @@ size_t qprintf(queue_t *q, int blocking, const char *str, ...)
 
 	static char buffer[buffer_size];
 	static uint32_t lock;
-	size_t i;
 
 	register_t saved = spin_lock_intsave(&lock);
 
@@ -245,23 +377,13 @@ size_t qprintf(queue_t *q, int blocking, const char *str, ...)
 	if (ret > buffer_size)
 		ret = buffer_size;
 	
-	for (i = 0; i < ret; i++) {
-		/* This is needed if the destination is a serial port.
-		 * Is it safe for all destinations?
-		 */
-
-		if (blocking) {
-			if (buffer[i] == '\n')	
-				queue_writechar_blocking(q, '\r');
-			
-			queue_writechar_blocking(q, buffer[i]);
-		} else {
-			if (buffer[i] == '\n')	
-				queue_writechar(q, '\r');
-			
-			queue_writechar(q, buffer[i]);
-		}
-	}
+	/* CR/LF expansion is needed if the destination is a serial port.
+	 * Is it safe for all destinations?
+	 */
+	if (blocking)
+		queue_write_crlf_blocking(q, (const uint8_t *)buffer, ret);
+	else
+		queue_write_crlf(q, (const uint8_t *)buffer, ret);
 
 	spin_unlock_intsave(&lock, saved);
 	return ret;
@@ -271,47 +393,19 @@ size_t qprintf(queue_t *q, int blocking, const char *str, ...)
 ssize_t queue_to_chardev(chardev_t *dest, queue_t *src,
                          size_t len, int peek, int flags)
 {
-	size_t orig_len = len;
-	size_t head = src->head;
-	size_t tail = raw_in32(&src->tail);
-
-	if (head == tail)
-		/* queue is empty */
-		return 0;
-
-	if (tail < head) {
-		size_t chunk = src->size - head;
-		if (chunk > len)
-			chunk = len;
-
-		dest->ops->tx(dest, &src->buf[head], chunk, flags);
-
-		head = queue_wrap(src, head + chunk);
-		len -= chunk;
-
-		if (!peek) {
-			smp_lwsync();
-			raw_out32(&src->head, head);
-		}
-	}
+	queue_span_t span;
+	int i;
 
-	if (len > 0) {
-		size_t chunk = tail - head;
-		if (chunk > len)
-			chunk = len;
+	len = queue_peek_span(src, &span, len);
 
-		dest->ops->tx(dest, &src->buf[head], chunk, flags);
+	for (i = 0; i < 2 && span.len[i] > 0; i++) {
+		dest->ops->tx(dest, span.buf[i], span.len[i], flags);
 
-		head = queue_wrap(src, head + chunk);
-		len -= chunk;
-
-		if (!peek) {
-			smp_lwsync();
-			raw_out32(&src->head, head);
-		}
+		if (!peek)
+			queue_consume(src, span.len[i]);
 	}
 
-	return orig_len - len;
+	return len;
 }
 
 ssize_t queue_to_queue(queue_t *dest, queue_t *src,
@@ -319,7 +413,7 @@ ssize_t queue_to_queue(queue_t *dest, queue_t *src,
 {
 	size_t orig_len = len;
 	size_t head = src->head;
-	size_t tail = src->tail;
+	size_t tail = queue_wrap(src, head + queue_cons_avail(src, src->size));
 	ssize_t ret;
 
 	if (head == tail)
@@ -382,7 +476,7 @@ ssize_t queue_to_queue(queue_t *dest, queue_t *src,
 
 size_t queue_discard(queue_t *q, size_t num)
 {
-	size_t avail = queue_get_avail(q);
+	size_t avail = queue_cons_avail(q, num);
 
 	if (num > avail)
 		num = avail;
@@ -397,15 +491,19 @@ ssize_t queue_memchr(queue_t *q, int c, size_t start)
 	uint32_t tail = raw_in32(&q->tail);
 	uint8_t *ret;
 
+	/* Search up to the end of the buffer, then from its start up
+	 * to tail.  memchr() doesn't stop at NUL, so the lengths must
+	 * not run past the data.
+	 */
 	if (pos > tail) {
-		ret = memchr(&q->buf[pos], c, q->size - q->head);
+		ret = memchr(&q->buf[pos], c, q->size - pos);
 		if (ret)
-			return ret - &q->buf[q->head];
+			return queue_wrap(q, ret - &q->buf[q->head]);
 
 		pos = 0;
 	}
 
-	ret = memchr(&q->buf[pos], c, tail - q->head);
+	ret = memchr(&q->buf[pos], c, tail - pos);
 	if (ret)
 		return queue_wrap(q, ret - &q->buf[q->head]);
 
@@ -32,6 +32,7 @@
 #include <libos/readline.h>
 #include <libos/errors.h>
 #include <libos/alloc.h>
+#include <libos/slab.h>
 #include <libos/bitops.h>
 #include <libos/console.h>
 #include <libos/thread.h>
@@ -46,6 +47,8 @@ typedef struct line {
 	char buf[LINE_SIZE];
 } line_t;
 
+static DEFINE_SLAB_CACHE(line_cache, line_t);
+
 struct readline {
 	rl_action_t action;
 	const char *prompt;
@@ -189,7 +192,7 @@ static line_t *get_newline(readline_t *rl)
 		return line;
 	}
 
-	line = alloc_type(line_t);
+	line = slab_alloc_type(&line_cache, line_t);
 	if (line)
 		return line;
 
@@ -682,7 +685,7 @@ int readline_init(queue_t *in, queue_t *out,
 	rl->user_ctx = user_ctx;
 	rl->thread = cpu->thread;
 	
-	rl->line = rl->newest_line = rl->oldest_line = alloc_type(line_t);
+	rl->line = rl->newest_line = rl->oldest_line = slab_alloc_type(&line_cache, line_t);
 	if (!rl->line) {
 		in->consumer = out->producer = NULL;
 		free(rl);
@@ -2,7 +2,8 @@
  * Memory allocation using a simple alloc-and-never-free pointer.
  *
  * This is used for "remote heap" functionality such as valloc(),
- * even when dlmalloc is used.
+ * even when dlmalloc is used, and for arenas whose contents are
+ * released all at once.
  */
 
 /* Copyright (C) 2008,2009 Freescale Semiconductor, Inc.
@@ -31,57 +32,148 @@
 
 #include <libos/alloc.h>
 #include <libos/bitops.h>
-
-typedef struct {	
-	uintptr_t start, end;
-} allocator;
+#include <libos/io.h>
+#include <libos/percpu.h>
 
 #ifdef CONFIG_LIBOS_SIMPLE_ALLOC
-static allocator heap;
+static arena_t heap;
+#endif
+
+#ifdef CONFIG_LIBOS_VIRT_ALLOC
+static arena_t virtual;
 #endif
 
-static allocator virtual;
-static uint32_t alloc_lock;
+static uint32_t arena_slot_lock;
+static int arena_slots_used;
+
+void arena_init(arena_t *a, unsigned long start, unsigned long end)
+{
+	a->start = start;
+	a->top = start;
+	a->end = end;
+	a->cpu_slot = 0;
+
+	/* An unused per-cpu region has generation zero. */
+	a->gen = 1;
+}
+
+/* Return the index of the arena's per-cpu region, or -1. */
+static int arena_cpu_slot(arena_t *a)
+{
+	int slot = a->cpu_slot;
+
+	if (likely(slot != 0))
+		return slot > 0 ? slot - 1 : -1;
+
+	register_t saved = spin_lock_intsave(&arena_slot_lock);
+
+	if (a->cpu_slot == 0) {
+		if (arena_slots_used < ARENA_CPU_SLOTS)
+			a->cpu_slot = ++arena_slots_used;
+		else
+			a->cpu_slot = -1;
+	}
+
+	slot = a->cpu_slot;
+	spin_unlock_intsave(&arena_slot_lock, saved);
+
+	return slot > 0 ? slot - 1 : -1;
+}
+
+static void *arena_alloc_shared(arena_t *a, size_t size, size_t align)
+{
+	unsigned long top, new_start, new_top;
+
+	do {
+		top = a->top;
+		new_start = (top + align - 1) & ~(align - 1);
+		new_top = new_start + size;
+
+		if (new_start < top || new_top > a->end || new_top < new_start)
+			return NULL;
+	} while (!compare_and_swap(&a->top, top, new_top));
 
-static void *__alloc(allocator *a, size_t size, size_t align)
+	return (void *)new_start;
+}
+
+void *arena_alloc(arena_t *a, size_t size, size_t align)
 {
-	register_t saved = spin_lock_intsave(&alloc_lock);
+	unsigned long gen, new_start, new_top;
+	arena_cpu_t *ac;
+	register_t saved;
+	void *ret;
+	int slot;
+
+	if (size > ARENA_CPU_CHUNK / 4 || align > ARENA_CPU_CHUNK / 4)
+		return arena_alloc_shared(a, size, align);
+
+	slot = arena_cpu_slot(a);
+	if (slot < 0)
+		return arena_alloc_shared(a, size, align);
 
-	uintptr_t new_start = (a->start + align - 1) & ~(align - 1);
-	void *ret = (void *)new_start;
-	new_start += size;
+	saved = disable_int_save();
+	ac = &cpu->arena[slot];
+	gen = a->gen;
 
-	if (new_start > a->end || new_start <= a->start)
-		ret = NULL;
-	else
-		a->start = new_start;
+	new_start = (ac->top + align - 1) & ~(align - 1);
+	new_top = new_start + size;
 
-	spin_unlock_intsave(&alloc_lock, saved);
+	if (likely(ac->gen == gen && new_top <= ac->end)) {
+		ac->top = new_top;
+		restore_int(saved);
+		return (void *)new_start;
+	}
+
+	/* Start a new region, with this allocation at its base.  If the
+	 * arena has less than a region left, allocate directly, and
+	 * keep the old region in case a later allocation fits.
+	 */
+	ret = arena_alloc_shared(a, ARENA_CPU_CHUNK,
+	                         max(align, sizeof(unsigned long)));
+	if (ret) {
+		ac->top = (unsigned long)ret + size;
+		ac->end = (unsigned long)ret + ARENA_CPU_CHUNK;
+		ac->gen = gen;
+	} else {
+		ret = arena_alloc_shared(a, size, align);
+	}
+
+	restore_int(saved);
 	return ret;
 }
 
+arena_mark_t arena_mark(arena_t *a)
+{
+	atomic_add(&a->gen, 1);
+	return a->top;
+}
+
+void arena_release(arena_t *a, arena_mark_t mark)
+{
+	atomic_add(&a->gen, 1);
+	a->top = mark;
+}
+
 #ifdef CONFIG_LIBOS_SIMPLE_ALLOC
 void *simple_alloc(size_t size, size_t align)
 {
-	return __alloc(&heap, size, align);
+	return arena_alloc(&heap, size, align);
 }
 
 void simple_alloc_init(void *start, size_t size)
 {
-	heap.start = (uintptr_t)start;
-	heap.end = heap.start + size - 1;
+	arena_init(&heap, (unsigned long)start, (unsigned long)start + size);
 }
 #endif	/* CONFIG_LIBOS_SIMPLE_ALLOC */
 
 #ifdef CONFIG_LIBOS_VIRT_ALLOC
 void *valloc(unsigned long size, unsigned long align)
 {
-	return __alloc(&virtual, size, align);
+	return arena_alloc(&virtual, size, align);
 }
 
 void valloc_init(unsigned long start, unsigned long end)
 {
-	virtual.start = (uintptr_t)start;
-	virtual.end = end;
+	arena_init(&virtual, start, end);
 }
 #endif
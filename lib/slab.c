@@ -0,0 +1,220 @@
+/** @file
+ * Caches of fixed-size objects.
+ */
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <libos/slab.h>
+#include <libos/bitops.h>
+#include <libos/io.h>
+#include <libos/libos.h>
+
+static uint32_t slab_slot_lock;
+static int slab_slots_used;
+
+void slab_cache_init(slab_cache_t *c, const char *name,
+                     size_t size, size_t align)
+{
+	align = __SLAB_ALIGN(align);
+
+	c->name = name;
+	c->objsize = (size + align - 1) & ~(align - 1);
+	c->align = align;
+	c->cpu_slot = 0;
+	c->lock = 0;
+	c->free = NULL;
+	c->nfree = 0;
+	c->carve = c->carve_end = NULL;
+	c->slabs = 0;
+}
+
+/* Return the index of the cache's per-cpu free list, or -1. */
+static int slab_cpu_slot(slab_cache_t *c)
+{
+	int slot = c->cpu_slot;
+
+	if (likely(slot != 0))
+		return slot > 0 ? slot - 1 : -1;
+
+	register_t saved = spin_lock_intsave(&slab_slot_lock);
+
+	if (c->cpu_slot == 0) {
+		if (slab_slots_used < SLAB_CPU_SLOTS)
+			c->cpu_slot = ++slab_slots_used;
+		else
+			c->cpu_slot = -1;
+	}
+
+	slot = c->cpu_slot;
+	spin_unlock_intsave(&slab_slot_lock, saved);
+
+	return slot > 0 ? slot - 1 : -1;
+}
+
+/* Take one object from the shared list, or carve one from the current
+ * slab, allocating a new slab if needed.  Called with c->lock held.
+ */
+static void *slab_get_shared(slab_cache_t *c)
+{
+	void *ret = c->free;
+	size_t slab_size;
+
+	if (ret) {
+		c->free = *(void **)ret;
+		c->nfree--;
+		return ret;
+	}
+
+	if (c->carve_end - c->carve < (ptrdiff_t)c->objsize) {
+		slab_size = max((size_t)SLAB_SIZE, c->objsize * SLAB_BATCH);
+
+		c->carve = memalign(c->align, slab_size);
+		if (!c->carve) {
+			c->carve_end = NULL;
+			return NULL;
+		}
+
+		c->carve_end = c->carve + slab_size;
+		c->slabs++;
+	}
+
+	ret = c->carve;
+	c->carve += c->objsize;
+	return ret;
+}
+
+void *slab_alloc(slab_cache_t *c)
+{
+	int slot = slab_cpu_slot(c);
+	slab_cpu_t *sc;
+	register_t saved;
+	void *ret, *obj;
+	int i;
+
+	if (slot < 0) {
+		saved = spin_lock_intsave(&c->lock);
+		ret = slab_get_shared(c);
+		spin_unlock_intsave(&c->lock, saved);
+		return ret;
+	}
+
+	saved = disable_int_save();
+	sc = &cpu->slab[slot];
+
+	ret = sc->head;
+	if (likely(ret)) {
+		sc->head = *(void **)ret;
+		sc->count--;
+		restore_int(saved);
+		return ret;
+	}
+
+	/* Refill the local list with a batch, keeping interrupts
+	 * disabled so that sc stays ours.
+	 */
+	spin_lock(&c->lock);
+
+	ret = slab_get_shared(c);
+
+	for (i = 1; ret && i < SLAB_BATCH; i++) {
+		obj = slab_get_shared(c);
+		if (!obj)
+			break;
+
+		*(void **)obj = sc->head;
+		sc->head = obj;
+		sc->count++;
+	}
+
+	spin_unlock(&c->lock);
+	restore_int(saved);
+	return ret;
+}
+
+/* Move a batch of objects from the head of the local list to the
+ * shared list.  Called with interrupts disabled.
+ */
+static void slab_drain_cpu(slab_cache_t *c, slab_cpu_t *sc, unsigned int num)
+{
+	void *first = sc->head, *last = first;
+	unsigned int i;
+
+	if (num == 0)
+		return;
+
+	for (i = 1; i < num; i++)
+		last = *(void **)last;
+
+	sc->head = *(void **)last;
+	sc->count -= num;
+
+	spin_lock(&c->lock);
+	*(void **)last = c->free;
+	c->free = first;
+	c->nfree += num;
+	spin_unlock(&c->lock);
+}
+
+void slab_free(slab_cache_t *c, void *obj)
+{
+	int slot = slab_cpu_slot(c);
+	slab_cpu_t *sc;
+	register_t saved;
+
+	if (!obj)
+		return;
+
+	if (slot < 0) {
+		saved = spin_lock_intsave(&c->lock);
+		*(void **)obj = c->free;
+		c->free = obj;
+		c->nfree++;
+		spin_unlock_intsave(&c->lock, saved);
+		return;
+	}
+
+	saved = disable_int_save();
+	sc = &cpu->slab[slot];
+
+	*(void **)obj = sc->head;
+	sc->head = obj;
+
+	if (++sc->count > 2 * SLAB_BATCH)
+		slab_drain_cpu(c, sc, SLAB_BATCH);
+
+	restore_int(saved);
+}
+
+void slab_cache_flush(slab_cache_t *c)
+{
+	int slot = slab_cpu_slot(c);
+	register_t saved;
+
+	if (slot < 0)
+		return;
+
+	saved = disable_int_save();
+	slab_drain_cpu(c, &cpu->slab[slot], cpu->slab[slot].count);
+	restore_int(saved);
+}
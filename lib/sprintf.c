@@ -84,6 +84,86 @@ static void printf_fill(char *buf, size_t *opos, size_t limit,
 	*opos += len;
 }
 
+/* Output src, space padded to fieldwidth as for %s and %c. */
+static void printf_field(char *buf, size_t *opos, size_t limit,
+                         const char *src, size_t len, int fieldwidth,
+                         int flags)
+{
+	if (!(flags & left_justify) && len < fieldwidth)
+		printf_fill(buf, opos, limit, ' ', fieldwidth - len);
+
+	printf_string(buf, opos, limit, src, len);
+
+	if ((flags & left_justify) && len < fieldwidth)
+		printf_fill(buf, opos, limit, ' ', fieldwidth - len);
+}
+
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* Write the digits of uval backwards, ending at buf[pos], and return
+ * the position before the first digit.  Radix is 8, 10, or 16.
+ */
+static int printf_digits(char *buf, int pos, uint64_t uval,
+                         int radix, int letter)
+{
+	uint64_t q;
+	uint32_t val32;
+	unsigned int rem;
+
+	if (radix != 10) {
+		int shift = radix == 16 ? 4 : 3;
+
+		do {
+			int ch = uval & (radix - 1);
+
+			buf[pos--] = ch < 10 ? ch + '0' : ch + letter;
+			uval >>= shift;
+		} while (uval);
+
+		return pos;
+	}
+
+	/* 64-bit division is a libgcc call on 32-bit cores, so switch
+	 * to 32-bit division as soon as the value fits, and get the
+	 * remainder from the quotient rather than with a second call.
+	 */
+	while (uval >> 32) {
+		q = uval / 100;
+		rem = uval - q * 100;
+		uval = q;
+		buf[pos--] = digit_pairs[rem * 2 + 1];
+		buf[pos--] = digit_pairs[rem * 2];
+	}
+
+	val32 = uval;
+
+	while (val32 >= 100) {
+		rem = val32 % 100;
+		val32 /= 100;
+		buf[pos--] = digit_pairs[rem * 2 + 1];
+		buf[pos--] = digit_pairs[rem * 2];
+	}
+
+	if (val32 >= 10) {
+		buf[pos--] = digit_pairs[val32 * 2 + 1];
+		buf[pos--] = digit_pairs[val32 * 2];
+	} else {
+		buf[pos--] = val32 + '0';
+	}
+
+	return pos;
+}
+
 static void printf_num(char *obuf, size_t *opos, size_t limit,
                        int64_t value, long radix, int fieldwidth,
                        int precision, int flags)
@@ -91,9 +171,13 @@ static void printf_num(char *obuf, size_t *opos, size_t limit,
 	char buf[65];
 	int pos = 64;
 	int letter = (flags & capital_hex) ? 'A' - 10 : 'a' - 10;
+	char prefix[3];
 	uint64_t uval;
 	int len, extralen;
 
+	if (precision < 0)
+		flags &= ~has_precision;
+
 	if (flags & num_signed)
 		uval = value < 0 ? -value : value;
 	else
@@ -104,46 +188,40 @@ static void printf_num(char *obuf, size_t *opos, size_t limit,
 	 * or field width.
 	 */
 	
-	if (uval != 0 || !(flags & has_precision) || precision != 0) do {
-		int ch = uval % radix;
-		
-		if (ch < 10)
-			buf[pos] = ch + '0';
-		else
-			buf[pos] = ch + letter;
-		
-		uval /= radix;
-		pos--;
-	} while (uval);
+	if (uval != 0 || !(flags & has_precision) || precision != 0)
+		pos = printf_digits(buf, pos, uval, radix, letter);
 	
 	len = 64 - pos;
 
-	/* length which counts against fieldwidth but not precision */
+	/* An explicit precision disables zero padding. */
+	if (flags & has_precision)
+		flags &= ~zero_pad;
+
+	/* sign and "0x", which count against fieldwidth but not precision */
 	extralen = 0; 
 	
 	if (flags & num_signed) {
-		if (value < 0) {
-			printf_fill(obuf, opos, limit, '-', 1);
-			extralen += 1;
-		} else if (flags & always_sign) {
-			printf_fill(obuf, opos, limit, '+', 1);
-			extralen += 1;
-		} else if (flags & leave_blank) {
-			printf_fill(obuf, opos, limit, ' ', 1);
-			extralen += 1;
-		}
+		if (value < 0)
+			prefix[extralen++] = '-';
+		else if (flags & always_sign)
+			prefix[extralen++] = '+';
+		else if (flags & leave_blank)
+			prefix[extralen++] = ' ';
 	}
 	
-	if ((flags & alt_form) && value != 0) {
-		if (radix == 8 && (!(flags & has_precision) || precision <= len)) {
-			flags |= has_precision;
-			precision = len + 1;
-		}
-		
-		if (radix == 16) {
-			printf_string(obuf, opos, limit, "0x", 2);
-			extralen += 2;
-		}
+	/* The octal alternate form only needs to add a leading zero if
+	 * there isn't one already, which is also the case when a zero
+	 * value was suppressed by a precision of 0.
+	 */
+	if ((flags & alt_form) && radix == 8 && (value != 0 || len == 0) &&
+	    (!(flags & has_precision) || precision <= len)) {
+		flags |= has_precision;
+		precision = len + 1;
+	}
+
+	if ((flags & alt_form) && radix == 16 && value != 0) {
+		prefix[extralen++] = '0';
+		prefix[extralen++] = (flags & capital_hex) ? 'X' : 'x';
 	}
 	
 	if ((flags & has_precision) && len < precision) {
@@ -155,10 +233,14 @@ static void printf_num(char *obuf, size_t *opos, size_t limit,
 	
 	len += extralen;
 	
-	if (!(flags & left_justify) && len < fieldwidth) {
-		char padchar = (flags & zero_pad) ? '0' : ' ';
-		printf_fill(obuf, opos, limit, padchar, fieldwidth - len);
-	}
+	/* Space padding goes before the prefix, zero padding after it. */
+	if (!(flags & (left_justify | zero_pad)) && len < fieldwidth)
+		printf_fill(obuf, opos, limit, ' ', fieldwidth - len);
+
+	printf_string(obuf, opos, limit, prefix, extralen);
+
+	if ((flags & zero_pad) && !(flags & left_justify) && len < fieldwidth)
+		printf_fill(obuf, opos, limit, '0', fieldwidth - len);
 
 	if (precision != 0)
 		printf_fill(obuf, opos, limit, '0', precision);
@@ -169,14 +251,43 @@ static void printf_num(char *obuf, size_t *opos, size_t limit,
 		printf_fill(obuf, opos, limit, ' ', fieldwidth - len);
 }
 
-int vsnprintf(char *buf, size_t size, const char *str, va_list args)
+/* Source of arguments: either a va_list, or an array saved by
+ * printf_save_args().
+ */
+struct printf_args {
+	va_list args;
+	const uint64_t *argv;
+	const char *strbase;
+};
+
+#define printf_arg(pa, type) \
+	((pa)->argv ? (type)*(pa)->argv++ : va_arg((pa)->args, type))
+
+#define printf_ptr_arg(pa, type) \
+	((pa)->argv ? (type)(uintptr_t)*(pa)->argv++ : va_arg((pa)->args, type))
+
+static const char *printf_str_arg(struct printf_args *pa)
+{
+	if (pa->argv && pa->strbase) {
+		uint64_t off = *pa->argv++;
+
+		return off == PRINTF_NULL_STR ? NULL : pa->strbase + off;
+	}
+
+	return printf_ptr_arg(pa, const char *);
+}
+
+static int __vsnprintf(char *buf, size_t size, const char *str,
+                       struct printf_args *pa)
 {
 	size_t opos = 0; /* position in the output string */
+	size_t limit = size ? size - 1 : 0; /* room for output before the NUL */
 	unsigned int flags = 0;
 	int radix = 10;
 	int state = 0;
 	int fieldwidth = 0;
 	int precision = 0;
+	size_t run;
 
 	for (size_t pos = 0; str[pos]; pos++) switch (state) {
 		case 0:
@@ -189,10 +300,13 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 				break;
 			}
 		
-			if (opos < size - 1)
-				buf[opos] = str[pos];
+			/* Copy literal text up to the next conversion at once. */
+			run = 1;
+			while (str[pos + run] && str[pos + run] != '%')
+				run++;
 
-			opos++;
+			printf_string(buf, &opos, limit, &str[pos], run);
+			pos += run - 1;
 			break;
 		
 		case 1: /* A percent has been seen; read in format characters */
@@ -225,7 +339,7 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 					if (fieldwidth || (flags & has_precision))
 						goto default_case;
 					
-					fieldwidth = va_arg(args, int);
+					fieldwidth = printf_arg(pa, int);
 					
 					if (fieldwidth < 0) {
 						fieldwidth = -fieldwidth;
@@ -237,12 +351,13 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 				case '.':
 					flags |= has_precision;
 					
+					/* A negative precision is taken as if it
+					 * were omitted, but still ends the field
+					 * width, so has_precision stays set.
+					 */
 					if (str[pos + 1] == '*') {
 						pos++;
-						precision = va_arg(args, int);
-						
-						if (precision < 0)
-							precision = 0;
+						precision = printf_arg(pa, int);
 					} else while (str[pos + 1] >= '0' && str[pos + 1] <= '9') {
 						precision *= 10;
 						precision += str[++pos] - '0';
@@ -299,22 +414,22 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 					int64_t arg;
 				
 					if ((flags & intmax_arg) || (flags & long_long_arg))
-						arg = va_arg(args, long long);
+						arg = printf_arg(pa, long long);
 					else if (flags & size_t_arg)
-						arg = va_arg(args, ssize_t);
+						arg = printf_arg(pa, ssize_t);
 					else if (flags & ptrdiff_arg)
-						arg = va_arg(args, ptrdiff_t);
+						arg = printf_arg(pa, ptrdiff_t);
 					else if (flags & long_arg)
-						arg = va_arg(args, long);
+						arg = printf_arg(pa, long);
 					else if (flags & short_short_arg)
-						arg = (signed char)va_arg(args, int);
+						arg = (signed char)printf_arg(pa, int);
 					else if (flags & short_arg)
-						arg = (short)va_arg(args, int);
+						arg = (short)printf_arg(pa, int);
 					else
-						arg = va_arg(args, int);
+						arg = printf_arg(pa, int);
 					
 					flags |= num_signed;
-					printf_num(buf, &opos, size - 1, arg, 10,
+					printf_num(buf, &opos, limit, arg, 10,
 					           fieldwidth, precision, flags);
 					state = 0;
 					break;
@@ -336,68 +451,61 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 					uint64_t arg;
 				
 					if ((flags & intmax_arg) || (flags & long_long_arg))
-						arg = va_arg(args, unsigned long long);
+						arg = printf_arg(pa, unsigned long long);
 					else if (flags & size_t_arg)
-						arg = va_arg(args, size_t);
+						arg = printf_arg(pa, size_t);
 					else if (flags & ptrdiff_arg)
-						arg = va_arg(args, intptr_t);
+						arg = printf_arg(pa, intptr_t);
 					else if (flags & long_arg)
-						arg = va_arg(args, unsigned long);
+						arg = printf_arg(pa, unsigned long);
 					else if (flags & short_short_arg)
-						arg = (unsigned char)va_arg(args, unsigned int);
+						arg = (unsigned char)printf_arg(pa, unsigned int);
 					else if (flags & short_arg)
-						arg = (unsigned short)va_arg(args, unsigned int);
+						arg = (unsigned short)printf_arg(pa, unsigned int);
 					else if (flags & short_short_arg)
-						arg = (signed char)va_arg(args, int);
+						arg = (signed char)printf_arg(pa, int);
 					else if (flags & short_arg)
-						arg = (short)va_arg(args, int);
+						arg = (short)printf_arg(pa, int);
 					else
-						arg = va_arg(args, unsigned int);
+						arg = printf_arg(pa, unsigned int);
 					
-					printf_num(buf, &opos, size - 1, arg, radix,
+					printf_num(buf, &opos, limit, arg, radix,
 					           fieldwidth, precision, flags);
 					state = 0;
 					break;
 				}
 				
-				case 'c':
-					if (opos < size - 1)
-						buf[opos] = va_arg(args, int);
-	
-					opos++;
+				case 'c': {
+					char arg = printf_arg(pa, int);
+
+					printf_field(buf, &opos, limit, &arg, 1,
+					             fieldwidth, flags);
 					state = 0;
 					break;
+				}
 				
 				case 's': {
-					const char *arg = va_arg(args, const char *);
+					const char *arg = printf_str_arg(pa);
 					size_t len;
 					
 					if (!arg)
 						arg = "(null)";
 					
-					if (flags & has_precision)
+					if ((flags & has_precision) && precision >= 0)
 						len = min(precision, strnlen(arg, precision));
 					else
 						len = strlen(arg);
 
-					if (!(flags & left_justify) && len < fieldwidth)
-						printf_fill(buf, &opos, size - 1, ' ',
-						            fieldwidth - len);
-					
-					printf_string(buf, &opos, size - 1, arg, len);
-
-					if ((flags & left_justify) && len < fieldwidth)
-						printf_fill(buf, &opos, size - 1, ' ',
-						            fieldwidth - len);
-
+					printf_field(buf, &opos, limit, arg, len,
+					             fieldwidth, flags);
 					state = 0;
 					break;
 				}
 				
 				case 'p': {
-					const void *arg = va_arg(args, const void *);
+					const void *arg = printf_ptr_arg(pa, const void *);
 
-					printf_num(buf, &opos, size - 1, (unsigned long)arg, 16,
+					printf_num(buf, &opos, limit, (unsigned long)arg, 16,
 					           fieldwidth, precision, flags);
 					
 					state = 0;
@@ -405,20 +513,27 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 				}
 				
 				case 'n': {
+					/* Whatever saved the arguments is gone. */
+					if (pa->argv) {
+						pa->argv++;
+						state = 0;
+						break;
+					}
+
 					if ((flags & intmax_arg) || (flags & long_long_arg))
-						*va_arg(args, unsigned long long *) = opos;
+						*printf_ptr_arg(pa, unsigned long long *) = opos;
 					else if (flags & size_t_arg)
-						*va_arg(args, ssize_t *) = opos;
+						*printf_ptr_arg(pa, ssize_t *) = opos;
 					else if (flags & ptrdiff_arg)
-						*va_arg(args, ptrdiff_t *) = opos;
+						*printf_ptr_arg(pa, ptrdiff_t *) = opos;
 					else if (flags & long_arg)
-						*va_arg(args, long *) = opos;
+						*printf_ptr_arg(pa, long *) = opos;
 					else if (flags & short_short_arg)
-						*va_arg(args, signed char *) = opos;
+						*printf_ptr_arg(pa, signed char *) = opos;
 					else if (flags & short_arg)
-						*va_arg(args, short *) = opos;
+						*printf_ptr_arg(pa, short *) = opos;
 					else
-						*va_arg(args, int *) = opos;
+						*printf_ptr_arg(pa, int *) = opos;
 						
 					state = 0;
 					break;
@@ -426,7 +541,7 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 
 				default_case: /* label for goto */
 				default:
-					if (opos < size - 1)
+					if (opos < limit)
 						buf[opos] = str[pos];
 					
 					opos++;
@@ -438,11 +553,202 @@ int vsnprintf(char *buf, size_t size, const char *str, va_list args)
 	if (opos < size)
 		buf[opos] = 0;
 	else if (size > 0)
-		buf[size - 1] = 0;
+		buf[limit] = 0;
 	
 	return opos;
 }
 
+int vsnprintf(char *buf, size_t size, const char *str, va_list args)
+{
+	struct printf_args pa = { .argv = NULL };
+	int ret;
+
+	va_copy(pa.args, args);
+	ret = __vsnprintf(buf, size, str, &pa);
+	va_end(pa.args);
+
+	return ret;
+}
+
+int vsnprintf_argv(char *buf, size_t size, const char *str,
+                   const uint64_t *argv, const char *strbase)
+{
+	struct printf_args pa = { .argv = argv, .strbase = strbase };
+
+	return __vsnprintf(buf, size, str, &pa);
+}
+
+/* This must consume arguments exactly as __vsnprintf() does, including
+ * for malformed conversions, or the saved arguments are misaligned.
+ */
+int printf_save_args(const char *str, va_list args, uint64_t *argv,
+                     int max, uint32_t *strmask)
+{
+	unsigned int flags = 0;
+	int fieldwidth = 0;
+	int state = 0;
+	int num = 0;
+
+	*strmask = 0;
+
+	for (size_t pos = 0; str[pos]; pos++) {
+		uint64_t arg;
+
+		if (state == 0) {
+			if (str[pos] == '%') {
+				flags = 0;
+				fieldwidth = 0;
+				state = 1;
+			}
+
+			continue;
+		}
+
+		switch (str[pos]) {
+		case '0':
+			if (!(flags & has_precision))
+				continue;
+
+			/* fall through */
+
+		case '1' ... '9':
+			if (flags & has_precision) {
+				state = 0;
+				continue;
+			}
+
+			do {
+				fieldwidth *= 10;
+				fieldwidth += str[pos++] - '0';
+			} while (str[pos] >= '0' && str[pos] <= '9');
+
+			pos--;
+			continue;
+
+		case '*':
+			if (fieldwidth || (flags & has_precision)) {
+				state = 0;
+				continue;
+			}
+
+			arg = va_arg(args, int);
+			fieldwidth = (int)arg < 0 ? -(int)arg : (int)arg;
+			break;
+
+		case '.':
+			flags |= has_precision;
+
+			if (str[pos + 1] == '*') {
+				pos++;
+				arg = va_arg(args, int);
+				break;
+			}
+
+			while (str[pos + 1] >= '0' && str[pos + 1] <= '9')
+				pos++;
+
+			continue;
+
+		case '#':
+		case '-':
+		case ' ':
+		case '+':
+		case '\'':
+			continue;
+
+		case 'l':
+			if (flags & long_arg)
+				flags |= long_long_arg;
+			else
+				flags |= long_arg;
+
+			continue;
+
+		case 'h':
+			if (flags & short_arg)
+				flags |= short_short_arg;
+			else
+				flags |= short_arg;
+
+			continue;
+
+		case 'j':
+			flags |= intmax_arg;
+			continue;
+
+		case 't':
+			flags |= ptrdiff_arg;
+			continue;
+
+		case 'z':
+			flags |= size_t_arg;
+			continue;
+
+		case 'd':
+		case 'i':
+			if ((flags & intmax_arg) || (flags & long_long_arg))
+				arg = va_arg(args, long long);
+			else if (flags & size_t_arg)
+				arg = va_arg(args, ssize_t);
+			else if (flags & ptrdiff_arg)
+				arg = va_arg(args, ptrdiff_t);
+			else if (flags & long_arg)
+				arg = va_arg(args, long);
+			else
+				arg = va_arg(args, int);
+
+			state = 0;
+			break;
+
+		case 'X':
+		case 'x':
+		case 'o':
+		case 'u':
+			if ((flags & intmax_arg) || (flags & long_long_arg))
+				arg = va_arg(args, unsigned long long);
+			else if (flags & size_t_arg)
+				arg = va_arg(args, size_t);
+			else if (flags & ptrdiff_arg)
+				arg = va_arg(args, intptr_t);
+			else if (flags & long_arg)
+				arg = va_arg(args, unsigned long);
+			else
+				arg = va_arg(args, unsigned int);
+
+			state = 0;
+			break;
+
+		case 'c':
+			arg = va_arg(args, int);
+			state = 0;
+			break;
+
+		case 's':
+			if (num < 32)
+				*strmask |= 1U << num;
+
+			/* fall through */
+
+		case 'p':
+		case 'n':
+			arg = (uintptr_t)va_arg(args, const void *);
+			state = 0;
+			break;
+
+		default:
+			state = 0;
+			continue;
+		}
+
+		if (num >= max || num >= 32)
+			return -1;
+
+		argv[num++] = arg;
+	}
+
+	return num;
+}
+
 int snprintf(char *buf, size_t size, const char *str, ...)
 {
 	va_list args;
@@ -80,6 +80,25 @@ int vprintf(const char *str, va_list args)
 	static char buffer[buffer_size];
 	int lock = 1;
 
+#ifdef CONFIG_LIBOS_CONSOLE_FANIN
+	/* Format short messages on the stack, so that they can go through
+	 * the fan-in without console_lock.  Longer ones, or ones that
+	 * don't fit in the fan-in, use the static buffer below.
+	 */
+	if (likely(!cpu->crashing)) {
+		char msg[CONSOLE_FANIN_MSG];
+		va_list copy;
+		int ret;
+
+		va_copy(copy, args);
+		ret = vsnprintf(msg, sizeof(msg), str, copy);
+		va_end(copy);
+
+		if (ret < (int)sizeof(msg) && console_write_fanin(msg, ret) == 0)
+			return ret;
+	}
+#endif
+
 	if (unlikely(cpu->crashing)) {
 		if (cpu->crashing > CRASH_IN_PRINT)
 			return -1;
@@ -47,45 +47,178 @@
 
 #include <libos/errors.h>
 #include <libos/percpu.h>
+#include <libos/io.h>
+#include <libos/endian.h>
 
-void *memcpy(void *dest, const void *src, size_t len)
+#define WORD_SIZE sizeof(unsigned long)
+#define WORD_MASK (WORD_SIZE - 1)
+
+#define BYTES_ONES ((unsigned long)-1 / 0xff)
+#define BYTES_HIGH (BYTES_ONES << 7)
+
+/* Nonzero if any byte of x is zero.  A borrow can flag a 0x01 byte
+ * above a zero byte, so this only says whether the word holds a zero,
+ * not where.
+ */
+static inline unsigned long has_zero_byte(unsigned long x)
+{
+	return (x - BYTES_ONES) & ~x & BYTES_HIGH;
+}
+
+static inline int same_alignment(const void *a, const void *b)
+{
+	return !(((uintptr_t)a ^ (uintptr_t)b) & WORD_MASK);
+}
+
+/* The copy loops move one chunk per iteration and touch the source
+ * and destination a few chunks ahead.  dcbt/dcbtst never fault, so
+ * touching past the end of a buffer is harmless.  The chunk is the
+ * smallest cache block size of any supported core.
+ */
+#define COPY_CHUNK_WORDS (32 / WORD_SIZE)
+#define COPY_AHEAD 128
+
+/* Below this length, the setup for word copies costs more than it saves. */
+#define COPY_MIN_WORDS 4
+
+static inline void touch_ahead(const void *src, void *dest)
+{
+	prefetch((void *)src + COPY_AHEAD);
+	prefetch_store(dest + COPY_AHEAD);
+}
+
+static void copy_words_fwd(unsigned long *ld, const unsigned long *ls,
+                           size_t words)
 {
-	const char *cs = src;
-	char *cd = dest;
-	const long *ls;
-	long *ld;
 	size_t i;
-	const unsigned int lowbits = sizeof(long) - 1;
 
-	if (__builtin_expect((((uintptr_t)dest) & lowbits) !=
-	                     (((uintptr_t)src) & lowbits), 0)) {
-		for (i = 0; i < len; i++)	
-			cd[i] = cs[i];
+	while (words >= COPY_CHUNK_WORDS) {
+		touch_ahead(ls, ld);
+
+		for (i = 0; i < COPY_CHUNK_WORDS; i++)
+			ld[i] = ls[i];
 
-		return dest;
+		ld += COPY_CHUNK_WORDS;
+		ls += COPY_CHUNK_WORDS;
+		words -= COPY_CHUNK_WORDS;
 	}
 
-	while (len > 0 && (((uintptr_t)cd) & lowbits)) {
+	while (words-- > 0)
+		*ld++ = *ls++;
+}
+
+/* Copy to an aligned destination from a source with a different
+ * alignment.  Every load is an aligned word, so nothing outside the
+ * words holding the first and last source bytes is read.
+ */
+static void copy_shift_fwd(unsigned long *ld, const char *cs, size_t words)
+{
+	unsigned int shift = ((uintptr_t)cs & WORD_MASK) * 8;
+	const unsigned long *ls = (const unsigned long *)(cs - shift / 8);
+	unsigned long prev = *ls++, next;
+	size_t i;
+
+	while (words >= COPY_CHUNK_WORDS) {
+		touch_ahead(ls, ld);
+
+		for (i = 0; i < COPY_CHUNK_WORDS; i++) {
+			next = *ls++;
+			*ld++ = MERGE_CPU(prev, next, shift);
+			prev = next;
+		}
+
+		words -= COPY_CHUNK_WORDS;
+	}
+
+	while (words-- > 0) {
+		next = *ls++;
+		*ld++ = MERGE_CPU(prev, next, shift);
+		prev = next;
+	}
+}
+
+/* ld and ls point just past the end of the regions to copy. */
+static void copy_words_back(unsigned long *ld, const unsigned long *ls,
+                            size_t words)
+{
+	size_t i;
+
+	while (words >= COPY_CHUNK_WORDS) {
+		ld -= COPY_CHUNK_WORDS;
+		ls -= COPY_CHUNK_WORDS;
+		prefetch((void *)ls - COPY_AHEAD);
+		prefetch_store((void *)ld - COPY_AHEAD);
+
+		for (i = COPY_CHUNK_WORDS; i-- > 0; )
+			ld[i] = ls[i];
+
+		words -= COPY_CHUNK_WORDS;
+	}
+
+	while (words-- > 0)
+		*--ld = *--ls;
+}
+
+/* ld and cs point just past the end of the regions to copy. */
+static void copy_shift_back(unsigned long *ld, const char *cs, size_t words)
+{
+	unsigned int shift = ((uintptr_t)cs & WORD_MASK) * 8;
+	const unsigned long *ls = (const unsigned long *)(cs - shift / 8);
+	unsigned long next = *ls, prev;
+	size_t i;
+
+	while (words >= COPY_CHUNK_WORDS) {
+		prefetch((void *)ls - COPY_AHEAD);
+		prefetch_store((void *)ld - COPY_AHEAD);
+
+		for (i = 0; i < COPY_CHUNK_WORDS; i++) {
+			prev = *--ls;
+			*--ld = MERGE_CPU(prev, next, shift);
+			next = prev;
+		}
+
+		words -= COPY_CHUNK_WORDS;
+	}
+
+	while (words-- > 0) {
+		prev = *--ls;
+		*--ld = MERGE_CPU(prev, next, shift);
+		next = prev;
+	}
+}
+
+void *memcpy(void *dest, const void *src, size_t len)
+{
+	const char *cs = src;
+	char *cd = dest;
+	size_t words;
+
+	if (len < COPY_MIN_WORDS * WORD_SIZE)
+		goto bytes;
+
+	while ((uintptr_t)cd & WORD_MASK) {
 		*cd++ = *cs++;
 		len--;
 	}
 
-	ls = (const long *)cs;
-	ld = (long *)cd;
+	words = len / WORD_SIZE;
 
-	while (len > lowbits) {
-		*ld++ = *ls++;
-		len -= sizeof(long);
-	}
-	
-	cs = (const char *)ls;
-	cd = (char *)ld;
+	if ((uintptr_t)cs & WORD_MASK)
+		copy_shift_fwd((unsigned long *)cd, cs, words);
+	else
+		copy_words_fwd((unsigned long *)cd,
+		               (const unsigned long *)cs, words);
+
+	cd += words * WORD_SIZE;
+	cs += words * WORD_SIZE;
+	len &= WORD_MASK;
 
+bytes:
 	while (len > 0) {
 		*cd++ = *cs++;
 		len--;
 	}
-	
+
 	return dest;
 }
 
@@ -93,49 +226,109 @@ void *memmove(void *dest, const void *src, size_t len)
 {
 	const char *cs = src;
 	char *cd = dest;
-	size_t i;
+	size_t words;
 
-	if (dest < src)
+	/* A forward copy only reads each source word before the
+	 * stores that could overwrite it.
+	 */
+	if (cd <= cs || cd >= cs + len)
 		return memcpy(dest, src, len);
 
-	for (i = len - 1; i < len; i--)
-		cd[i] = cs[i];
+	if (len < COPY_MIN_WORDS * WORD_SIZE)
+		goto bytes;
+
+	while ((uintptr_t)(cd + len) & WORD_MASK) {
+		len--;
+		cd[len] = cs[len];
+	}
+
+	words = len / WORD_SIZE;
+
+	if ((uintptr_t)(cs + len) & WORD_MASK)
+		copy_shift_back((unsigned long *)(cd + len), cs + len, words);
+	else
+		copy_words_back((unsigned long *)(cd + len),
+		                (const unsigned long *)(cs + len), words);
+
+	len &= WORD_MASK;
+
+bytes:
+	while (len > 0) {
+		len--;
+		cd[len] = cs[len];
+	}
 
 	return dest;
 }
 
 int memcmp(const void *b1, const void *b2, size_t len)
 {
-	size_t pos;
-	const char *c1 = b1;
-	const char *c2 = b2;
-	
-	for (pos = 0; pos < len; pos++) {
-		if (c1[pos] != c2[pos])
-			return (int)c1[pos] - (int)c2[pos];
+	const unsigned char *c1 = b1;
+	const unsigned char *c2 = b2;
+	const unsigned long *l1, *l2;
+
+	if (len >= COPY_MIN_WORDS * WORD_SIZE && same_alignment(c1, c2)) {
+		while ((uintptr_t)c1 & WORD_MASK) {
+			if (*c1 != *c2)
+				return *c1 - *c2;
+
+			c1++;
+			c2++;
+			len--;
+		}
+
+		l1 = (const unsigned long *)c1;
+		l2 = (const unsigned long *)c2;
+
+		while (len >= WORD_SIZE && *l1 == *l2) {
+			l1++;
+			l2++;
+			len -= WORD_SIZE;
+		}
+
+		c1 = (const unsigned char *)l1;
+		c2 = (const unsigned char *)l2;
 	}
-	
+
+	for (; len > 0; len--, c1++, c2++) {
+		if (*c1 != *c2)
+			return *c1 - *c2;
+	}
+
 	return 0;
 }
 
 size_t strnlen(const char *s, size_t n)
 {
-	size_t pos = 0;
+	const char *end = memchr(s, 0, n);
 
-	while (pos < n && *s++)
-		pos++;
-
-	return pos;
+	return end ? end - s : n;
 }
 
+/* Aligned word loads never cross a page, so reading past the
+ * terminator within the last word is safe.
+ */
 size_t strlen(const char *s)
 {
-	size_t pos = 0;
+	const char *p = s;
+	const unsigned long *lp;
 
-	while (*s++)
-		pos++;
+	while ((uintptr_t)p & WORD_MASK) {
+		if (!*p)
+			return p - s;
+
+		p++;
+	}
+
+	lp = (const unsigned long *)p;
+	while (!has_zero_byte(*lp))
+		lp++;
 
-	return pos;
+	p = (const char *)lp;
+	while (*p)
+		p++;
+
+	return p - s;
 }
 
 char *strcpy(char *dest, const char *src)
@@ -195,25 +388,52 @@ char *strncat(char *dest, const char *src, size_t len)
 
 int strcmp(const char *s1, const char *s2)
 {
-	while (*s1 && *s2 && *s1 == *s2) {
-		s1++;
-		s2++;
+	const unsigned char *c1 = (const unsigned char *)s1;
+	const unsigned char *c2 = (const unsigned char *)s2;
+	const unsigned long *l1, *l2;
+
+	if (same_alignment(c1, c2)) {
+		while ((uintptr_t)c1 & WORD_MASK) {
+			if (!*c1 || *c1 != *c2)
+				return *c1 - *c2;
+
+			c1++;
+			c2++;
+		}
+
+		l1 = (const unsigned long *)c1;
+		l2 = (const unsigned long *)c2;
+
+		while (*l1 == *l2 && !has_zero_byte(*l1)) {
+			l1++;
+			l2++;
+		}
+
+		c1 = (const unsigned char *)l1;
+		c2 = (const unsigned char *)l2;
+	}
+
+	while (*c1 && *c1 == *c2) {
+		c1++;
+		c2++;
 	}
 
-	return *s2 - *s1;
+	return *c1 - *c2;
 }
 
 int strncmp(const char *s1, const char *s2, size_t n)
 {
-	int i = 0;
+	const unsigned char *c1 = (const unsigned char *)s1;
+	const unsigned char *c2 = (const unsigned char *)s2;
+	size_t i = 0;
 
-	while (i < n && s1[i] && s2[i] && s1[i] == s2[i])
+	while (i < n && c1[i] && c1[i] == c2[i])
 		i++;
 
 	if (i == n)
 		return 0;
 
-	return s2[i] - s1[i];
+	return c1[i] - c2[i];
 }
 
 char *strchr(const char *s, int c)
@@ -261,13 +481,29 @@ char *strdup(const char *s)
 
 void *memchr(const void *s, int c, size_t len)
 {
-	const char *cp = s;
+	const unsigned char *cp = s;
+	const unsigned long *lp;
+	unsigned char ch = c;
+	unsigned long pattern = ch * BYTES_ONES;
+
+	while (len > 0 && ((uintptr_t)cp & WORD_MASK)) {
+		if (*cp == ch)
+			return (void *)cp;
 
-	while (*cp && *cp != c && len-- != 0)
 		cp++;
+		len--;
+	}
 
-	if (*cp == c) 
-		return (void *)cp;
+	lp = (const unsigned long *)cp;
+	while (len >= WORD_SIZE && !has_zero_byte(*lp ^ pattern)) {
+		lp++;
+		len -= WORD_SIZE;
+	}
+
+	for (cp = (const unsigned char *)lp; len > 0; cp++, len--) {
+		if (*cp == ch)
+			return (void *)cp;
+	}
 
 	return NULL;
 }
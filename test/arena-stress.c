@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Tests for the arenas in simple-alloc.c.
+ *
+ * Several threads, each on its own cpu, allocate from a shared arena
+ * with random sizes and alignments, sometimes larger than a per-cpu
+ * region, and the allocations must be aligned, inside the arena, and
+ * disjoint.  Between phases, the main thread takes a mark and then
+ * releases it, and every allocation made after the mark, on any cpu,
+ * must be above it.  The exact bounds of simple_alloc_init() and
+ * valloc_init(), and arenas beyond the per-cpu slots, are checked on
+ * their own.
+ *
+ * usage: arena-stress [threads [allocations per thread and phase]]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libos/alloc.h>
+#include <libos/percpu.h>
+
+#include "host.h"
+
+/* libos declares these in its own malloc.h. */
+void *simple_alloc(size_t size, size_t align);
+void simple_alloc_init(void *start, size_t size);
+
+#define ARENA_SIZE (64 << 20)
+#define MAX_SIZE   (ARENA_CPU_CHUNK * 2)
+#define MAX_ALIGN  512
+
+typedef struct chunk {
+	unsigned long addr;
+	size_t size;
+} chunk_t;
+
+static arena_t arena;
+static arena_mark_t mark;
+static pthread_barrier_t phase;
+static chunk_t *chunks;
+static int nthreads = 4;
+static unsigned long count = 10000;
+static int failed;
+
+static __attribute__((format(printf, 1, 2))) void fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+
+	va_start(ap, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* Fill c[0...count) from the arena, and check that each allocation
+ * is aligned and at or above floor.
+ */
+static void allocate(chunk_t *c, uint32_t *rand, unsigned long floor)
+{
+	unsigned long i;
+
+	for (i = 0; i < count; i++) {
+		uint32_t r = next_rand(rand);
+		size_t align = 1 << (r % 10);
+		size_t size;
+		void *p;
+
+		r >>= 4;
+
+		/* Mostly small, sometimes too big for a per-cpu region. */
+		if (r % 16 == 0)
+			size = ARENA_CPU_CHUNK / 4 + (r >> 4) % MAX_SIZE;
+		else
+			size = (r >> 4) % 200 + 1;
+
+		p = arena_alloc(&arena, size, align);
+		if (!p) {
+			fail("size %zu align %zu: arena exhausted", size, align);
+			return;
+		}
+
+		if ((unsigned long)p & (align - 1))
+			fail("%p: misaligned to %zu", p, align);
+
+		if ((unsigned long)p < floor)
+			fail("%p: below mark %#lx", p, floor);
+
+		c[i].addr = (unsigned long)p;
+		c[i].size = size;
+	}
+}
+
+static void *worker(void *arg)
+{
+	int id = (uintptr_t)arg;
+	uint32_t rand = id * 2654435761U + 1;
+	chunk_t *c = &chunks[id * count];
+
+	host_cpu_init(id);
+
+	/* Before the mark. */
+	allocate(c, &rand, 0);
+	pthread_barrier_wait(&phase);
+	pthread_barrier_wait(&phase);
+
+	/* After the mark. */
+	allocate(c + nthreads * count, &rand, mark);
+	pthread_barrier_wait(&phase);
+	pthread_barrier_wait(&phase);
+
+	/* After releasing it, over the allocations made after it. */
+	allocate(c + nthreads * count, &rand, mark);
+	return NULL;
+}
+
+static int compare_chunks(const void *a, const void *b)
+{
+	const chunk_t *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/* Check that n chunks lie within the arena and do not overlap. */
+static void check_disjoint(const chunk_t *chunks, unsigned long n)
+{
+	chunk_t *c = malloc(n * sizeof(chunk_t));
+	unsigned long i;
+
+	memcpy(c, chunks, n * sizeof(chunk_t));
+	qsort(c, n, sizeof(chunk_t), compare_chunks);
+
+	if (c[0].addr < arena.start || c[n - 1].addr + c[n - 1].size > arena.top)
+		fail("allocations outside [%#lx, %#lx)", arena.start, arena.top);
+
+	for (i = 1; i < n; i++)
+		if (c[i - 1].addr + c[i - 1].size > c[i].addr)
+			fail("%#lx overlaps %#lx", c[i - 1].addr, c[i].addr);
+
+	free(c);
+}
+
+static void run_threads(void)
+{
+	pthread_t threads[HOST_MAX_CPUS];
+	unsigned long n = nthreads * count;
+	void *mem;
+	int i;
+
+	if (posix_memalign(&mem, MAX_ALIGN, ARENA_SIZE)) {
+		fprintf(stderr, "FAIL: no memory for the arena\n");
+		exit(1);
+	}
+
+	arena_init(&arena, (unsigned long)mem,
+	           (unsigned long)mem + ARENA_SIZE);
+
+	chunks = calloc(2 * n, sizeof(chunk_t));
+
+	pthread_barrier_init(&phase, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, worker, (void *)(uintptr_t)i);
+
+	pthread_barrier_wait(&phase);
+	mark = arena_mark(&arena);
+	pthread_barrier_wait(&phase);
+
+	pthread_barrier_wait(&phase);
+	check_disjoint(chunks, 2 * n);
+
+	/* Whatever came after the mark is released, and the next
+	 * allocations reuse it.
+	 */
+	arena_release(&arena, mark);
+	if (arena.top != mark)
+		fail("top %#lx after release to %#lx", arena.top, mark);
+
+	pthread_barrier_wait(&phase);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	check_disjoint(chunks, 2 * n);
+
+	arena_reset(&arena);
+	if (arena_avail(&arena) != ARENA_SIZE)
+		fail("%zu bytes available after reset, not %d",
+		     arena_avail(&arena), ARENA_SIZE);
+
+	pthread_barrier_destroy(&phase);
+	free(chunks);
+	free(mem);
+}
+
+/* The bounds passed to simple_alloc_init() and valloc_init() are
+ * exact: the last byte can be allocated, and a zero-sized region
+ * holds only zero-sized allocations.
+ *
+ * Each simple_alloc_init() takes a new per-cpu slot for the heap, so
+ * this uses the last three, after run_threads() took the first.
+ */
+static void test_bounds(void)
+{
+	static uint8_t buf[2 * ARENA_CPU_CHUNK] __attribute__((aligned(64)));
+	uint8_t *p;
+
+	/* Small allocations go through a per-cpu region, which is
+	 * carved from the heap when it has room for one.
+	 */
+	simple_alloc_init(buf, sizeof(buf));
+	p = simple_alloc(8, 8);
+	if (p != buf || simple_alloc(8, 8) != buf + 8)
+		fail("heap at %p: first allocation at %p", buf, p);
+	if (simple_alloc(ARENA_CPU_CHUNK, 1) != buf + ARENA_CPU_CHUNK)
+		fail("large allocation not after the per-cpu region");
+	if (simple_alloc(1, 1) != buf + 16)
+		fail("small allocation not from the per-cpu region");
+
+	simple_alloc_init(buf, 100);
+	if (simple_alloc(100, 1) != buf)
+		fail("100 bytes from a 100-byte heap failed");
+	if (simple_alloc(1, 1) || simple_alloc(0, 64))
+		fail("allocated past the end of a 100-byte heap");
+
+	simple_alloc_init(buf, 0);
+	if (simple_alloc(0, 1) != buf)
+		fail("zero bytes from an empty heap failed");
+	if (simple_alloc(1, 1))
+		fail("one byte from an empty heap");
+
+	valloc_init(0x10000, 0x14000);
+	if (valloc(0x1000, 0x1000) != (void *)0x10000 ||
+	    valloc(0x3000, 0x1000) != (void *)0x11000 ||
+	    valloc(1, 1))
+		fail("valloc of [0x10000, 0x14000) not exact");
+}
+
+/* arena_alloc() is declared malloc-like, so gcc takes its results to
+ * differ from any existing pointer; compare addresses instead.
+ */
+static __attribute__((noinline))
+unsigned long alloc_addr(arena_t *a, size_t size, size_t align)
+{
+	return (unsigned long)arena_alloc(a, size, align);
+}
+
+/* Arenas beyond the per-cpu slots allocate from the shared top. */
+static void test_slots(void)
+{
+	static uint8_t buf[ARENA_CPU_SLOTS + 2][256] __attribute__((aligned(8)));
+	arena_t a[ARENA_CPU_SLOTS + 2];
+	unsigned long base;
+	int i;
+
+	for (i = 0; i < ARENA_CPU_SLOTS + 2; i++) {
+		base = (unsigned long)buf[i];
+		arena_init(&a[i], base, base + sizeof(buf[i]));
+
+		if (alloc_addr(&a[i], 16, 8) != base ||
+		    alloc_addr(&a[i], 16, 8) != base + 16 ||
+		    alloc_addr(&a[i], 256 - 32, 1) != base + 32 ||
+		    alloc_addr(&a[i], 1, 1))
+			fail("arena %d of %d", i, ARENA_CPU_SLOTS + 2);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t start;
+
+	if (argc > 1)
+		nthreads = atoi(argv[1]);
+	if (argc > 2)
+		count = strtoul(argv[2], NULL, 0);
+
+	/* The main thread is the last cpu. */
+	if (nthreads < 1 || nthreads >= HOST_MAX_CPUS || count < 1 ||
+	    2 * nthreads * count * MAX_ALIGN > ARENA_SIZE) {
+		fprintf(stderr, "usage: %s [threads [allocations]]\n", argv[0]);
+		return 2;
+	}
+
+	host_cpu_init(nthreads);
+	start = host_time_ns();
+
+	run_threads();
+	test_bounds();
+	test_slots();
+
+	if (failed)
+		return 1;
+
+	printf("%d threads: %lu allocations in %.2f s\n", nthreads,
+	       nthreads * count * 3, (host_time_ns() - start) / 1e9);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Stress test for the console fan-in (CONFIG_LIBOS_CONSOLE_FANIN).
+ *
+ * Threads print numbered lines with libos's printf() and puts().  Short
+ * lines go through the lockless fan-in, lines longer than
+ * CONSOLE_FANIN_MSG take console_lock, and puts() always does.  The
+ * console is a queue big enough for the whole run, so nothing is
+ * dropped.  Every line must come out whole, CR/LF expanded, exactly
+ * once, and in order relative to the other lines from its thread.
+ *
+ * usage: console-fanin [threads [lines per thread]]
+ *
+ * Interleaving bugs only show if the threads really run in parallel,
+ * so run it on a host with several cpus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libos/console.h>
+#include <libos/queue.h>
+
+#include "host.h"
+#include "libos-libc.h"
+
+#define MAX_LINE 600
+
+static queue_t sink;
+static int threads = 4;
+static unsigned int lines = 5000;
+
+/* Length of the filler for a line, from the line's own numbers, so
+ * that the checker can recompute it.
+ */
+static unsigned int filler_len(unsigned int thread, unsigned int seq)
+{
+	uint32_t x = (thread + 1) * 0x9e3779b9 ^ seq * 0x85ebca6b;
+
+	x ^= x >> 15;
+
+	/* Mostly short lines, with some past CONSOLE_FANIN_MSG. */
+	if (x % 8 == 0)
+		return CONSOLE_FANIN_MSG + x % (MAX_LINE - CONSOLE_FANIN_MSG - 32);
+
+	return x % 64;
+}
+
+static void *printer(void *arg)
+{
+	unsigned int thread = (uintptr_t)arg;
+	char filler[MAX_LINE];
+	unsigned int seq;
+
+	host_cpu_init(thread + 1);
+
+	for (seq = 0; seq < lines; seq++) {
+		unsigned int len = filler_len(thread, seq);
+		char line[MAX_LINE + 32];
+
+		memset(filler, 'a' + (seq + thread) % 26, len);
+		filler[len] = 0;
+
+		if (seq % 16 == 15) {
+			snprintf(line, sizeof(line), "T%u %u %s", thread, seq, filler);
+			libos_puts(line);
+		} else {
+			libos_printf("T%u %u %s\n", thread, seq, filler);
+		}
+	}
+
+	return NULL;
+}
+
+static int check_line(const char *line, size_t len, unsigned int *next)
+{
+	unsigned int thread, seq, flen, i;
+	int pos;
+
+	if (sscanf(line, "T%u %u %n", &thread, &seq, &pos) != 2 ||
+	    thread >= (unsigned int)threads) {
+		fprintf(stderr, "FAIL: garbled line: %.*s\n", (int)len, line);
+		return -1;
+	}
+
+	if (seq != next[thread]) {
+		fprintf(stderr, "FAIL: thread %u line %u, expected %u\n",
+		        thread, seq, next[thread]);
+		return -1;
+	}
+
+	flen = filler_len(thread, seq);
+	if (len != pos + flen + 2 || line[len - 2] != '\r') {
+		fprintf(stderr, "FAIL: thread %u line %u: bad length %zu\n",
+		        thread, seq, len);
+		return -1;
+	}
+
+	for (i = 0; i < flen; i++) {
+		if (line[pos + i] != 'a' + (seq + thread) % 26) {
+			fprintf(stderr, "FAIL: thread %u line %u: bad filler\n",
+			        thread, seq);
+			return -1;
+		}
+	}
+
+	next[thread]++;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t tids[HOST_MAX_CPUS];
+	unsigned int *next;
+	size_t size = 1, len, total = 0;
+	char *out, *line, *end;
+	int i;
+
+	if (argc > 1)
+		threads = atoi(argv[1]);
+	if (argc > 2)
+		lines = strtoul(argv[2], NULL, 0);
+
+	if (threads < 1 || threads >= HOST_MAX_CPUS) {
+		fprintf(stderr, "thread count must be 1 to %d\n",
+		        HOST_MAX_CPUS - 1);
+		return 1;
+	}
+
+	while (size < (size_t)threads * lines * (MAX_LINE / 4) + 4096)
+		size <<= 1;
+
+	if (queue_init(&sink, size)) {
+		fprintf(stderr, "queue_init failed\n");
+		return 1;
+	}
+
+	host_cpu_init(0);
+	qconsole_init(&sink);
+
+	for (i = 0; i < threads; i++)
+		pthread_create(&tids[i], NULL, printer, (void *)(uintptr_t)i);
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+
+	/* Whatever is still in consolebuf comes after the sink. */
+	out = malloc(size + consolebuf.size);
+	next = calloc(threads, sizeof(*next));
+	if (!out || !next) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	while ((len = queue_read(&sink, (uint8_t *)out + total, size, 0)) > 0)
+		total += len;
+	while ((len = queue_read(&consolebuf, (uint8_t *)out + total,
+	                         consolebuf.size, 0)) > 0)
+		total += len;
+
+	for (line = out; line < out + total; line = end + 1) {
+		end = memchr(line, '\n', out + total - line);
+		if (!end) {
+			fprintf(stderr, "FAIL: unterminated output\n");
+			return 1;
+		}
+
+		if (check_line(line, end + 1 - line, next))
+			return 1;
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (next[i] != lines) {
+			fprintf(stderr, "FAIL: thread %d: %u of %u lines\n",
+			        i, next[i], lines);
+			return 1;
+		}
+	}
+
+	printf("%d threads, %u lines each, in order and intact\n",
+	       threads, lines);
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Check libos_bind_driver()'s compatible index against a linear walk.
+ *
+ * A set of drivers with overlapping compatible lists is linked into
+ * .libos.drivers, as a client would, and random devices are bound.
+ * The probes must be called in the order that walking every driver
+ * with match_compat() would call them, with the same compatible
+ * entries, and binding must end the same way.  Some strings are
+ * shared by more drivers than the index returns for one device, so
+ * the fallback to the walk is taken as well.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <libos/libos.h>
+#include <libos/errors.h>
+
+#include "host.h"
+
+extern driver_t driver_begin, driver_end;
+
+#define MAX_PROBES 64
+
+static struct probe {
+	int drv;
+	const dev_compat_t *compat;
+} probes[MAX_PROBES];
+
+static int num_probes;
+
+/* What each driver's probe returns for the current device */
+static int results[64];
+
+static int probe(device_t *dev, const dev_compat_t *compat_id)
+{
+	int drv = dev->driver - &driver_begin;
+
+	if (num_probes < MAX_PROBES) {
+		probes[num_probes].drv = drv;
+		probes[num_probes].compat = compat_id;
+	}
+
+	num_probes++;
+	return results[drv];
+}
+
+#define DRIVER(name, ...) \
+	static const dev_compat_t name##_compat[] = { \
+		__VA_ARGS__, {} \
+	}; \
+	static driver_t name __driver = { name##_compat, probe }
+
+DRIVER(uart0, { "ns16550" }, { "fsl,ns16550" });
+DRIVER(uart1, { "fsl,ns16550" }, { "ns16550a" }, { "ns16550" });
+DRIVER(mpic, { "chrp,open-pic" }, { "fsl,mpic" });
+DRIVER(pamu, { "fsl,pamu" }, { "fsl,p4080-pamu" }, { "fsl,pamu-v1.0" });
+DRIVER(bc, { "epapr,hv-byte-channel" });
+DRIVER(bc2, { "epapr,hv-byte-channel" }, { "fsl,hv-byte-channel" });
+DRIVER(gpio, { "fsl,mpc8572-gpio" }, { "fsl,qoriq-gpio" });
+DRIVER(i2c, { "fsl-i2c" }, { "fsl,mpc8544-i2c" });
+DRIVER(dup, { "dup" }, { "dup" }, { "fsl,qoriq-gpio" });
+DRIVER(empty, { "" });
+
+/* More drivers claiming "generic" than the index allows candidates */
+DRIVER(g0, { "generic" }, { "g0" });
+DRIVER(g1, { "g1" }, { "generic" });
+DRIVER(g2, { "generic" });
+DRIVER(g3, { "generic" }, { "ns16550" });
+DRIVER(g4, { "generic" });
+DRIVER(g5, { "generic" });
+DRIVER(g6, { "generic" });
+DRIVER(g7, { "generic" });
+DRIVER(g8, { "generic" });
+DRIVER(g9, { "generic" });
+DRIVER(g10, { "generic" });
+DRIVER(g11, { "generic" });
+DRIVER(g12, { "generic" });
+DRIVER(g13, { "generic" });
+DRIVER(g14, { "generic" });
+DRIVER(g15, { "generic" });
+DRIVER(g16, { "generic" }, { "g16" });
+
+static const char *const names[] = {
+	"ns16550", "fsl,ns16550", "ns16550a", "chrp,open-pic", "fsl,mpic",
+	"fsl,pamu", "fsl,p4080-pamu", "fsl,pamu-v1.0",
+	"epapr,hv-byte-channel", "fsl,hv-byte-channel", "fsl,mpc8572-gpio",
+	"fsl,qoriq-gpio", "fsl-i2c", "fsl,mpc8544-i2c", "dup", "",
+	"generic", "g0", "g1", "g16", "unknown", "ns1655", "ns16550b",
+};
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+/* xorshift64*, so that a seed gives the same cases on any host */
+static uint64_t rng_state = 1;
+
+static unsigned int rnd(unsigned int n)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 0x2545f4914f6cdd1dULL >> 32) % n;
+}
+
+/* The linear walk that the index replaces */
+static int walk_bind(device_t *dev, const char *strlist, size_t len)
+{
+	for (driver_t *drv = &driver_begin; drv < &driver_end; drv++) {
+		const dev_compat_t *compat = NULL;
+		size_t pos = 0;
+		int ret;
+
+		while (!compat && pos < len) {
+			const char *str = strlist + pos;
+
+			for (int i = 0; drv->compatibles[i].compatible; i++) {
+				if (!strcmp(str, drv->compatibles[i].compatible)) {
+					compat = &drv->compatibles[i];
+					break;
+				}
+			}
+
+			pos += strlen(str) + 1;
+		}
+
+		if (!compat)
+			continue;
+
+		/* A device is left bound only if its probe succeeds. */
+		dev->driver = drv;
+		ret = probe(dev, compat);
+		if (ret)
+			dev->driver = NULL;
+
+		if (ret != ERR_UNHANDLED)
+			return ret;
+	}
+
+	return ERR_UNHANDLED;
+}
+
+int main(void)
+{
+	int num_drivers = &driver_end - &driver_begin;
+	unsigned long failures = 0;
+	int cases = 100000;
+
+	host_cpu_init(0);
+
+	if (num_drivers != 27) {
+		printf("FAIL: %d drivers in .libos.drivers, expected 27\n",
+		       num_drivers);
+		return 1;
+	}
+
+	for (int n = 0; n < cases; n++) {
+		struct probe expect[MAX_PROBES];
+		int expect_num, expect_ret, ret;
+		driver_t *expect_drv;
+		char strlist[256];
+		device_t dev = {};
+		size_t len = 0;
+
+		for (int i = rnd(5); i > 0; i--) {
+			const char *name = names[rnd(NUM_NAMES)];
+
+			strcpy(strlist + len, name);
+			len += strlen(name) + 1;
+		}
+
+		/* Mostly decline, so that several probes are tried. */
+		for (int i = 0; i < num_drivers; i++) {
+			switch (rnd(8)) {
+			case 0:
+				results[i] = 0;
+				break;
+			case 1:
+				results[i] = ERR_NOMEM;
+				break;
+			default:
+				results[i] = ERR_UNHANDLED;
+				break;
+			}
+		}
+
+		num_probes = 0;
+		expect_ret = walk_bind(&dev, strlist, len);
+		expect_drv = dev.driver;
+		expect_num = num_probes;
+		memcpy(expect, probes, sizeof(probes));
+
+		dev.driver = NULL;
+		num_probes = 0;
+		ret = libos_bind_driver(&dev, strlist, len);
+
+		if (ret != expect_ret || dev.driver != expect_drv ||
+		    num_probes != expect_num ||
+		    memcmp(probes, expect, sizeof(probes[0]) *
+		           (num_probes < MAX_PROBES ? num_probes : MAX_PROBES))) {
+			if (failures++ < 10) {
+				printf("FAIL: case %d: returned %d after %d probes, "
+				       "expected %d after %d\n",
+				       n, ret, num_probes, expect_ret, expect_num);
+			}
+		}
+	}
+
+	if (failures) {
+		printf("%lu failures\n", failures);
+		return 1;
+	}
+
+	printf("%d bindings match the linear walk\n", cases);
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Included ahead of everything built by this directory, in place of
+ * a client's libos-client.h and autoconf.h.  Per-test options are
+ * passed with -D in the Makefile, and must be the same for the libos
+ * objects and the test program that uses them.
+ */
+
+#define CONFIG_LIBOS_MAX_BUILD_LOGLEVEL 15
+#define CONFIG_LIBOS_DEFAULT_LOGLEVEL 4
+#define CONFIG_LIBOS_MAX_CPUS 64
+#define CONFIG_LIBOS_MAX_HW_THREADS 2
+
+/* The target compiler defines _BIG_ENDIAN; the host's may not. */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define _BIG_ENDIAN 1
+#else
+#define _LITTLE_ENDIAN 1
+#endif
+
+#define PHYSBASE 0
+#define KSTACK_SIZE 4096
+
+#ifndef _ASM
+typedef int client_cpu_t;
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-cpu state and SPR emulation, built with the libos headers. */
+
+#include <libos/libos.h>
+#include <libos/percpu.h>
+#include <libos/printlog.h>
+
+#include "host.h"
+
+__thread cpu_t *cpu;
+static cpu_t host_cpus[HOST_MAX_CPUS];
+
+uint8_t loglevels[NUM_LOGTYPES] = {
+	[0 ... NUM_LOGTYPES - 1] = CONFIG_LIBOS_DEFAULT_LOGLEVEL
+};
+
+unsigned long physbase_phys;
+
+void host_cpu_init(int pir)
+{
+	assert(pir >= 0 && pir < HOST_MAX_CPUS);
+
+	cpu = &host_cpus[pir];
+	cpu->coreid = pir;
+	cpu->console_ok = 1;
+}
+
+register_t host_mfspr(int reg)
+{
+	switch (reg) {
+	case SPR_PIR:
+		return cpu ? cpu->coreid : 0;
+
+	case SPR_TBL:
+		return (uint32_t)host_time_ns();
+
+	case SPR_TBU:
+		return host_time_ns() >> 32;
+	}
+
+	BUG();
+}
+
+#ifdef CONFIG_LIBOS_CONSOLE
+/* Tests that link console.c get its set_crashing() instead. */
+__attribute__((weak)) void set_crashing(int crashing)
+{
+	if (cpu)
+		cpu->crashing = crashing;
+}
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host replacement for libos/bitops.h, used by the tests in this
+ * directory.  The atomics have the same semantics as the lwarx/stwcx.
+ * versions: no implied barrier beyond the one the libos versions have.
+ */
+
+#ifndef LIBOS_BITOPS_H
+#define LIBOS_BITOPS_H
+
+#include <libos/libos.h>
+#include <libos/core-regs.h>
+#include <libos/io.h>
+
+static inline int compare_and_swap(unsigned long *ptr,
+                                   unsigned long old,
+                                   unsigned long new)
+{
+	return __atomic_compare_exchange_n(ptr, &old, new, 0,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline int compare_and_swap32(uint32_t *ptr, uint32_t old, uint32_t new)
+{
+	return __atomic_compare_exchange_n(ptr, &old, new, 0,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline int spin_lock_held(uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED) ==
+	       mfspr_nonvolatile(SPR_PIR) + 1;
+}
+
+static inline int raw_spin_trylock(uint32_t *ptr)
+{
+	uint32_t old = 0;
+
+	return __atomic_compare_exchange_n(ptr, &old,
+	                                   mfspr_nonvolatile(SPR_PIR) + 1, 0,
+	                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void raw_spin_lock(uint32_t *ptr)
+{
+	while (!raw_spin_trylock(ptr))
+		while (__atomic_load_n(ptr, __ATOMIC_RELAXED))
+			;
+}
+
+static inline void spin_lock(uint32_t *ptr)
+{
+	assert(!spin_lock_held(ptr));
+	raw_spin_lock(ptr);
+}
+
+static inline int spin_trylock(uint32_t *ptr)
+{
+	return raw_spin_trylock(ptr);
+}
+
+static inline void spin_unlock(uint32_t *ptr)
+{
+	assert(spin_lock_held(ptr));
+	__atomic_store_n(ptr, 0, __ATOMIC_RELEASE);
+}
+
+#define DEF_SPIN_SAVE(suffix, disable, restore) \
+static inline register_t spin_lock_##suffix(uint32_t *ptr) \
+{ \
+	register_t ret = disable(); \
+	spin_lock(ptr); \
+	return ret; \
+} \
+\
+static inline void spin_unlock_##suffix(uint32_t *ptr, register_t saved) \
+{ \
+	spin_unlock(ptr); \
+	restore(saved); \
+}
+
+DEF_SPIN_SAVE(intsave, disable_int_save, restore_int)
+DEF_SPIN_SAVE(critsave, disable_critint_save, restore_critint)
+DEF_SPIN_SAVE(mchksave, disable_mchk_save, restore_mchk)
+
+static inline void spin_lock_int(uint32_t *ptr)
+{
+	spin_lock(ptr);
+}
+
+static inline void spin_unlock_int(uint32_t *ptr)
+{
+	spin_unlock(ptr);
+}
+
+static inline unsigned long atomic_or(unsigned long *ptr, unsigned long val)
+{
+	return __atomic_or_fetch(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline unsigned long atomic_and(unsigned long *ptr, unsigned long val)
+{
+	return __atomic_and_fetch(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline unsigned long atomic_add(unsigned long *ptr, long val)
+{
+	return __atomic_add_fetch(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline int count_msb_zeroes(unsigned long val)
+{
+	return __builtin_clzl(val);
+}
+
+static inline int count_lsb_zeroes(unsigned long val)
+{
+	return __builtin_ctzl(val);
+}
+
+static inline int ilog2(unsigned long val)
+{
+	return LONG_BITS - 1 - count_msb_zeroes(val);
+}
+
+static inline int ilog2_roundup(unsigned long val)
+{
+	return LONG_BITS - count_msb_zeroes(val - 1);
+}
+
+static inline int count_msb_zeroes_32(uint32_t val)
+{
+	return __builtin_clz(val);
+}
+
+static inline int count_lsb_zeroes_32(uint32_t val)
+{
+	return __builtin_ctz(val);
+}
+
+static inline int ilog2_32(uint32_t val)
+{
+	return 31 - count_msb_zeroes_32(val);
+}
+
+static inline int ilog2_roundup_32(unsigned long val)
+{
+	return 32 - count_msb_zeroes_32(val - 1);
+}
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host replacement for libos/io.h, used by the tests in this directory.
+ * Barriers map to compiler atomics, SPR reads are emulated by host.c,
+ * and interrupt masking is a no-op: interrupts are never "enabled".
+ */
+
+#ifndef LIBOS_IO_H
+#define LIBOS_IO_H
+
+#include <libos/types.h>
+#include <libos/core-regs.h>
+
+register_t host_mfspr(int reg);
+
+static inline register_t mfspr(int reg)
+{
+	return host_mfspr(reg);
+}
+
+static inline register_t mfspr_nonvolatile(int reg)
+{
+	return host_mfspr(reg);
+}
+
+static inline void mtspr(int reg, register_t val)
+{
+}
+
+static inline register_t mfmsr(void)
+{
+	return 0;
+}
+
+static inline void mtmsr(register_t val)
+{
+}
+
+static inline void barrier(void)
+{
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void isync(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void sync(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* lwsync orders everything but store-load, as acq_rel does. */
+static inline void lwsync(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQ_REL);
+}
+
+static inline void smp_mbar(void)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void smp_lwsync(void)
+{
+	lwsync();
+}
+
+static inline void smp_sync(void)
+{
+	sync();
+}
+
+static inline register_t disable_int_save(void)
+{
+	return 0;
+}
+
+static inline void restore_int(register_t saved)
+{
+}
+
+static inline register_t disable_critint_save(void)
+{
+	return 0;
+}
+
+static inline void restore_critint(register_t saved)
+{
+}
+
+static inline register_t disable_mchk_save(void)
+{
+	return 0;
+}
+
+static inline void restore_mchk(register_t saved)
+{
+}
+
+static inline void disable_int(void)
+{
+}
+
+static inline void enable_int(void)
+{
+}
+
+static inline int ints_enabled(void)
+{
+	return 0;
+}
+
+#define disable_extint disable_int
+#define enable_extint enable_int
+
+/* The raw accessors are compiler barriers, as the asm versions are
+ * with their "memory" clobbers, but imply no ordering between cpus.
+ */
+#define IO_DEF_IN(name, type) \
+static inline type raw_##name(const type *ptr) \
+{ \
+	type ret; \
+	barrier(); \
+	ret = __atomic_load_n(ptr, __ATOMIC_RELAXED); \
+	barrier(); \
+	return ret; \
+} \
+\
+static inline type name(const type *ptr) \
+{ \
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST); \
+}
+
+#define IO_DEF_OUT(name, type) \
+static inline void raw_##name(type *ptr, type val) \
+{ \
+	barrier(); \
+	__atomic_store_n(ptr, val, __ATOMIC_RELAXED); \
+	barrier(); \
+} \
+\
+static inline void name(type *ptr, type val) \
+{ \
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST); \
+}
+
+IO_DEF_IN(in8, uint8_t)
+IO_DEF_IN(in16, uint16_t)
+IO_DEF_IN(in32, uint32_t)
+IO_DEF_OUT(out8, uint8_t)
+IO_DEF_OUT(out16, uint16_t)
+IO_DEF_OUT(out32, uint32_t)
+
+static inline void prefetch(void *ptr)
+{
+	__builtin_prefetch(ptr, 0);
+}
+
+static inline void prefetch_store(void *ptr)
+{
+	__builtin_prefetch(ptr, 1);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* libos's libc routines, as renamed for linking into host programs
+ * next to the host libc.  See the libc rule in the Makefile.
+ */
+
+#ifndef TEST_LIBOS_LIBC_H
+#define TEST_LIBOS_LIBC_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void *libos_memcpy(void *dest, const void *src, size_t len);
+void *libos_memmove(void *dest, const void *src, size_t len);
+void *libos_memchr(const void *s, int c, size_t len);
+int libos_memcmp(const void *b1, const void *b2, size_t len);
+size_t libos_strlen(const char *s);
+size_t libos_strnlen(const char *s, size_t n);
+int libos_strcmp(const char *s1, const char *s2);
+int libos_strncmp(const char *s1, const char *s2, size_t n);
+
+int libos_sprintf(char *buf, const char *str, ...);
+int libos_snprintf(char *buf, size_t size, const char *str, ...);
+int libos_vsnprintf(char *buf, size_t size, const char *str, va_list args);
+int libos_printf_save_args(const char *str, va_list args, uint64_t *argv,
+                           int max, uint32_t *strmask);
+int libos_vsnprintf_argv(char *buf, size_t size, const char *str,
+                         const uint64_t *argv, const char *strbase);
+
+int libos_printf(const char *str, ...);
+int libos_puts(const char *s);
+
+/* As in include-libc/string.h */
+#define PRINTF_NULL_STR (~0ULL)
+
+#endif
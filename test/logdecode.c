@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Decode a dump of a per-cpu log buffer on the host.
+ *
+ * The dump is the raw contents of a logbuf_t's buf[], and the image is
+ * the ELF file of the program that logged it, which the format strings
+ * of binary records are read from.  The dump is taken to have the
+ * image's byte order.  Records are printed from the given start offset,
+ * which is the logbuf's head modulo the buffer size, up to the first
+ * one that isn't ready.
+ *
+ * printf_save_args() widens every argument to 64 bits, signed or not
+ * as its conversion is, so a 64-bit host formats the arguments of a
+ * 32-bit target the same way the target would.
+ *
+ * usage: logdecode [-s start] image dump
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <elf.h>
+
+#include <libos/logbuf.h>
+
+#include "libos-libc.h"
+
+static int big_endian;
+
+static uint64_t get(const void *ptr, int size)
+{
+	const uint8_t *p = ptr;
+	uint64_t val = 0;
+
+	for (int i = 0; i < size; i++) {
+		int byte = big_endian ? i : size - 1 - i;
+
+		val = val << 8 | p[byte];
+	}
+
+	return val;
+}
+
+/* Read a field of an ELF structure of either class. */
+#define GET(elf64, ptr, type, field) \
+	((elf64) ? get((const uint8_t *)(ptr) + offsetof(Elf64_##type, field), \
+	               sizeof(((Elf64_##type *)0)->field)) : \
+	           get((const uint8_t *)(ptr) + offsetof(Elf32_##type, field), \
+	               sizeof(((Elf32_##type *)0)->field)))
+
+static uint8_t *read_file(const char *name, size_t *size)
+{
+	FILE *f = fopen(name, "rb");
+	uint8_t *data = NULL;
+	size_t len = 0, alloc = 0;
+
+	if (!f) {
+		perror(name);
+		return NULL;
+	}
+
+	while (!feof(f)) {
+		alloc = alloc ? alloc * 2 : 65536;
+		data = realloc(data, alloc + 1);
+		if (!data) {
+			fprintf(stderr, "%s: out of memory\n", name);
+			fclose(f);
+			return NULL;
+		}
+
+		len += fread(data + len, 1, alloc - len, f);
+
+		if (ferror(f)) {
+			perror(name);
+			fclose(f);
+			free(data);
+			return NULL;
+		}
+	}
+
+	fclose(f);
+
+	/* A string at the very end of the image is still terminated. */
+	data[len] = 0;
+	*size = len;
+	return data;
+}
+
+static const uint8_t *image;
+static size_t image_size;
+static int elf64;
+
+/* The strings of the current binary record, NUL-terminated */
+static char *strbuf;
+
+static int check_image(const char *name)
+{
+	if (image_size < EI_NIDENT || memcmp(image, ELFMAG, SELFMAG) ||
+	    (image[EI_CLASS] != ELFCLASS32 && image[EI_CLASS] != ELFCLASS64) ||
+	    (image[EI_DATA] != ELFDATA2LSB && image[EI_DATA] != ELFDATA2MSB)) {
+		fprintf(stderr, "%s: not an ELF file\n", name);
+		return -1;
+	}
+
+	elf64 = image[EI_CLASS] == ELFCLASS64;
+	big_endian = image[EI_DATA] == ELFDATA2MSB;
+
+	if (image_size < (elf64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr))) {
+		fprintf(stderr, "%s: truncated ELF header\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Find the string at a virtual address in a loadable segment. */
+static const char *image_string(uint64_t addr)
+{
+	uint64_t phoff = GET(elf64, image, Ehdr, e_phoff);
+	unsigned int phentsize = GET(elf64, image, Ehdr, e_phentsize);
+	unsigned int phnum = GET(elf64, image, Ehdr, e_phnum);
+
+	for (unsigned int i = 0; i < phnum; i++) {
+		const uint8_t *ph = image + phoff + i * phentsize;
+		uint64_t vaddr, offset, filesz;
+
+		if (phoff + (i + 1) * phentsize > image_size)
+			break;
+
+		if (GET(elf64, ph, Phdr, p_type) != PT_LOAD)
+			continue;
+
+		vaddr = GET(elf64, ph, Phdr, p_vaddr);
+		offset = GET(elf64, ph, Phdr, p_offset);
+		filesz = GET(elf64, ph, Phdr, p_filesz);
+
+		if (addr >= vaddr && addr - vaddr < filesz &&
+		    offset + filesz <= image_size)
+			return (const char *)image + offset + (addr - vaddr);
+	}
+
+	return NULL;
+}
+
+static void print_binary(const uint8_t *rec, uint32_t size,
+                         unsigned int argc, uint64_t tb)
+{
+	uint64_t argv[LOGREC_MAX_ARGS];
+	const uint8_t *words = rec + sizeof(logrec_t);
+	size_t strsize = size - sizeof(logrec_t) - (argc + 1) * 8;
+	char text[1024];
+	uint64_t fmt_addr = get(words, 8);
+	const char *fmt = image_string(fmt_addr);
+
+	if (!fmt) {
+		printf("[%llu] <format string at 0x%llx not in image>\n",
+		       (unsigned long long)tb, (unsigned long long)fmt_addr);
+		return;
+	}
+
+	for (unsigned int i = 0; i < argc; i++)
+		argv[i] = get(words + (i + 1) * 8, 8);
+
+	/* Terminate the last string even if the record is corrupt. */
+	memcpy(strbuf, words + (argc + 1) * 8, strsize);
+	strbuf[strsize] = 0;
+
+	libos_vsnprintf_argv(text, sizeof(text), fmt, argv, strbuf);
+	printf("[%llu] %s", (unsigned long long)tb, text);
+}
+
+static int decode(const uint8_t *buf, size_t bufsize, size_t start)
+{
+	size_t off = start;
+
+	do {
+		const uint8_t *rec = buf + off;
+		uint32_t info, size;
+		unsigned int len;
+		uint64_t tb;
+
+		info = get(rec + offsetof(logrec_t, info), 4);
+		if (!(info & LOGREC_READY))
+			return 0;
+
+		size = info & LOGREC_SIZE;
+		if (size < 4 || size % LOGREC_ALIGN || size > bufsize - off) {
+			fprintf(stderr, "bad record size %u at offset %zu\n",
+			        size, off);
+			return -1;
+		}
+
+		if (info & LOGREC_PAD)
+			goto next;
+
+		if (size < sizeof(logrec_t)) {
+			fprintf(stderr, "short record at offset %zu\n", off);
+			return -1;
+		}
+
+		len = get(rec + offsetof(logrec_t, len), 2);
+		tb = get(rec + offsetof(logrec_t, tb), 8);
+
+		if (!(info & LOGREC_BINARY)) {
+			if (len > size - sizeof(logrec_t)) {
+				fprintf(stderr, "bad text length %u at offset %zu\n",
+				        len, off);
+				return -1;
+			}
+
+			printf("[%llu] %.*s", (unsigned long long)tb, (int)len,
+			       (const char *)rec + sizeof(logrec_t));
+			goto next;
+		}
+
+		if (len > LOGREC_MAX_ARGS ||
+		    sizeof(logrec_t) + (len + 1) * 8 > size) {
+			fprintf(stderr, "bad argument count %u at offset %zu\n",
+			        len, off);
+			return -1;
+		}
+
+		print_binary(rec, size, len, tb);
+
+next:
+		off += size;
+		if (off == bufsize)
+			off = 0;
+	} while (off != start);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long start = 0;
+	uint8_t *dump;
+	size_t dump_size;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			start = strtoul(optarg, NULL, 0);
+			break;
+
+		default:
+			goto usage;
+		}
+	}
+
+	if (argc - optind != 2)
+		goto usage;
+
+	image = read_file(argv[optind], &image_size);
+	if (!image || check_image(argv[optind]))
+		return 1;
+
+	dump = read_file(argv[optind + 1], &dump_size);
+	if (!dump)
+		return 1;
+
+	if (dump_size == 0 || (dump_size & (dump_size - 1)) ||
+	    start >= dump_size || start % LOGREC_ALIGN) {
+		fprintf(stderr, "%s: size must be a power of two, and the "
+		        "start offset an aligned offset within it\n",
+		        argv[optind + 1]);
+		return 1;
+	}
+
+	strbuf = malloc(dump_size + 1);
+	if (!strbuf) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	return decode(dump, dump_size, start) ? 1 : 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s start] image dump\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Multithreaded benchmark of libos malloc()/free().
+ *
+ * Built as malloc-bench and malloc-bench-cache, the latter with
+ * CONFIG_LIBOS_MALLOC_CPU_CACHE.  Each thread has its own cpu_t and
+ * repeatedly allocates a batch of small blocks and frees them again,
+ * so with the cache most operations should stay off the mspace lock.
+ * Contention only shows where the threads get separate cores; on a
+ * single cpu this mostly measures the fast path.
+ *
+ * usage: malloc-bench [max threads [batches per thread]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "host.h"
+#include "malloc-bench.h"
+
+#define HEAP_SIZE (64 << 20)
+#define BATCH     32
+#define MIN_SIZE  16
+#define MAX_SIZE  256
+
+static unsigned long batches;
+
+static void *worker(void *arg)
+{
+	void *ptrs[BATCH];
+	uint64_t rng_state = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+	unsigned long i;
+	int j;
+
+	host_cpu_init((uintptr_t)arg);
+
+	for (i = 0; i < batches; i++) {
+		for (j = 0; j < BATCH; j++) {
+			size_t size;
+
+			rng_state ^= rng_state >> 12;
+			rng_state ^= rng_state << 25;
+			rng_state ^= rng_state >> 27;
+			size = MIN_SIZE + (rng_state * 0x2545f4914f6cdd1dULL >> 32) %
+			       (MAX_SIZE - MIN_SIZE + 1);
+
+			ptrs[j] = bench_malloc(size);
+			if (!ptrs[j]) {
+				fprintf(stderr, "FAIL: out of memory\n");
+				exit(1);
+			}
+
+			*(char *)ptrs[j] = j;
+		}
+
+		/* Free in the opposite order, as a caller unwinding would. */
+		for (j = BATCH - 1; j >= 0; j--) {
+			if (*(char *)ptrs[j] != j) {
+				fprintf(stderr, "FAIL: block %d overwritten\n", j);
+				exit(1);
+			}
+
+			bench_free(ptrs[j]);
+		}
+	}
+
+	return NULL;
+}
+
+static void run(int nthreads)
+{
+	pthread_t threads[HOST_MAX_CPUS];
+	uint64_t start, ns, ops;
+	int i;
+
+	start = host_time_ns();
+
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, worker, (void *)(uintptr_t)i);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	ns = host_time_ns() - start;
+	ops = 2ULL * BATCH * batches * nthreads;
+	printf("%2d thread%s %10.2f Mops/s  %6.1f ns/op\n", nthreads,
+	       nthreads == 1 ? " " : "s", ops * 1e3 / ns, (double)ns / ops);
+}
+
+int main(int argc, char *argv[])
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int max = argc > 1 ? atoi(argv[1]) : ncpus < 2 ? 2 : ncpus;
+	void *heap;
+	int i;
+
+	batches = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+
+	if (max < 1 || max > HOST_MAX_CPUS) {
+		fprintf(stderr, "thread count must be 1 to %d\n", HOST_MAX_CPUS);
+		return 1;
+	}
+
+	heap = malloc(HEAP_SIZE);
+	if (!heap || bench_heap_init(heap, HEAP_SIZE)) {
+		fprintf(stderr, "heap setup failed\n");
+		return 1;
+	}
+
+#ifdef CONFIG_LIBOS_MALLOC_CPU_CACHE
+	printf("per-cpu cache, %ld cpus online\n", ncpus);
+#else
+	printf("bare mspace, %ld cpus online\n", ncpus);
+#endif
+
+	for (i = 1; i <= max; i *= 2)
+		run(i);
+	if (max & (max - 1))
+		run(max);
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The libos side of malloc-segments.  The segment table is static, so
+ * this includes malloc-wrapper.c rather than linking against it.
+ */
+
+#include "../lib/malloc-wrapper.c"
+
+#include "malloc-segments.h"
+
+int seg_add(uintptr_t start, uintptr_t end, int node)
+{
+	return malloc_add_segment_node((void *)start, (void *)end, node);
+}
+
+int seg_exclude(uintptr_t start, uintptr_t end)
+{
+	return malloc_exclude_segment((void *)start, (void *)end);
+}
+
+uintptr_t seg_alloc(size_t size, size_t align)
+{
+	return (uintptr_t)malloc_alloc_segment(size, align);
+}
+
+int seg_get(test_segment_t *segs, int max)
+{
+	for (int i = 0; i < nextseg && i < max; i++) {
+		segs[i].start = segments[i].start;
+		segs[i].end = segments[i].end;
+		segs[i].node = segments[i].node;
+	}
+
+	return nextseg;
+}
+
+int seg_find(uintptr_t addr)
+{
+	return find_segment(addr);
+}
+
+void seg_reset(void)
+{
+	nextseg = 0;
+}
@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Tests for the malloc segment table in malloc-wrapper.c.
+ *
+ * Fixed cases check insertion order, replacement of overlapping
+ * segments, merging of adjacent segments on the same node, lookup,
+ * and what happens when the table is full.  Then random adds,
+ * excludes and allocations are checked against a map of which node
+ * owns each unit of a small address space: the table must always hold
+ * exactly the maximal runs of that map, in order.
+ *
+ * usage: malloc-segments [operations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "malloc-segments.h"
+
+/* libos/errors.h can't be included next to the host headers. */
+#define ERR_NOMEM   (-257)
+#define ERR_INVALID (-260)
+
+#define NUM_SEGMENTS 64
+
+/* The model's address space, in units of UNIT bytes from BASE. */
+#define BASE  0x100000
+#define UNIT  16
+#define UNITS 1024
+
+static int failed;
+
+static void fail(const char *what)
+{
+	test_segment_t segs[NUM_SEGMENTS];
+	int i, n = seg_get(segs, NUM_SEGMENTS);
+
+	fprintf(stderr, "FAIL: %s; table:\n", what);
+	for (i = 0; i < n && i < NUM_SEGMENTS; i++)
+		fprintf(stderr, "  %#lx-%#lx node %d\n", (unsigned long)segs[i].start,
+		        (unsigned long)segs[i].end, segs[i].node);
+
+	failed = 1;
+}
+
+/* Check the table against n expected segments. */
+static void expect(const char *what, const test_segment_t *want, int n)
+{
+	test_segment_t segs[NUM_SEGMENTS];
+	int i;
+
+	if (seg_get(segs, NUM_SEGMENTS) != n) {
+		fail(what);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (segs[i].start != want[i].start || segs[i].end != want[i].end ||
+		    segs[i].node != want[i].node) {
+			fail(what);
+			return;
+		}
+	}
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void test_sorted(void)
+{
+	test_segment_t want[20];
+	uint32_t rand = 1;
+	int order[20];
+	int i, j, t;
+
+	seg_reset();
+
+	for (i = 0; i < 20; i++) {
+		want[i].start = 0x10000 + i * 0x1000;
+		want[i].end = want[i].start + 0x7ff;
+		want[i].node = 0;
+		order[i] = i;
+	}
+
+	for (i = 19; i > 0; i--) {
+		j = next_rand(&rand) % (i + 1);
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	for (i = 0; i < 20; i++)
+		if (seg_add(want[order[i]].start, want[order[i]].end, 0))
+			fail("add to a table with room");
+
+	expect("sorted insertion", want, 20);
+
+	for (i = 0; i < 20; i++) {
+		if (seg_find(want[i].start) != i || seg_find(want[i].end) != i ||
+		    seg_find(want[i].end + 1) != i + 1)
+			fail("lookup");
+	}
+
+	if (seg_find(0) != 0 || seg_find(UINTPTR_MAX) != 20)
+		fail("lookup outside the table");
+
+	if (seg_add(0x5000, 0x4fff, 0) != ERR_INVALID ||
+	    seg_exclude(0x5000, 0x4fff) != ERR_INVALID)
+		fail("end below start accepted");
+}
+
+static void test_overlap(void)
+{
+	static const test_segment_t two[] = {
+		{ 0x1000, 0x17ff, 0 },
+		{ 0x1800, 0x27ff, 1 },
+	};
+	static const test_segment_t four[] = {
+		{ 0x1000, 0x11ff, 0 },
+		{ 0x1200, 0x12ff, 1 },
+		{ 0x1300, 0x17ff, 0 },
+		{ 0x1800, 0x27ff, 1 },
+	};
+	static const test_segment_t one[] = {
+		{ 0x0800, 0x2fff, 2 },
+	};
+
+	seg_reset();
+
+	seg_add(0x1000, 0x1fff, 0);
+	seg_add(0x1800, 0x27ff, 1);
+	expect("overlapping tail replaced", two, 2);
+
+	seg_add(0x1200, 0x12ff, 1);
+	expect("overlapping middle replaced", four, 4);
+
+	seg_add(0x0800, 0x2fff, 2);
+	expect("covered segments replaced", one, 1);
+}
+
+static void test_merge(void)
+{
+	static const test_segment_t merged[] = {
+		{ 0x1000, 0x3fff, 0 },
+	};
+	static const test_segment_t nodes[] = {
+		{ 0x0800, 0x3fff, 0 },
+		{ 0x4000, 0x4fff, 1 },
+	};
+
+	seg_reset();
+
+	seg_add(0x1000, 0x1fff, 0);
+	seg_add(0x3000, 0x3fff, 0);
+	seg_add(0x2000, 0x2fff, 0);
+	expect("gap filled", merged, 1);
+
+	seg_add(0x4000, 0x4fff, 1);
+	seg_add(0x0800, 0x0fff, 0);
+	expect("merged only on the same node", nodes, 2);
+}
+
+/* Segment i of a full table has a size that grows with i. */
+static uintptr_t full_start(int i)
+{
+	return 0x10000 + i * 0x10000;
+}
+
+static uintptr_t full_end(int i)
+{
+	return full_start(i) + (i + 2) * 0x100 - 1;
+}
+
+static void test_full(void)
+{
+	test_segment_t want[NUM_SEGMENTS];
+	int i;
+
+	seg_reset();
+
+	for (i = 0; i < NUM_SEGMENTS; i++) {
+		want[i].start = full_start(i);
+		want[i].end = full_end(i);
+		want[i].node = 0;
+
+		if (seg_add(want[i].start, want[i].end, 0))
+			fail("add to a table with room");
+	}
+
+	expect("full table", want, NUM_SEGMENTS);
+
+	/* Growing a segment needs no new entry. */
+	want[5].end += 0x100;
+	if (seg_add(want[5].end - 0xff, want[5].end, 0))
+		fail("merge into a full table");
+
+	expect("merge into a full table", want, NUM_SEGMENTS);
+
+	/* A segment smaller than any in the table is dropped. */
+	if (seg_add(0x1000, 0x10ff, 0) != ERR_NOMEM)
+		fail("small segment added to a full table");
+
+	expect("small segment dropped", want, NUM_SEGMENTS);
+
+	/* A larger one replaces the smallest, segment 0. */
+	if (seg_add(0x2000000, 0x2000fff, 0) != ERR_NOMEM)
+		fail("no error for a discarded segment");
+
+	memmove(&want[0], &want[1], (NUM_SEGMENTS - 1) * sizeof(want[0]));
+	want[NUM_SEGMENTS - 1].start = 0x2000000;
+	want[NUM_SEGMENTS - 1].end = 0x2000fff;
+	expect("smallest segment dropped", want, NUM_SEGMENTS);
+
+	/* Splitting a segment needs an entry; segment 1, now the
+	 * smallest at 0x300 bytes, makes room.
+	 */
+	if (seg_exclude(full_start(40) + 0x400, full_start(40) + 0x4ff) !=
+	    ERR_NOMEM)
+		fail("no error when a split overflows the table");
+
+	memmove(&want[0], &want[1], 39 * sizeof(want[0]));
+	want[38].start = full_start(40);
+	want[38].end = full_start(40) + 0x3ff;
+	want[39].start = full_start(40) + 0x500;
+	want[39].end = full_end(40);
+	want[39].node = 0;
+	expect("split in a full table", want, NUM_SEGMENTS);
+
+	/* Unless a piece of the split is itself the smallest. */
+	if (seg_exclude(full_start(50) + 0x100, full_start(50) + 0x1ff) !=
+	    ERR_NOMEM)
+		fail("no error when a split overflows the table");
+
+	want[49].start = full_start(50) + 0x200;
+	expect("split piece dropped", want, NUM_SEGMENTS);
+}
+
+/* The model: the node owning each unit, or -1. */
+static int model[UNITS];
+
+static uintptr_t unit_addr(int unit)
+{
+	return BASE + unit * UNIT;
+}
+
+static void model_set(int first, int last, int node)
+{
+	int i;
+
+	for (i = first; i <= last; i++)
+		model[i] = node;
+}
+
+/* The table must hold the model's maximal runs. */
+static void check_model(uint32_t *rand)
+{
+	test_segment_t want[UNITS / 2 + 1];
+	int i, n = 0;
+
+	for (i = 0; i < UNITS; i++) {
+		if (model[i] < 0)
+			continue;
+
+		if (n && model[i] == want[n - 1].node &&
+		    want[n - 1].end + 1 == unit_addr(i)) {
+			want[n - 1].end += UNIT;
+			continue;
+		}
+
+		want[n].start = unit_addr(i);
+		want[n].end = unit_addr(i) + UNIT - 1;
+		want[n].node = model[i];
+		n++;
+	}
+
+	expect("table differs from model", want, n);
+
+	/* Look up a few addresses against a linear search. */
+	for (i = 0; i < 8; i++) {
+		uintptr_t addr = BASE - UNIT + next_rand(rand) % ((UNITS + 2) * UNIT);
+		int j;
+
+		for (j = 0; j < n && want[j].end < addr; j++)
+			;
+
+		if (seg_find(addr) != j)
+			fail("lookup differs from linear search");
+	}
+}
+
+/* Take the first fit from the model, as malloc_alloc_segment() does. */
+static uintptr_t model_alloc(int units, int align)
+{
+	int i = 0, start, end;
+
+	while (i < UNITS) {
+		if (model[i] < 0) {
+			i++;
+			continue;
+		}
+
+		for (end = i; end + 1 < UNITS && model[end + 1] == model[i]; end++)
+			;
+
+		start = (i + align - 1) / align * align;
+		if (start + units - 1 <= end) {
+			model_set(start, start + units - 1, -1);
+			return unit_addr(start);
+		}
+
+		i = end + 1;
+	}
+
+	return 0;
+}
+
+static void test_random(unsigned long ops)
+{
+	uint32_t rand = 12345;
+	unsigned long n;
+	int ret;
+
+	seg_reset();
+	model_set(0, UNITS - 1, -1);
+
+	for (n = 0; n < ops && !failed; n++) {
+		uint32_t r = next_rand(&rand);
+		int len = r % 64 + 1;
+		int first = (r >> 6) % (UNITS - len + 1);
+		int last = first + len - 1;
+		int node = (r >> 16) % 3;
+		int align = 1 << ((r >> 18) % 4);
+		uintptr_t got, want;
+
+		switch ((r >> 20) % 4) {
+		case 0:
+		case 1:
+			ret = seg_add(unit_addr(first), unit_addr(last) + UNIT - 1,
+			              node);
+			model_set(first, last, node);
+			break;
+
+		case 2:
+			ret = seg_exclude(unit_addr(first), unit_addr(last) + UNIT - 1);
+			model_set(first, last, -1);
+			break;
+
+		case 3:
+			got = seg_alloc(len * UNIT, align * UNIT);
+			want = model_alloc(len, align);
+			if (got != want)
+				fail("allocation differs from model");
+
+			ret = 0;
+			break;
+		}
+
+		/* The model has no limit; start again when the table
+		 * fills up.
+		 */
+		if (ret == ERR_NOMEM) {
+			seg_reset();
+			model_set(0, UNITS - 1, -1);
+			continue;
+		}
+
+		if (ret)
+			fail("unexpected error");
+
+		check_model(&rand);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long ops = 100000;
+
+	if (argc > 1)
+		ops = strtoul(argv[1], NULL, 0);
+
+	host_cpu_init(0);
+
+	test_sorted();
+	test_overlap();
+	test_merge();
+	test_full();
+	test_random(ops);
+
+	if (failed)
+		return 1;
+
+	printf("%lu random operations\n", ops);
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Interface between the host and libos halves of malloc-segments */
+
+#ifndef TEST_MALLOC_SEGMENTS_H
+#define TEST_MALLOC_SEGMENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct test_segment {
+	uintptr_t start, end;
+	int node;
+} test_segment_t;
+
+/* malloc_add_segment_node(), malloc_exclude_segment() and
+ * malloc_alloc_segment(), on addresses that are never dereferenced.
+ */
+int seg_add(uintptr_t start, uintptr_t end, int node);
+int seg_exclude(uintptr_t start, uintptr_t end);
+uintptr_t seg_alloc(size_t size, size_t align);
+
+/** Copy out the segment table; returns the number of segments. */
+int seg_get(test_segment_t *segs, int max);
+
+/** find_segment(): the index of the first segment ending at or after addr. */
+int seg_find(uintptr_t addr);
+
+/** Empty the segment table. */
+void seg_reset(void);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The libos side of malloc-stats, built against the libos headers
+ * with CONFIG_LIBOS_MALLOC_STATS.
+ */
+
+#include <libos/libos.h>
+#include <libos/alloc.h>
+#include <libos/malloc.h>
+#include <libos/printlog.h>
+#include <malloc.h>
+
+#include "malloc-stats.h"
+
+typedef int classes_match[TEST_CLASSES == MALLOC_STATS_CLASSES ? 1 : -1];
+typedef int sites_match[TEST_SITES == MALLOC_STATS_SITES ? 1 : -1];
+
+/* Keep the pointer live past the call, so that the call is not a
+ * tail call and its return address stays in the calling function.
+ */
+#define KEEP(p) asm volatile("" : "+r" (p))
+
+int stats_heap_init(void *base, size_t size)
+{
+	if (malloc_add_segment(base, base + size - 1))
+		return -1;
+
+	return malloc_init() ? 0 : -1;
+}
+
+void *stats_malloc(size_t size)
+{
+	void *p = malloc(size);
+	KEEP(p);
+	return p;
+}
+
+void *stats_memalign(size_t align, size_t size)
+{
+	void *p = memalign(align, size);
+	KEEP(p);
+	return p;
+}
+
+void *stats_calloc(size_t size)
+{
+	void *p = calloc(1, size);
+	KEEP(p);
+	return p;
+}
+
+void *stats_alloc(size_t size)
+{
+	void *p = alloc(size, 8);
+	KEEP(p);
+	return p;
+}
+
+void *stats_realloc(void *ptr, size_t size)
+{
+	void *p = realloc(ptr, size);
+	KEEP(p);
+	return p;
+}
+
+void stats_free(void *ptr)
+{
+	free(ptr);
+}
+
+/* Each case is its own call site; the different asm comments after
+ * the calls keep the compiler from merging them.
+ */
+#define SITE(n) \
+	case n: \
+		p = malloc(size); \
+		asm volatile("# site " #n : "+r" (p)); \
+		break;
+
+#define SITES10(n) \
+	SITE(n##0) SITE(n##1) SITE(n##2) SITE(n##3) SITE(n##4) \
+	SITE(n##5) SITE(n##6) SITE(n##7) SITE(n##8) SITE(n##9)
+
+void *stats_site_alloc(int n, size_t size)
+{
+	void *p = NULL;
+
+	switch (n) {
+	SITE(0) SITE(1) SITE(2) SITE(3) SITE(4)
+	SITE(5) SITE(6) SITE(7) SITE(8) SITE(9)
+	SITES10(1) SITES10(2) SITES10(3) SITES10(4)
+	SITES10(5) SITES10(6) SITES10(7)
+	}
+
+	return p;
+}
+
+size_t stats_usable(void *ptr)
+{
+	return mspace_usable_size(ptr);
+}
+
+int stats_tag(void *ptr)
+{
+	return ((uint8_t *)ptr)[mspace_usable_size(ptr) - 1];
+}
+
+void stats_get(test_stats_t *out)
+{
+	malloc_stats_t st;
+	int i;
+
+	malloc_get_stats(&st);
+
+	out->allocs = st.allocs;
+	out->frees = st.frees;
+	out->failures = st.failures;
+	out->bytes = st.bytes;
+	out->peak = st.peak;
+
+	for (i = 0; i < TEST_CLASSES; i++) {
+		out->class_allocs[i] = st.classes[i].allocs;
+		out->class_frees[i] = st.classes[i].frees;
+		out->class_bytes[i] = st.classes[i].bytes;
+	}
+}
+
+int stats_get_sites(test_site_t *out, int max)
+{
+	static malloc_site_stats_t sites[MALLOC_STATS_SITES];
+	int i, num;
+
+	num = malloc_get_site_stats(sites, min(max, MALLOC_STATS_SITES));
+
+	for (i = 0; i < num; i++) {
+		out[i].site = (uintptr_t)sites[i].site;
+		out[i].allocs = sites[i].allocs;
+		out[i].frees = sites[i].frees;
+		out[i].bytes = sites[i].bytes;
+		out[i].peak = sites[i].peak;
+	}
+
+	return num;
+}
+
+void stats_dump(void)
+{
+	malloc_dump_stats(LOGLEVEL_ALWAYS);
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Tests for the malloc statistics in malloc-stats.c.
+ *
+ * Allocations are made from several call sites in the libos half,
+ * through each of the inline wrappers, and mirrored in a model here,
+ * keyed by the site tag read from each new chunk.  The model checks
+ * that each call site gets its own row and tag, that the tag survives
+ * the caller filling its whole allocation, and that the totals, the
+ * size-class histogram, the per-site rows and the output of
+ * malloc_dump_stats() all agree with it.  Finally, more call sites
+ * than the table holds are used, and the extras must share row 0.
+ *
+ * usage: malloc-stats
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "malloc-stats.h"
+
+#define HEAP_SIZE (4 << 20)
+#define MAX_LIVE  1024
+
+typedef struct live {
+	void *p;
+	size_t usable;
+	int tag;
+} live_t;
+
+static test_stats_t model;
+static test_site_t rows[TEST_SITES];
+static live_t live[MAX_LIVE];
+static int nlive;
+static int failed;
+
+static void fail(const char *what)
+{
+	fprintf(stderr, "FAIL: %s\n", what);
+	failed = 1;
+}
+
+static int size_class(size_t size)
+{
+	int class = 0;
+
+	while (class < TEST_CLASSES - 1 && size > (size_t)16 << class)
+		class++;
+
+	return class;
+}
+
+/* Record a new allocation of size bytes, and fill it as its owner
+ * would, up to the last byte it asked for.
+ */
+static int track(void *p, size_t size)
+{
+	live_t *l = &live[nlive++];
+	int class;
+
+	if (!p || nlive > MAX_LIVE) {
+		fail("allocation failed");
+		exit(1);
+	}
+
+	l->p = p;
+	l->usable = stats_usable(p);
+	l->tag = stats_tag(p);
+	class = size_class(l->usable);
+
+	if (l->usable < size + 1)
+		fail("no room for the site tag");
+
+	model.allocs++;
+	model.bytes += l->usable;
+	if (model.bytes > model.peak)
+		model.peak = model.bytes;
+
+	model.class_allocs[class]++;
+	model.class_bytes[class] += l->usable;
+
+	rows[l->tag].allocs++;
+	rows[l->tag].bytes += l->usable;
+	if (rows[l->tag].bytes > rows[l->tag].peak)
+		rows[l->tag].peak = rows[l->tag].bytes;
+
+	memset(p, 0xa5, size);
+	return l->tag;
+}
+
+/* Forget live[i], which the caller has freed or reallocated. */
+static void untrack(int i)
+{
+	live_t *l = &live[i];
+	int class = size_class(l->usable);
+
+	model.frees++;
+	model.bytes -= l->usable;
+	model.class_frees[class]++;
+	model.class_bytes[class] -= l->usable;
+
+	rows[l->tag].frees++;
+	rows[l->tag].bytes -= l->usable;
+
+	live[i] = live[--nlive];
+}
+
+static void release(int i)
+{
+	stats_free(live[i].p);
+	untrack(i);
+}
+
+/* Check the counters against the model.  Rows are reported in table
+ * order, skipping unused ones, and their sites must be set except for
+ * row 0.
+ */
+static void check(const char *when)
+{
+	test_site_t sites[TEST_SITES];
+	test_stats_t st;
+	int i, n, num;
+
+	stats_get(&st);
+
+	if (st.allocs != model.allocs || st.frees != model.frees ||
+	    st.failures != model.failures || st.bytes != model.bytes ||
+	    st.peak != model.peak) {
+		fprintf(stderr, "%s: %lu/%lu allocs, %lu/%lu frees, "
+		        "%lu/%lu failures, %zu/%zu bytes, %zu/%zu peak\n", when,
+		        st.allocs, model.allocs, st.frees, model.frees,
+		        st.failures, model.failures, st.bytes, model.bytes,
+		        st.peak, model.peak);
+		fail("totals differ from model");
+	}
+
+	for (i = 0; i < TEST_CLASSES; i++) {
+		if (st.class_allocs[i] != model.class_allocs[i] ||
+		    st.class_frees[i] != model.class_frees[i] ||
+		    st.class_bytes[i] != model.class_bytes[i]) {
+			fprintf(stderr, "%s: class %d\n", when, i);
+			fail("size class differs from model");
+		}
+	}
+
+	num = stats_get_sites(sites, TEST_SITES);
+
+	for (i = 0, n = 0; i < TEST_SITES; i++) {
+		if (!rows[i].allocs)
+			continue;
+
+		if (n >= num || sites[n].allocs != rows[i].allocs ||
+		    sites[n].frees != rows[i].frees ||
+		    sites[n].bytes != rows[i].bytes ||
+		    sites[n].peak != rows[i].peak ||
+		    !sites[n].site != !i) {
+			fprintf(stderr, "%s: row %d\n", when, i);
+			fail("site differs from model");
+		}
+
+		rows[i].site = n < num ? sites[n].site : 0;
+		n++;
+	}
+
+	if (n != num)
+		fail("unexpected sites");
+}
+
+/* Check that the site of a row is in the function that called the
+ * allocator, just after its start.
+ */
+static void check_site(int tag, void *fn, const char *name)
+{
+	uintptr_t start = (uintptr_t)fn;
+
+	if (rows[tag].site <= start || rows[tag].site > start + 256) {
+		fprintf(stderr, "%s at %p, site %#lx\n", name, fn,
+		        (unsigned long)rows[tag].site);
+		fail("site outside the calling function");
+	}
+}
+
+static void test_wrappers(void)
+{
+	static const size_t sizes[] = {
+		1, 7, 15, 16, 24, 40, 100, 200, 500, 1000, 3000, 10000, 70000
+	};
+	int tags[6], i, j, t;
+	void *p;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t size = sizes[i];
+
+		tags[0] = track(stats_malloc(size), size);
+		tags[1] = track(stats_memalign(64, size), size);
+		tags[2] = track(stats_calloc(size), size);
+		tags[3] = track(stats_alloc(size), size);
+
+		/* Reallocate the calloc() chunk. */
+		p = stats_realloc(live[nlive - 2].p, size * 2);
+		untrack(nlive - 2);
+		tags[4] = track(p, size * 2);
+
+		tags[5] = track(stats_malloc(size), size);
+
+		if (tags[0] != tags[5])
+			fail("one call site, two tags");
+
+		for (j = 0; j < 5; j++)
+			for (t = j + 1; t < 5; t++)
+				if (tags[j] == tags[t] || !tags[j])
+					fail("two call sites, one tag");
+
+		check("wrappers");
+	}
+
+	check_site(tags[0], stats_malloc, "stats_malloc");
+	check_site(tags[1], stats_memalign, "stats_memalign");
+	check_site(tags[2], stats_calloc, "stats_calloc");
+	check_site(tags[3], stats_alloc, "stats_alloc");
+	check_site(tags[4], stats_realloc, "stats_realloc");
+
+	/* Free every other chunk, which leaves peaks above bytes. */
+	for (i = nlive - 1; i >= 0; i -= 2)
+		release(i);
+
+	check("frees");
+
+	if (stats_malloc((size_t)-1) || stats_malloc(HEAP_SIZE))
+		fail("impossible allocation succeeded");
+
+	model.failures += 2;
+	check("failures");
+}
+
+/* Parse malloc_dump_stats() output, and check it against the model. */
+static void check_dump(void)
+{
+	char line[256], site[32];
+	FILE *out = tmpfile();
+	int saved = dup(1);
+	int i, nclasses = 0, nsites = 0, mspaces = 0, totals = 0;
+	int want_classes = 0, want_sites = 0;
+
+	fflush(stdout);
+	dup2(fileno(out), 1);
+	stats_dump();
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+	rewind(out);
+
+	while (fgets(line, sizeof(line), out)) {
+		unsigned long allocs, frees, failures;
+		size_t bytes, peak;
+		unsigned int limit;
+		char *s;
+
+		if ((s = strstr(line, "malloc: "))) {
+			if (sscanf(s, "malloc: %lu allocs, %lu frees, %lu failures, "
+			           "%zu bytes in use, peak %zu",
+			           &allocs, &frees, &failures, &bytes, &peak) != 5 ||
+			    allocs != model.allocs || frees != model.frees ||
+			    failures != model.failures || bytes != model.bytes ||
+			    peak != model.peak)
+				fail("dumped totals differ from model");
+
+			totals++;
+		} else if ((s = strstr(line, "  <=")) || (s = strstr(line, "  >"))) {
+			if (sscanf(s + (s[2] == '<' ? 4 : 3),
+			           "%u: %lu allocs, %lu frees, %zu bytes in use",
+			           &limit, &allocs, &frees, &bytes) != 4) {
+				fail("bad class line");
+				continue;
+			}
+
+			i = size_class(limit) + (s[2] == '>');
+			if (i >= TEST_CLASSES || allocs != model.class_allocs[i] ||
+			    frees != model.class_frees[i] ||
+			    bytes != model.class_bytes[i])
+				fail("dumped class differs from model");
+
+			nclasses++;
+		} else if ((s = strstr(line, "mspace "))) {
+			mspaces++;
+		} else if ((s = strstr(line, "  ")) &&
+		           sscanf(s, " %31[^:]: %lu allocs, %lu frees, "
+		                  "%zu bytes in use, peak %zu",
+		                  site, &allocs, &frees, &bytes, &peak) == 5) {
+			uintptr_t addr = strcmp(site, "(nil)") ?
+			                 strtoul(site, NULL, 16) : 0;
+
+			for (i = 0; i < TEST_SITES; i++)
+				if (rows[i].allocs && rows[i].site == addr)
+					break;
+
+			if (i == TEST_SITES || allocs != rows[i].allocs ||
+			    frees != rows[i].frees || bytes != rows[i].bytes ||
+			    peak != rows[i].peak)
+				fail("dumped site differs from model");
+
+			nsites++;
+		} else {
+			fprintf(stderr, "%s", line);
+			fail("unexpected line in dump");
+		}
+	}
+
+	fclose(out);
+
+	for (i = 0; i < TEST_CLASSES; i++)
+		want_classes += model.class_allocs[i] != 0;
+	for (i = 0; i < TEST_SITES; i++)
+		want_sites += rows[i].bytes != 0;
+
+	if (totals != 1 || mspaces != 1 || nclasses != want_classes ||
+	    nsites != want_sites)
+		fail("dump has missing or extra lines");
+}
+
+/* Use more call sites than the table holds. */
+static void test_overflow(void)
+{
+	int i, used = 0, tag;
+
+	for (i = 1; i < TEST_SITES; i++)
+		used += rows[i].allocs != 0;
+
+	for (i = 0; i < TEST_SWITCH_SITES; i++) {
+		tag = track(stats_site_alloc(i, 32), 32);
+
+		if ((used < TEST_SITES - 1) != (tag != 0))
+			fail("site table overflow at the wrong point");
+
+		if (tag && rows[tag].allocs != 1)
+			fail("new call site in a used row");
+
+		used += tag != 0;
+	}
+
+	check("overflow");
+	check_dump();
+
+	while (nlive)
+		release(nlive - 1);
+
+	check("everything freed");
+	check_dump();
+}
+
+int main(int argc, char *argv[])
+{
+	void *heap;
+
+	host_cpu_init(0);
+
+	if (posix_memalign(&heap, 4096, HEAP_SIZE) ||
+	    stats_heap_init(heap, HEAP_SIZE)) {
+		fprintf(stderr, "FAIL: heap setup\n");
+		return 1;
+	}
+
+	check("start");
+	test_wrappers();
+	check_dump();
+	test_overflow();
+
+	if (failed)
+		return 1;
+
+	printf("%lu allocations, %lu frees\n", model.allocs, model.frees);
+	return 0;
+}
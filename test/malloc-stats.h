@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Interface between the host and libos halves of malloc-stats */
+
+#ifndef TEST_MALLOC_STATS_H
+#define TEST_MALLOC_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* MALLOC_STATS_CLASSES and MALLOC_STATS_SITES */
+#define TEST_CLASSES 16
+#define TEST_SITES   64
+
+/* Number of distinct call sites in stats_site_alloc() */
+#define TEST_SWITCH_SITES 80
+
+typedef struct test_stats {
+	unsigned long allocs, frees, failures;
+	size_t bytes, peak;
+	unsigned long class_allocs[TEST_CLASSES], class_frees[TEST_CLASSES];
+	size_t class_bytes[TEST_CLASSES];
+} test_stats_t;
+
+typedef struct test_site {
+	uintptr_t site;
+	unsigned long allocs, frees;
+	size_t bytes, peak;
+} test_site_t;
+
+/** Give libos malloc a heap and set it up; returns 0 on success. */
+int stats_heap_init(void *base, size_t size);
+
+/* Each of these is one call site of the libos allocation function or
+ * wrapper it is named after.
+ */
+void *stats_malloc(size_t size);
+void *stats_memalign(size_t align, size_t size);
+void *stats_calloc(size_t size);
+void *stats_alloc(size_t size);
+void *stats_realloc(void *ptr, size_t size);
+void stats_free(void *ptr);
+
+/** malloc() from call site n of TEST_SWITCH_SITES. */
+void *stats_site_alloc(int n, size_t size);
+
+/** The usable size of a chunk, and the site tag in its last byte. */
+size_t stats_usable(void *ptr);
+int stats_tag(void *ptr);
+
+/* malloc_get_stats(), malloc_get_site_stats() and malloc_dump_stats() */
+void stats_get(test_stats_t *stats);
+int stats_get_sites(test_site_t *sites, int max);
+void stats_dump(void);
+
+#endif
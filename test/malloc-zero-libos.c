@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The libos side of malloc-zero, built against the libos headers. */
+
+#include <libos/libos.h>
+#include <libos/alloc.h>
+#include <libos/malloc.h>
+#include <malloc.h>
+
+#include "malloc-zero.h"
+
+int zero_heap_init(void *dirty, size_t dirty_size,
+                   void *zeroed, size_t zeroed_size)
+{
+	if (malloc_add_segment(dirty, dirty + dirty_size - 1))
+		return -1;
+
+	if (malloc_add_zeroed_segment(zeroed, zeroed + zeroed_size - 1, 0))
+		return -1;
+
+	return malloc_init() ? 0 : -1;
+}
+
+void *zero_malloc(size_t size)
+{
+	return malloc(size);
+}
+
+void *zero_calloc(size_t nmemb, size_t size)
+{
+	return calloc(nmemb, size);
+}
+
+void *zero_zalloc(size_t size)
+{
+	return malloc_zalloc(size);
+}
+
+void *zero_alloc(size_t size)
+{
+	return alloc(size, 8);
+}
+
+void *zero_alloc_aligned(size_t size)
+{
+	return alloc(size, 64);
+}
+
+void *zero_realloc(void *ptr, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+void zero_free(void *ptr)
+{
+	free(ptr);
+}
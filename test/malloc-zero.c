@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Check that libos calloc(), malloc_zalloc() and alloc() return
+ * cleared memory, and that they skip clearing only what they may.
+ *
+ * Built as malloc-zero and malloc-zero-cache, the latter with
+ * CONFIG_LIBOS_MALLOC_CPU_CACHE.  The heap is a small dirty segment
+ * followed by a large segment added with malloc_add_zeroed_segment(),
+ * so malloc_init() must leave the zeroed one as the top chunk even
+ * though it is not the last by address.
+ *
+ * A poison byte planted in the "zeroed" segment shows that fresh carves
+ * from the top chunk are not cleared again.  Every other allocation
+ * is filled with garbage before it is freed, so memory reused after a
+ * free, after neighbours merge, or after it returns to the top chunk
+ * must be cleared.  Random operations then mix all of these.
+ *
+ * usage: malloc-zero [operations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "malloc-zero.h"
+
+#define DIRTY_SIZE  (64 * 1024)
+#define ZEROED_SIZE (1024 * 1024)
+#define PROBE_SIZE  (128 * 1024)
+
+#define DIRTY  0xdd
+#define POISON 0xee
+
+#define NSLOTS 128
+
+static uint8_t *zeroed;
+static int failed;
+
+static void fail(const char *what, const void *ptr, size_t size)
+{
+	fprintf(stderr, "FAIL: %s: %p size %zu\n", what, ptr, size);
+	failed = 1;
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* Return the number of non-zero bytes in ptr[0..size). */
+static size_t count_dirty(const uint8_t *ptr, size_t size)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < size; i++)
+		n += ptr[i] != 0;
+
+	return n;
+}
+
+static void check_zero(const char *what, void *ptr, size_t size)
+{
+	if (!ptr) {
+		fail(what, ptr, size);
+		return;
+	}
+
+	if (count_dirty(ptr, size))
+		fail(what, ptr, size);
+}
+
+static int in_zeroed(const uint8_t *ptr, size_t size)
+{
+	return ptr >= zeroed && ptr + size <= zeroed + ZEROED_SIZE;
+}
+
+/* Fresh memory from the top chunk is trusted to be zero, which the
+ * poison bytes show; once freed back to the top, it is cleared again.
+ */
+static void test_top(void)
+{
+	uint8_t *p1, *p2, *p3, *p4;
+
+	zeroed[PROBE_SIZE / 2] = POISON;
+	zeroed[PROBE_SIZE + PROBE_SIZE / 2] = POISON;
+
+	/* Larger than the dirty segment, so these must come from top. */
+	p1 = zero_calloc(1, PROBE_SIZE);
+	p2 = zero_zalloc(PROBE_SIZE);
+	p3 = zero_alloc(PROBE_SIZE);
+
+	if (!p1 || !p2 || !p3 ||
+	    !in_zeroed(p1, PROBE_SIZE) || !in_zeroed(p2, PROBE_SIZE) ||
+	    !in_zeroed(p3, PROBE_SIZE)) {
+		fprintf(stderr, "FAIL: probes %p %p %p not from the zeroed "
+		        "segment at %p\n", p1, p2, p3, zeroed);
+		exit(1);
+	}
+
+	if (count_dirty(p1, PROBE_SIZE) != 1 ||
+	    count_dirty(p2, PROBE_SIZE) != 1)
+		fail("top carve cleared, or poison lost", p1, PROBE_SIZE);
+
+	check_zero("alloc from top", p3, PROBE_SIZE);
+
+	memset(p1, DIRTY, PROBE_SIZE);
+	memset(p2, DIRTY, PROBE_SIZE);
+	memset(p3, DIRTY, PROBE_SIZE);
+
+	/* p3 and then p2 merge back into the top chunk. */
+	zero_free(p3);
+	zero_free(p2);
+
+	p4 = zero_calloc(2, PROBE_SIZE);
+	if (p4 != p2)
+		fail("calloc did not reuse the top chunk", p4, 2 * PROBE_SIZE);
+	check_zero("calloc after free into top", p4, 2 * PROBE_SIZE);
+
+	memset(p4, DIRTY, 2 * PROBE_SIZE);
+	zero_free(p4);
+
+	p4 = zero_zalloc(3 * PROBE_SIZE);
+	check_zero("zalloc after free into top", p4, 3 * PROBE_SIZE);
+
+	zero_free(p4);
+	zero_free(p1);
+}
+
+static void test_free(void)
+{
+	for (size_t size = 8; size <= 8192; size *= 2) {
+		void *p = zero_malloc(size);
+
+		memset(p, DIRTY, size);
+		zero_free(p);
+		p = zero_calloc(size, 1);
+		check_zero("calloc after free", p, size);
+
+		memset(p, DIRTY, size);
+		zero_free(p);
+		p = zero_zalloc(size);
+		check_zero("zalloc after free", p, size);
+
+		memset(p, DIRTY, size);
+		zero_free(p);
+		p = zero_alloc_aligned(size);
+		check_zero("aligned alloc after free", p, size);
+
+		zero_free(p);
+	}
+}
+
+/* Free chunks that coalesce on both sides, then allocate across them. */
+static void test_merge(void)
+{
+	size_t size = 3000;
+	uint8_t *a, *b, *c, *guard, *p;
+
+	a = zero_malloc(size);
+	b = zero_malloc(size);
+	c = zero_malloc(size);
+	guard = zero_malloc(64);
+
+	memset(a, DIRTY, size);
+	memset(b, DIRTY, size);
+	memset(c, DIRTY, size);
+
+	zero_free(a);
+	zero_free(c);
+	zero_free(b);
+
+	p = zero_calloc(3, size);
+	check_zero("calloc after merge", p, 3 * size);
+
+	memset(p, DIRTY, 3 * size);
+	zero_free(p);
+
+	p = zero_alloc(3 * size);
+	check_zero("alloc after merge", p, 3 * size);
+
+	zero_free(p);
+	zero_free(guard);
+}
+
+struct slot {
+	uint8_t *ptr;
+	size_t size;
+	uint8_t fill;
+};
+
+static void check_fill(const struct slot *s)
+{
+	for (size_t i = 0; i < s->size; i++) {
+		if (s->ptr[i] != s->fill) {
+			fail("overwritten", s->ptr, s->size);
+			return;
+		}
+	}
+}
+
+static size_t rand_size(uint32_t *rand)
+{
+	static const size_t max[] = { 64, 1024, 8192, 32768 };
+	uint32_t r = next_rand(rand);
+
+	return r / 4 % max[r % 4] + 1;
+}
+
+static void test_random(unsigned long ops)
+{
+	static struct slot slots[NSLOTS];
+	uint32_t rand = 1;
+
+	for (unsigned long n = 0; n < ops && !failed; n++) {
+		uint32_t r = next_rand(&rand);
+		struct slot *s = &slots[r % NSLOTS];
+		size_t size;
+
+		r /= NSLOTS;
+
+		if (s->ptr) {
+			check_fill(s);
+
+			if (r % 4 == 0) {
+				size = rand_size(&rand);
+				s->ptr = zero_realloc(s->ptr, size);
+				if (!s->ptr) {
+					fail("realloc", NULL, size);
+					return;
+				}
+
+				if (size > s->size)
+					memset(s->ptr + s->size, s->fill, size - s->size);
+
+				s->size = size;
+				continue;
+			}
+
+			zero_free(s->ptr);
+			s->ptr = NULL;
+			continue;
+		}
+
+		size = rand_size(&rand);
+
+		switch (r % 5) {
+		case 0:
+			s->ptr = zero_malloc(size);
+			break;
+		case 1:
+			s->ptr = zero_calloc(size / 8 + 1, 8);
+			check_zero("calloc", s->ptr, size / 8 * 8 + 8);
+			break;
+		case 2:
+			s->ptr = zero_zalloc(size);
+			check_zero("zalloc", s->ptr, size);
+			break;
+		case 3:
+			s->ptr = zero_alloc(size);
+			check_zero("alloc", s->ptr, size);
+			break;
+		case 4:
+			s->ptr = zero_alloc_aligned(size);
+			check_zero("aligned alloc", s->ptr, size);
+			break;
+		}
+
+		if (!s->ptr) {
+			fail("out of memory", NULL, size);
+			return;
+		}
+
+		s->size = size;
+		s->fill = r / 5 % 255 + 1;
+		memset(s->ptr, s->fill, size);
+	}
+
+	for (int i = 0; i < NSLOTS; i++) {
+		if (slots[i].ptr) {
+			check_fill(&slots[i]);
+			zero_free(slots[i].ptr);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long ops = 200000;
+	uint8_t *dirty;
+	void *heap;
+
+	if (argc > 1)
+		ops = strtoul(argv[1], NULL, 0);
+
+	if (argc > 2 || !ops) {
+		fprintf(stderr, "usage: %s [operations]\n", argv[0]);
+		return 2;
+	}
+
+	/* The zeroed segment is below the dirty one, so adding segments
+	 * in address order would leave the dirty one as the top chunk.
+	 * They are adjacent, but must not be merged.
+	 */
+	if (posix_memalign(&heap, 4096, ZEROED_SIZE + DIRTY_SIZE)) {
+		fprintf(stderr, "FAIL: no host memory\n");
+		return 1;
+	}
+
+	zeroed = heap;
+	dirty = zeroed + ZEROED_SIZE;
+	memset(zeroed, 0, ZEROED_SIZE);
+	memset(dirty, DIRTY, DIRTY_SIZE);
+
+	host_cpu_init(0);
+
+	if (zero_heap_init(dirty, DIRTY_SIZE, zeroed, ZEROED_SIZE)) {
+		fprintf(stderr, "FAIL: heap setup\n");
+		return 1;
+	}
+
+	test_top();
+	test_free();
+	test_merge();
+	test_random(ops);
+
+	if (failed)
+		return 1;
+
+	printf("%lu operations\n", ops);
+	return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Interface between the host and libos halves of malloc-zero */
+
+#ifndef TEST_MALLOC_ZERO_H
+#define TEST_MALLOC_ZERO_H
+
+#include <stddef.h>
+
+/** Give libos malloc a dirty segment and a zeroed segment, and set it
+ * up; returns 0 on success.
+ */
+int zero_heap_init(void *dirty, size_t dirty_size,
+                   void *zeroed, size_t zeroed_size);
+
+/* libos allocation functions; the calling thread must have a cpu_t. */
+void *zero_malloc(size_t size);
+void *zero_calloc(size_t nmemb, size_t size);
+void *zero_zalloc(size_t size);
+void *zero_alloc(size_t size);
+void *zero_alloc_aligned(size_t size);
+void *zero_realloc(void *ptr, size_t size);
+void zero_free(void *ptr);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Cycles per call of libos's memcpy() and memmove(), next to the
+ * host's for scale.  Cycles are timestamp counter ticks on x86, and
+ * nanoseconds elsewhere.
+ *
+ * usage: memcpy-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "libos-libc.h"
+#include "host.h"
+
+typedef void *(*copy_fn)(void *dest, const void *src, size_t len);
+
+/* Called through volatile pointers, so gcc can't inline the copies. */
+static copy_fn volatile host_memcpy = memcpy;
+static copy_fn volatile host_memmove = memmove;
+static copy_fn volatile libos_memcpy_fn = libos_memcpy;
+static copy_fn volatile libos_memmove_fn = libos_memmove;
+
+static unsigned char buf[2][65536 + 64];
+static unsigned long iters;
+
+static double cycles(copy_fn fn, void *dest, const void *src, size_t len)
+{
+	unsigned long n = iters * 64 / (len + 64) + 1;
+	uint64_t start = host_cycles();
+
+	for (unsigned long i = 0; i < n; i++)
+		fn(dest, src, len);
+
+	return (double)(host_cycles() - start) / n;
+}
+
+static void bench(const char *name, size_t len, int src_off, int dest_off,
+                  int overlap)
+{
+	unsigned char *src = buf[0] + src_off;
+	unsigned char *dest = (overlap ? buf[0] : buf[1]) + dest_off;
+	double ours, host;
+
+	if (overlap) {
+		ours = cycles(libos_memmove_fn, dest, src, len);
+		host = cycles(host_memmove, dest, src, len);
+	} else {
+		ours = cycles(libos_memcpy_fn, dest, src, len);
+		host = cycles(host_memcpy, dest, src, len);
+	}
+
+	printf("%-16s %6zu %3d %3d %10.1f %10.1f %8.2f\n", name, len,
+	       src_off, dest_off, ours, host, len / ours);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t lens[] = { 7, 32, 100, 256, 1024, 4096, 65536 };
+
+	iters = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+	memset(buf, 0x5a, sizeof(buf));
+
+	printf("%-16s %6s %3s %3s %10s %10s %8s\n", "", "len", "src", "dst",
+	       "libos", "host", "B/cycle");
+
+	for (int i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		bench("memcpy", lens[i], 0, 0, 0);
+		bench("memcpy", lens[i], 1, 0, 0);
+		bench("memcpy", lens[i], 0, 3, 0);
+		bench("memcpy", lens[i], 5, 2, 0);
+		bench("memmove, back", lens[i], 0, 8, 1);
+		bench("memmove, back", lens[i], 0, 3, 1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Correctness of libos's memcpy() and memmove().
+ *
+ * Every source and destination alignment within two words is tried
+ * with every length up to a few copy chunks, and memmove() with every
+ * overlap in both directions.  The bytes around the destination must
+ * be left alone, and the source may only be read within the aligned
+ * words that hold it, which is checked with inaccessible pages on
+ * either side.
+ *
+ * The shift-and-merge step of misaligned copies is also checked for
+ * both byte orders, so that the big-endian form the target uses is
+ * tested on a little-endian host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <libos/endian.h>
+
+#include "libos-libc.h"
+
+#define MAX_ALIGN  16
+#define MAX_LEN    300
+#define MAX_DELTA  40
+#define GUARD      64
+#define BUF_SIZE   (GUARD + MAX_ALIGN + MAX_DELTA + MAX_LEN + MAX_DELTA + GUARD)
+
+static unsigned char src_buf[BUF_SIZE], dest_buf[BUF_SIZE];
+static unsigned char expect[BUF_SIZE];
+static unsigned long failures;
+
+static void fail(const char *what, int src_off, int dest_off, size_t len)
+{
+	if (failures++ < 20)
+		printf("FAIL: %s, src +%d, dest +%d, len %zu\n",
+		       what, src_off, dest_off, len);
+}
+
+static void fill(unsigned char *buf, size_t len, unsigned int seed)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = seed + i * 7 + (i >> 8);
+}
+
+static uint64_t load(const unsigned char *p, int size, int big_endian)
+{
+	uint64_t val = 0;
+
+	for (int i = 0; i < size; i++)
+		val = val << 8 | p[big_endian ? i : size - 1 - i];
+
+	return val;
+}
+
+static void check_merge(void)
+{
+	unsigned char bytes[16];
+
+	fill(bytes, sizeof(bytes), 0x31);
+
+	for (int be = 0; be < 2; be++) {
+		for (int shift = 1; shift < 8; shift++) {
+			uint64_t first = load(bytes, 8, be);
+			uint64_t second = load(bytes + 8, 8, be);
+			uint64_t want = load(bytes + shift, 8, be);
+			uint64_t got = be ? MERGE_BE(first, second, shift * 8) :
+			                    MERGE_LE(first, second, shift * 8);
+
+			if (got != want)
+				printf("FAIL: 64-bit %s merge, shift %d: "
+				       "%016llx, expected %016llx\n",
+				       be ? "BE" : "LE", shift * 8,
+				       (unsigned long long)got,
+				       (unsigned long long)want);
+
+			failures += got != want;
+		}
+
+		for (int shift = 1; shift < 4; shift++) {
+			uint32_t first = load(bytes, 4, be);
+			uint32_t second = load(bytes + 4, 4, be);
+			uint32_t want = load(bytes + shift, 4, be);
+			uint32_t got = be ? MERGE_BE(first, second, shift * 8) :
+			                    MERGE_LE(first, second, shift * 8);
+
+			if (got != want)
+				printf("FAIL: 32-bit %s merge, shift %d: "
+				       "%08x, expected %08x\n",
+				       be ? "BE" : "LE", shift * 8, got, want);
+
+			failures += got != want;
+		}
+	}
+}
+
+static void check_memcpy(void)
+{
+	fill(src_buf, BUF_SIZE, 1);
+
+	for (int src_off = 0; src_off < MAX_ALIGN; src_off++) {
+		for (int dest_off = 0; dest_off < MAX_ALIGN; dest_off++) {
+			for (size_t len = 0; len <= MAX_LEN; len++) {
+				unsigned char *src = src_buf + GUARD + src_off;
+				unsigned char *dest = dest_buf + GUARD + dest_off;
+
+				memset(dest_buf, 0xa5, BUF_SIZE);
+				memset(expect, 0xa5, BUF_SIZE);
+				memcpy(expect + GUARD + dest_off, src, len);
+
+				if (libos_memcpy(dest, src, len) != dest)
+					fail("memcpy return", src_off, dest_off, len);
+
+				if (memcmp(dest_buf, expect, BUF_SIZE))
+					fail("memcpy", src_off, dest_off, len);
+			}
+		}
+	}
+}
+
+/* Overlapping moves, with dest from MAX_DELTA below src to MAX_DELTA
+ * above it.
+ */
+static void check_memmove(void)
+{
+	for (int src_off = 0; src_off < MAX_ALIGN; src_off++) {
+		for (int delta = -MAX_DELTA; delta <= MAX_DELTA; delta++) {
+			for (size_t len = 0; len <= MAX_LEN; len++) {
+				int base = GUARD + MAX_DELTA + src_off;
+
+				fill(dest_buf, BUF_SIZE, len);
+				memcpy(expect, dest_buf, BUF_SIZE);
+				memmove(expect + base + delta, expect + base, len);
+
+				if (libos_memmove(dest_buf + base + delta,
+				                  dest_buf + base, len) !=
+				    dest_buf + base + delta)
+					fail("memmove return", src_off,
+					     src_off + delta, len);
+
+				if (memcmp(dest_buf, expect, BUF_SIZE))
+					fail("memmove", src_off, src_off + delta, len);
+			}
+		}
+	}
+}
+
+/* Sources that start or end at a page boundary, next to a page that
+ * can't be read.  A stray access faults.
+ */
+static void check_bounds(void)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	unsigned char *pages, *start, *end;
+
+	if (posix_memalign((void **)&pages, page, page * 3)) {
+		printf("FAIL: can't allocate pages\n");
+		failures++;
+		return;
+	}
+
+	start = pages + page;
+	end = pages + page * 2;
+	fill(start, page, 3);
+
+	if (mprotect(pages, page, PROT_NONE) ||
+	    mprotect(end, page, PROT_NONE)) {
+		perror("mprotect");
+		failures++;
+		return;
+	}
+
+	for (int dest_off = 0; dest_off < MAX_ALIGN; dest_off++) {
+		for (size_t len = 1; len <= MAX_LEN; len++) {
+			unsigned char *dest = dest_buf + GUARD + dest_off;
+
+			libos_memcpy(dest, start, len);
+			if (memcmp(dest, start, len))
+				fail("memcpy from page start", 0, dest_off, len);
+
+			libos_memcpy(dest, end - len, len);
+			if (memcmp(dest, end - len, len))
+				fail("memcpy to page end", 0, dest_off, len);
+
+			/* Backward, then forward, within the page */
+			memcpy(expect, start, len);
+			libos_memmove(start + dest_off, start, len);
+			if (memcmp(start + dest_off, expect, len))
+				fail("memmove from page start", 0, dest_off, len);
+
+			memcpy(expect, end - len, len);
+			libos_memmove(end - len - dest_off, end - len, len);
+			if (memcmp(end - len - dest_off, expect, len))
+				fail("memmove to page end", 0, dest_off, len);
+		}
+	}
+
+	mprotect(pages, page * 3, PROT_READ | PROT_WRITE);
+	free(pages);
+}
+
+int main(void)
+{
+	check_merge();
+	check_memcpy();
+	check_memmove();
+	check_bounds();
+
+	if (failures) {
+		printf("%lu failures\n", failures);
+		return 1;
+	}
+
+	printf("memcpy and memmove correct for all alignments up to %d, "
+	       "lengths up to %d\n", MAX_ALIGN, MAX_LEN);
+	return 0;
+}
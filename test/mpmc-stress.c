@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Stress test for mpmc-queue.c.
+ *
+ * Producer threads write fixed-size records, sometimes several per
+ * reservation.  Consumer threads read a random multiple of the record
+ * size at a time.  Since every reservation on both sides is a
+ * multiple of the record size, so is every read, and each record must
+ * come out intact, exactly once, and in order relative to the other
+ * records from the same producer.
+ *
+ * usage: mpmc-stress [producers [consumers [records per producer]]]
+ *
+ * This only finds ordering bugs if the threads really run in parallel,
+ * so run it on a host with several cpus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libos/mpmc-queue.h>
+#include <libos/errors.h>
+
+#include "host.h"
+
+#define QUEUE_SIZE 4096
+#define MAX_BATCH  4
+
+typedef struct record {
+	uint32_t producer;
+	uint32_t seq;
+	uint32_t payload;
+	uint32_t check;
+} record_t;
+
+static mpmc_queue_t queue;
+static int producers, consumers;
+static uint32_t records = 200000;
+
+static uint8_t *seen;
+static unsigned long consumed;
+static int failed;
+
+static uint32_t payload(uint32_t producer, uint32_t seq)
+{
+	return (producer * 0x9e3779b9) ^ (seq * 0x85ebca6b);
+}
+
+static uint32_t checkword(const record_t *rec)
+{
+	return rec->producer ^ rec->seq ^ rec->payload ^ 0x5a5a5a5a;
+}
+
+static void fail(const char *msg, const record_t *rec)
+{
+	__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+	fprintf(stderr, "FAIL: %s: producer %u seq %u payload %#x check %#x\n",
+	        msg, rec->producer, rec->seq, rec->payload, rec->check);
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void *producer(void *arg)
+{
+	uint32_t id = (uintptr_t)arg;
+	uint32_t rand = id * 2654435761U + 1;
+	uint32_t seq = 0;
+
+	host_cpu_init(id);
+
+	while (seq < records) {
+		record_t recs[MAX_BATCH];
+		mpmc_resv_t resv;
+		int n = next_rand(&rand) % MAX_BATCH + 1;
+		int i;
+
+		if (n > records - seq)
+			n = records - seq;
+
+		for (i = 0; i < n; i++) {
+			recs[i].producer = id;
+			recs[i].seq = seq + i;
+			recs[i].payload = payload(id, seq + i);
+			recs[i].check = checkword(&recs[i]);
+		}
+
+		/* Alternate between the one-shot and reservation APIs. */
+		if (n == 1) {
+			while (mpmc_queue_write(&queue, (uint8_t *)recs,
+			                        sizeof(record_t)) == ERR_BUSY)
+				sched_yield();
+		} else {
+			while (mpmc_queue_reserve_write(&queue, &resv,
+			                                n * sizeof(record_t)))
+				sched_yield();
+
+			for (i = 0; i < n; i++)
+				mpmc_queue_copy_in(&queue, &resv, i * sizeof(record_t),
+				                   (uint8_t *)&recs[i], sizeof(record_t));
+
+			mpmc_queue_commit_write(&queue, &resv);
+		}
+
+		seq += n;
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	uint32_t id = (uintptr_t)arg;
+	uint32_t rand = id * 2246822519U + 1;
+	uint32_t *last = calloc(producers, sizeof(uint32_t));
+	unsigned long total = (unsigned long)producers * records;
+
+	host_cpu_init(producers + id);
+
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < total &&
+	       !__atomic_load_n(&failed, __ATOMIC_RELAXED)) {
+		record_t recs[MAX_BATCH];
+		mpmc_resv_t resv;
+		size_t len, want;
+		int i, n;
+
+		want = (next_rand(&rand) % MAX_BATCH + 1) * sizeof(record_t);
+		len = mpmc_queue_reserve_read(&queue, &resv, want);
+		if (len == 0) {
+			sched_yield();
+			continue;
+		}
+
+		if (len % sizeof(record_t) || len > want) {
+			record_t dummy = {};
+			fail("bad read length", &dummy);
+			break;
+		}
+
+		n = len / sizeof(record_t);
+		mpmc_queue_copy_out(&queue, &resv, 0, (uint8_t *)recs, len);
+
+		mpmc_queue_commit_read(&queue, &resv);
+
+		for (i = 0; i < n; i++) {
+			record_t *rec = &recs[i];
+
+			if (rec->producer >= producers || rec->seq >= records ||
+			    rec->payload != payload(rec->producer, rec->seq) ||
+			    rec->check != checkword(rec)) {
+				fail("corrupt record", rec);
+				continue;
+			}
+
+			if (rec->seq && rec->seq <= last[rec->producer])
+				fail("out of order", rec);
+
+			last[rec->producer] = rec->seq;
+
+			if (__atomic_fetch_add(&seen[rec->producer * records + rec->seq],
+			                       1, __ATOMIC_RELAXED))
+				fail("duplicate", rec);
+		}
+
+		__atomic_fetch_add(&consumed, n, __ATOMIC_RELAXED);
+	}
+
+	free(last);
+	return NULL;
+}
+
+/* A lost commit leaves every thread spinning; report it rather than
+ * hang.
+ */
+static void watchdog(unsigned long total)
+{
+	struct timespec tick = { .tv_nsec = 10000000 };
+	unsigned long last = 0, now;
+	int idle = 0;
+
+	while ((now = __atomic_load_n(&consumed, __ATOMIC_RELAXED)) < total &&
+	       !__atomic_load_n(&failed, __ATOMIC_RELAXED)) {
+		idle = now == last ? idle + 1 : 0;
+		last = now;
+
+		if (idle == 1000) {
+			fprintf(stderr, "FAIL: no progress after %lu records: "
+			        "prod_head %u prod_tail %u cons_head %u cons_tail %u\n",
+			        now, queue.prod_head, queue.prod_tail,
+			        queue.cons_head, queue.cons_tail);
+			exit(1);
+		}
+
+		nanosleep(&tick, NULL);
+	}
+}
+
+static void test_init(void)
+{
+	mpmc_queue_t q;
+
+	if (mpmc_queue_init(&q, 0) != ERR_INVALID ||
+	    mpmc_queue_init(&q, 48) != ERR_INVALID) {
+		fprintf(stderr, "FAIL: bad sizes accepted\n");
+		exit(1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[HOST_MAX_CPUS];
+	uint64_t start;
+	int i;
+
+	/* Commits wait for earlier reservations on the same side, by
+	 * spinning.  With more threads than cpus, a waiter can spin away
+	 * whole time slices while the thread it waits for is preempted,
+	 * so by default there are no more threads than cpus.
+	 */
+	producers = sysconf(_SC_NPROCESSORS_ONLN) / 2;
+	if (producers < 1)
+		producers = 1;
+	if (producers > HOST_MAX_CPUS / 2)
+		producers = HOST_MAX_CPUS / 2;
+
+	consumers = producers;
+
+	if (argc > 1)
+		producers = atoi(argv[1]);
+	if (argc > 2)
+		consumers = atoi(argv[2]);
+	if (argc > 3)
+		records = strtoul(argv[3], NULL, 0);
+
+	if (producers < 1 || consumers < 1 ||
+	    producers + consumers > HOST_MAX_CPUS) {
+		fprintf(stderr, "usage: %s [producers [consumers [records]]]\n",
+		        argv[0]);
+		return 2;
+	}
+
+	test_init();
+
+	if (mpmc_queue_init(&queue, QUEUE_SIZE)) {
+		fprintf(stderr, "FAIL: mpmc_queue_init\n");
+		return 1;
+	}
+
+	seen = calloc((size_t)producers * records, 1);
+	start = host_time_ns();
+
+	for (i = 0; i < producers; i++)
+		pthread_create(&threads[i], NULL, producer, (void *)(uintptr_t)i);
+	for (i = 0; i < consumers; i++)
+		pthread_create(&threads[producers + i], NULL, consumer,
+		               (void *)(uintptr_t)i);
+
+	watchdog((unsigned long)producers * records);
+
+	for (i = 0; i < producers + consumers; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; !failed && i < producers * records; i++) {
+		if (seen[i] != 1) {
+			fprintf(stderr, "FAIL: producer %u seq %u seen %u times\n",
+			        i / records, i % records, seen[i]);
+			failed = 1;
+		}
+	}
+
+	if (failed)
+		return 1;
+
+	printf("%d producers, %d consumers: %lu records in %.2f s\n",
+	       producers, consumers, consumed,
+	       (host_time_ns() - start) / 1e9);
+	return 0;
+}
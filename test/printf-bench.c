@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Throughput of libos's snprintf, next to the host's for scale.
+ *
+ * usage: printf-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "libos-libc.h"
+#include "host.h"
+
+static char buf[256];
+static unsigned long iters;
+
+#define BENCH(name, ...) do { \
+	uint64_t t0, t1, t2; \
+	unsigned long i; \
+	\
+	t0 = host_time_ns(); \
+	for (i = 0; i < iters; i++) \
+		libos_snprintf(buf, sizeof(buf), __VA_ARGS__); \
+	t1 = host_time_ns(); \
+	for (i = 0; i < iters; i++) \
+		snprintf(buf, sizeof(buf), __VA_ARGS__); \
+	t2 = host_time_ns(); \
+	\
+	printf("%-20s %8.1f ns %8.1f ns\n", name, \
+	       (double)(t1 - t0) / iters, (double)(t2 - t1) / iters); \
+} while (0)
+
+int main(int argc, char *argv[])
+{
+	/* volatile, so that gcc can't format anything at compile time */
+	volatile unsigned int u32 = 3735928559U;
+	volatile unsigned long long u64 = 18446744073709551557ULL;
+	volatile int i32 = -123456;
+	const char *volatile str = "ns16550";
+
+	iters = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+
+	printf("%-20s %11s %11s\n", "", "libos", "host");
+
+	BENCH("literal", "no conversions here\n");
+	BENCH("%d", "%d", i32);
+	BENCH("%u, 32-bit", "%u", u32);
+	BENCH("%llu, 64-bit", "%llu", u64);
+	BENCH("%llx", "%llx", u64);
+	BENCH("%08x", "%08x", u32);
+	BENCH("%s", "%s", str);
+	BENCH("printlog-style",
+	      "%s: irq %d at 0x%08x, count %llu\n", str, i32, u32, u64);
+
+	return 0;
+}
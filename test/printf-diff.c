@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Differential test of libos's snprintf against the host's.
+ *
+ * Random conversions, with every flag, width, precision and length
+ * modifier that sprintf.c implements, are formatted by both and must
+ * produce the same output and return value.  Combinations that C
+ * leaves undefined, and %p, which libos prints without the "0x", are
+ * not generated.  Output is also truncated at random buffer sizes.
+ *
+ * usage: printf-diff [iterations [seed]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#include "libos-libc.h"
+
+enum kind {
+	K_INT, K_LONG, K_LLONG, K_SIZE, K_PTRDIFF, K_INTMAX, K_STR,
+};
+
+struct arg {
+	enum kind kind;
+	int nstar;
+	int star[2];
+	int64_t val;
+	const char *str;
+};
+
+/* Call fn with the stars, then the value, passed as the right type. */
+#define CALL_STARS(fn, buf, size, fmt, a, v) \
+	((a)->nstar == 0 ? fn(buf, size, fmt, v) : \
+	 (a)->nstar == 1 ? fn(buf, size, fmt, (a)->star[0], v) : \
+	 fn(buf, size, fmt, (a)->star[0], (a)->star[1], v))
+
+#define CALL(fn, buf, size, fmt, a) ({ \
+	int __ret; \
+	switch ((a)->kind) { \
+	case K_INT: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (int)(a)->val); \
+		break; \
+	case K_LONG: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (long)(a)->val); \
+		break; \
+	case K_LLONG: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (long long)(a)->val); \
+		break; \
+	case K_SIZE: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (size_t)(a)->val); \
+		break; \
+	case K_PTRDIFF: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (ptrdiff_t)(a)->val); \
+		break; \
+	case K_INTMAX: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (intmax_t)(a)->val); \
+		break; \
+	default: \
+		__ret = CALL_STARS(fn, buf, size, fmt, a, (a)->str); \
+		break; \
+	} \
+	__ret; \
+})
+
+#define BUF_SIZE 256
+
+static const char *const strings[] = {
+	"", "a", "hello", "hello, world", "0123456789abcdefghijklmnopqrstuvwxyz",
+};
+
+static unsigned long failures;
+
+/* Hidden from gcc's format checking */
+static const char *volatile null_str;
+
+static void check(const char *fmt, size_t size, const struct arg *a)
+{
+	char expect[BUF_SIZE], got[BUF_SIZE];
+	int expect_ret, got_ret;
+
+	memset(expect, 0x5a, sizeof(expect));
+	memset(got, 0x5a, sizeof(got));
+
+	expect_ret = CALL(snprintf, expect, size, fmt, a);
+	got_ret = CALL(libos_snprintf, got, size, fmt, a);
+
+	if (expect_ret == got_ret && !memcmp(expect, got, sizeof(got)))
+		return;
+
+	if (failures++ < 20) {
+		printf("FAIL: \"%s\", size %zu, stars %d %d %d, val %lld: "
+		       "expected %d \"%.*s\", got %d \"%.*s\"\n",
+		       fmt, size, a->nstar, a->star[0], a->star[1],
+		       (long long)a->val,
+		       expect_ret, (int)strnlen(expect, size), expect,
+		       got_ret, (int)strnlen(got, size), got);
+	}
+}
+
+/* xorshift64*, so that a seed gives the same cases on any host */
+static uint64_t rng_state;
+
+static uint64_t random64(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static unsigned int rnd(unsigned int n)
+{
+	return (random64() >> 32) % n;
+}
+
+static int64_t random_value(void)
+{
+	static const int64_t edges[] = {
+		0, 1, -1, 9, 10, 99, 100, INT_MAX, INT_MIN, UINT_MAX,
+		LLONG_MAX, LLONG_MIN, 4294967296LL, 10000000000LL,
+		-10000000000LL, 18446744073709551615ULL,
+	};
+
+	if (rnd(4) == 0)
+		return edges[rnd(sizeof(edges) / sizeof(edges[0]))];
+
+	return random64() >> rnd(64);
+}
+
+/* Width or precision, sometimes negative when passed as a '*' arg. */
+static int random_field(int star)
+{
+	int val = rnd(3) ? rnd(12) : rnd(40);
+
+	return star && rnd(4) == 0 ? -val : val;
+}
+
+static void random_case(void)
+{
+	static const char *const lengths[] = {
+		"", "hh", "h", "l", "ll", "j", "t", "z",
+	};
+	static const enum kind length_kinds[] = {
+		K_INT, K_INT, K_INT, K_LONG, K_LLONG, K_INTMAX, K_PTRDIFF, K_SIZE,
+	};
+	static const char convs[] = "diouxXcs";
+	char fmt[64], *p = fmt;
+	struct arg a = { .nstar = 0 };
+	char conv = convs[rnd(sizeof(convs) - 1)];
+	int numeric = conv != 'c' && conv != 's';
+	int len = 0;
+	size_t size;
+
+	if (rnd(4) == 0)
+		p += sprintf(p, "ab%%%%c");
+
+	*p++ = '%';
+
+	/* Flags, with repeats */
+	for (int i = rnd(5); i > 0; i--) {
+		switch (rnd(6)) {
+		case 0:
+			if (conv == 'o' || conv == 'x' || conv == 'X')
+				*p++ = '#';
+			break;
+		case 1:
+			if (numeric)
+				*p++ = '0';
+			break;
+		case 2:
+			*p++ = '-';
+			break;
+		case 3:
+			*p++ = ' ';
+			break;
+		case 4:
+			*p++ = '+';
+			break;
+		case 5:
+			*p++ = '\'';
+			break;
+		}
+	}
+
+	switch (rnd(3)) {
+	case 1:
+		p += sprintf(p, "%d", random_field(0));
+		break;
+	case 2:
+		*p++ = '*';
+		a.star[a.nstar++] = random_field(1);
+		break;
+	}
+
+	if (conv != 'c') {
+		switch (rnd(4)) {
+		case 1:
+			*p++ = '.';
+			break;
+		case 2:
+			p += sprintf(p, ".%d", random_field(0));
+			break;
+		case 3:
+			p += sprintf(p, ".*");
+			a.star[a.nstar++] = random_field(1);
+			break;
+		}
+	}
+
+	if (numeric) {
+		len = rnd(8);
+		p += sprintf(p, "%s", lengths[len]);
+	}
+
+	*p++ = conv;
+
+	if (rnd(4) == 0)
+		p += sprintf(p, " %%%% x");
+
+	*p = 0;
+
+	a.kind = conv == 's' ? K_STR : length_kinds[len];
+	a.val = random_value();
+	a.str = strings[rnd(sizeof(strings) / sizeof(strings[0]))];
+
+	if (conv == 'c')
+		a.val = ' ' + rnd(95);
+
+	size = rnd(4) ? BUF_SIZE : rnd(40);
+	check(fmt, size, &a);
+}
+
+/* Formats with several conversions, and the literal edge cases. */
+static void fixed_cases(void)
+{
+	char expect[BUF_SIZE], got[BUF_SIZE];
+	int expect_ret, got_ret, n1 = -1, n2 = -1;
+
+#define FIXED(...) do { \
+	expect_ret = snprintf(expect, sizeof(expect), __VA_ARGS__); \
+	got_ret = libos_snprintf(got, sizeof(got), __VA_ARGS__); \
+	if (expect_ret != got_ret || strcmp(expect, got)) { \
+		printf("FAIL: %s: expected \"%s\", got \"%s\"\n", \
+		       #__VA_ARGS__, expect, got); \
+		failures++; \
+	} \
+} while (0)
+
+	FIXED("%s", "");
+	FIXED("%%");
+	FIXED("no conversions");
+	FIXED("%d %s %c %x %o %u", -42, "str", 'c', 0xbeefU, 8U, 7U);
+	FIXED("%lld %llu %llx", LLONG_MIN, ULLONG_MAX, ULLONG_MAX);
+	FIXED("%hhd %hhu %hd %hu", 0x1ff, 0x1ff, 0x1ffff, 0x1ffff);
+	FIXED("%*.*d|%-*.*d", 8, 4, -5, 8, 4, -5);
+	FIXED("%.0d|%.0x|%#.0o|%#.0x", 0, 0U, 0U, 0U);
+	FIXED("%#o|%#x|%#X|%#5.3o", 0U, 0U, 255U, 8U);
+	FIXED("%s", null_str);
+	FIXED("%10s|%-10s|%.3s", null_str, "ab", "abcdef");
+
+	memset(got, 0, sizeof(got));
+	libos_snprintf(got, sizeof(got), "abc%nde%hhnf", &n1, (signed char *)&n2);
+	if (strcmp(got, "abcdef") || n1 != 3 || (signed char)n2 != 5) {
+		printf("FAIL: %%n: \"%s\" %d %d\n", got, n1, (signed char)n2);
+		failures++;
+	}
+#undef FIXED
+}
+
+/* libos prints %p as hex without "0x" unless '#' is given. */
+static void pointer_cases(void)
+{
+	static const char *const flags[] = { "", "#", "-", "0", "#0", "#-" };
+	char pfmt[32], xfmt[32];
+	char expect[BUF_SIZE], got[BUF_SIZE];
+
+	for (int i = 0; i < 1000; i++) {
+		const char *f = flags[rnd(6)];
+		int width = rnd(24);
+		uintptr_t ptr = random64() >> rnd(64);
+
+		sprintf(pfmt, "%%%s%dp", f, width);
+		sprintf(xfmt, "%%%s%dlx", f, width);
+
+		snprintf(expect, sizeof(expect), xfmt, (unsigned long)ptr);
+		libos_snprintf(got, sizeof(got), pfmt, (void *)ptr);
+
+		if (strcmp(expect, got)) {
+			printf("FAIL: \"%s\" %#lx: expected \"%s\", got \"%s\"\n",
+			       pfmt, (unsigned long)ptr, expect, got);
+			failures++;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long iters = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+
+	rng_state = argc > 2 ? strtoull(argv[2], NULL, 0) : 1;
+
+	fixed_cases();
+	pointer_cases();
+
+	for (unsigned long i = 0; i < iters; i++)
+		random_case();
+
+	if (failures) {
+		printf("%lu failures\n", failures);
+		return 1;
+	}
+
+	printf("%lu random cases match the host snprintf\n", iters);
+	return 0;
+}
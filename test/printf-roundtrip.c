@@ -0,0 +1,560 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Round trip of printf arguments through printf_save_args() and
+ * vsnprintf_argv(), as binary log records use them.
+ *
+ * Each case is formatted directly with vsnprintf(), and again from
+ * arguments saved by printf_save_args(), with %s strings copied out
+ * as logbuf.c does; the two must match.  Cases cover every conversion
+ * and modifier sprintf.c implements, and malformed conversions, which
+ * must consume the same arguments in both.
+ *
+ * The cases are also written out as big-endian binary log records,
+ * with an ELF image holding their format strings, and decoded with
+ * logdecode, which must print the same text.
+ *
+ * usage: printf-roundtrip [iterations [seed]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <elf.h>
+
+#include <libos/logbuf.h>
+
+#include "libos-libc.h"
+
+#define BUF_SIZE 256
+
+/* Log buffer and ELF image handed to logdecode */
+#define DUMP_SIZE  (256 * 1024)
+#define DUMP_START (DUMP_SIZE - 4096)
+#define IMAGE_SIZE (256 * 1024)
+#define IMAGE_VADDR 0x100000
+#define IMAGE_DATA (sizeof(Elf32_Ehdr) + sizeof(Elf32_Phdr))
+
+static uint8_t dump[DUMP_SIZE];
+static size_t dump_tail = DUMP_START, dump_used;
+static uint8_t image[IMAGE_SIZE];
+static size_t image_used = IMAGE_DATA;
+
+/* What logdecode should print */
+static char *expect_log;
+static size_t expect_log_len;
+static unsigned int records;
+
+static unsigned long failures;
+
+/* Hidden from gcc's format checking */
+static const char *volatile null_str;
+
+static void put(uint8_t *p, uint64_t val, int size)
+{
+	for (int i = size - 1; i >= 0; i--) {
+		p[i] = val;
+		val >>= 8;
+	}
+}
+
+static void fail(const char *fmt, const char *expect, const char *got)
+{
+	if (failures++ < 20)
+		printf("FAIL: \"%s\": expected \"%s\", got \"%s\"\n",
+		       fmt, expect, got);
+}
+
+/* Append a record to the dump, as logbuf_reserve() would place it.
+ * Returns NULL if the dump is full.
+ */
+static uint8_t *dump_reserve(size_t size)
+{
+	size_t off = dump_tail % DUMP_SIZE;
+	size_t pad = DUMP_SIZE - off < size ? DUMP_SIZE - off : 0;
+
+	size = (size + LOGREC_ALIGN - 1) & ~(size_t)(LOGREC_ALIGN - 1);
+
+	/* Leave room to tell the last record from the first. */
+	if (dump_used + pad + size + LOGREC_ALIGN > DUMP_SIZE)
+		return NULL;
+
+	if (pad) {
+		put(&dump[off], LOGREC_READY | LOGREC_PAD | pad, 4);
+		off = 0;
+	}
+
+	dump_tail += pad + size;
+	dump_used += pad + size;
+	return &dump[off];
+}
+
+static void log_expect(uint64_t tb, const char *text)
+{
+	size_t len = snprintf(NULL, 0, "[%llu] %s", (unsigned long long)tb, text);
+
+	expect_log = realloc(expect_log, expect_log_len + len + 1);
+	sprintf(expect_log + expect_log_len, "[%llu] %s",
+	        (unsigned long long)tb, text);
+	expect_log_len += len;
+}
+
+/* Write a binary record, laid out as by logbuf_append_binary(). */
+static void log_binary(const char *fmt, const uint64_t *argv, int argc,
+                       uint32_t strmask, const char *text)
+{
+	size_t fmtlen = strlen(fmt) + 1;
+	size_t strsize = 0, size, off = 0;
+	uint64_t tb = records * 1000ULL + 7;
+	uint8_t *rec, *words;
+	char *strbase;
+
+	if (image_used + fmtlen > IMAGE_SIZE || argc > LOGREC_MAX_ARGS)
+		return;
+
+	for (int i = 0; i < argc; i++)
+		if ((strmask & (1U << i)) && argv[i])
+			strsize += strlen((const char *)(uintptr_t)argv[i]) + 1;
+
+	size = sizeof(logrec_t) + (argc + 1) * 8 + strsize;
+	rec = dump_reserve(size);
+	if (!rec)
+		return;
+
+	memcpy(&image[image_used], fmt, fmtlen);
+
+	words = rec + sizeof(logrec_t);
+	strbase = (char *)words + (argc + 1) * 8;
+	put(words, IMAGE_VADDR + image_used, 8);
+	image_used += fmtlen;
+
+	for (int i = 0; i < argc; i++) {
+		const char *str = (const char *)(uintptr_t)argv[i];
+
+		if (!(strmask & (1U << i))) {
+			put(words + (i + 1) * 8, argv[i], 8);
+		} else if (!str) {
+			put(words + (i + 1) * 8, PRINTF_NULL_STR, 8);
+		} else {
+			strcpy(&strbase[off], str);
+			put(words + (i + 1) * 8, off, 8);
+			off += strlen(str) + 1;
+		}
+	}
+
+	put(rec + offsetof(logrec_t, len), argc, 2);
+	put(rec + offsetof(logrec_t, tb), tb, 8);
+	put(rec + offsetof(logrec_t, info),
+	    LOGREC_READY | LOGREC_BINARY | ((size + 7) & ~7), 4);
+
+	log_expect(tb, text);
+	records++;
+}
+
+static void log_text(const char *text)
+{
+	size_t len = strlen(text);
+	uint64_t tb = records * 1000ULL + 7;
+	uint8_t *rec = dump_reserve(sizeof(logrec_t) + len + 1);
+
+	if (!rec)
+		return;
+
+	memcpy(rec + sizeof(logrec_t), text, len + 1);
+	put(rec + offsetof(logrec_t, len), len, 2);
+	put(rec + offsetof(logrec_t, tb), tb, 8);
+	put(rec + offsetof(logrec_t, info),
+	    LOGREC_READY | ((sizeof(logrec_t) + len + 1 + 7) & ~7), 4);
+
+	log_expect(tb, text);
+	records++;
+}
+
+static void roundtrip(const char *fmt, ...)
+{
+	char expect[BUF_SIZE], got[BUF_SIZE], strbase[BUF_SIZE];
+	uint64_t argv[32], saved[32];
+	int expect_ret, got_ret, argc;
+	va_list args, args2;
+	uint32_t strmask;
+	size_t off = 0;
+
+	va_start(args, fmt);
+	va_copy(args2, args);
+
+	argc = libos_printf_save_args(fmt, args2, saved, 32, &strmask);
+	expect_ret = libos_vsnprintf(expect, sizeof(expect), fmt, args);
+
+	va_end(args2);
+	va_end(args);
+
+	if (argc < 0) {
+		fail(fmt, "saved arguments", "too many");
+		return;
+	}
+
+	/* Copy strings out, as logbuf_append_binary() does. */
+	for (int i = 0; i < argc; i++) {
+		const char *str = (const char *)(uintptr_t)saved[i];
+
+		if (!(strmask & (1U << i))) {
+			argv[i] = saved[i];
+		} else if (!str) {
+			argv[i] = PRINTF_NULL_STR;
+		} else {
+			strcpy(&strbase[off], str);
+			argv[i] = off;
+			off += strlen(str) + 1;
+		}
+	}
+
+	got_ret = libos_vsnprintf_argv(got, sizeof(got), fmt, argv, strbase);
+
+	if (expect_ret != got_ret || strcmp(expect, got)) {
+		fail(fmt, expect, got);
+		return;
+	}
+
+	if (strchr(expect, '\n'))
+		log_binary(fmt, saved, argc, strmask, expect);
+}
+
+/* xorshift64*, so that a seed gives the same cases on any host */
+static uint64_t rng_state;
+
+static uint64_t random64(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static unsigned int rnd(unsigned int n)
+{
+	return (random64() >> 32) % n;
+}
+
+static int64_t random_value(void)
+{
+	static const int64_t edges[] = {
+		0, 1, -1, 0x7f, 0x80, 0xff, 0x8000, 0xffff, INT_MAX, INT_MIN,
+		UINT_MAX, LLONG_MAX, LLONG_MIN, 0x100000000LL,
+	};
+
+	if (rnd(3) == 0)
+		return edges[rnd(sizeof(edges) / sizeof(edges[0]))];
+
+	return random64() >> rnd(64);
+}
+
+enum kind {
+	K_INT, K_LONG, K_LLONG, K_SIZE, K_PTRDIFF, K_INTMAX, K_PTR, K_NONE,
+};
+
+/* Call roundtrip() with the stars, then the value as the right type. */
+#define CALL_STARS(fmt, nstar, star, v) \
+	((nstar) == 0 ? roundtrip(fmt, v) : \
+	 (nstar) == 1 ? roundtrip(fmt, (star)[0], v) : \
+	 roundtrip(fmt, (star)[0], (star)[1], v))
+
+static void random_case(void)
+{
+	static const char *const lengths[] = {
+		"", "hh", "h", "l", "ll", "j", "t", "z",
+	};
+	static const enum kind length_kinds[] = {
+		K_INT, K_INT, K_INT, K_LONG, K_LLONG, K_INTMAX, K_PTRDIFF, K_SIZE,
+	};
+	static const char *const strings[] = {
+		"", "a", "hello", "0123456789abcdefghijklmnopqrstuvwxyz",
+	};
+	static const char flags[] = "#0- +'";
+	static const char convs[] = "diouxXcspn%";
+	static long long n_target;
+	char fmt[64], *p = fmt;
+	char conv = convs[rnd(sizeof(convs) - 1)];
+	int nstar = 0, star[2];
+	enum kind kind = K_NONE;
+	int64_t val = random_value();
+	const void *ptr = NULL;
+	int len = rnd(8);
+
+	*p++ = '%';
+
+	for (int i = rnd(4); i > 0; i--)
+		*p++ = flags[rnd(sizeof(flags) - 1)];
+
+	switch (rnd(3)) {
+	case 1:
+		p += sprintf(p, "%d", 1 + rnd(30));
+		break;
+	case 2:
+		*p++ = '*';
+		star[nstar++] = (int)rnd(61) - 30;
+		break;
+	}
+
+	switch (rnd(4)) {
+	case 1:
+		*p++ = '.';
+		break;
+	case 2:
+		p += sprintf(p, ".%d", rnd(30));
+		break;
+	case 3:
+		p += sprintf(p, ".*");
+		star[nstar++] = (int)rnd(61) - 30;
+		break;
+	}
+
+	switch (conv) {
+	case 'c':
+		kind = K_INT;
+		val = ' ' + rnd(95);
+		break;
+	case 's':
+		kind = K_PTR;
+		ptr = rnd(8) ? strings[rnd(4)] : null_str;
+		break;
+	case 'p':
+		kind = K_PTR;
+		ptr = (void *)(uintptr_t)val;
+		break;
+	case 'n':
+		kind = K_PTR;
+		ptr = &n_target;
+		p += sprintf(p, "%s", lengths[len]);
+		break;
+	case '%':
+		break;
+	default:
+		kind = length_kinds[len];
+		p += sprintf(p, "%s", lengths[len]);
+		break;
+	}
+
+	sprintf(p, "%c\n", conv);
+
+	switch (kind) {
+	case K_INT:
+		CALL_STARS(fmt, nstar, star, (int)val);
+		break;
+	case K_LONG:
+		CALL_STARS(fmt, nstar, star, (long)val);
+		break;
+	case K_LLONG:
+		CALL_STARS(fmt, nstar, star, (long long)val);
+		break;
+	case K_SIZE:
+		CALL_STARS(fmt, nstar, star, (size_t)val);
+		break;
+	case K_PTRDIFF:
+		CALL_STARS(fmt, nstar, star, (ptrdiff_t)val);
+		break;
+	case K_INTMAX:
+		CALL_STARS(fmt, nstar, star, (intmax_t)val);
+		break;
+	case K_PTR:
+		CALL_STARS(fmt, nstar, star, ptr);
+		break;
+	case K_NONE:
+		CALL_STARS(fmt, nstar, star, 0);
+		break;
+	}
+}
+
+/* Several conversions at once, and conversions that __vsnprintf()
+ * abandons partway, after which the rest of the format is literal.
+ * Every argument is a string, so that whichever ones a conversion
+ * takes are valid for it.
+ */
+static void fixed_cases(void)
+{
+	static const char *const malformed[] = {
+		"%5*d %s\n",
+		"%.5*d %s\n",
+		"%.*5d %s\n",
+		"%**d %s\n",
+		"%*.*3s %s\n",
+		"%-*5d %s\n",
+		"%0*d %s\n",
+		"%.*.*d %s\n",
+		"%*%%s\n",
+		"%.*%%s\n",
+		"%q %s\n",
+		"%5.3q %s\n",
+		"%hq %s\n",
+		"%L %s\n",
+		"%10.*s %s\n",
+		"%s %",
+	};
+	const char *a[4] = { "one", "two", "three", "four" };
+	long long n;
+
+	for (int i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+		roundtrip(malformed[i], a[0], a[1], a[2], a[3]);
+
+	roundtrip("%d %s %c %x %o %u %p\n",
+	          -42, "str", 'c', 0xbeefU, 8U, 7U, (void *)0x1234);
+	roundtrip("%lld %llu %llx %jd %zu %td\n", LLONG_MIN, ULLONG_MAX,
+	          ULLONG_MAX, (intmax_t)-1, (size_t)-1, (ptrdiff_t)-1);
+	roundtrip("%hhd %hhu %hd %hu %ld %lu\n",
+	          0x1ff, 0x1ff, 0x1ffff, 0x1ffff, -1L, -1UL);
+	roundtrip("%s|%10s|%.3s|%-6s|%n\n", null_str, null_str, "abcdef",
+	          "ab", &n);
+	roundtrip("%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d\n",
+	          1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+	roundtrip("%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n",
+	          "a", "b", "c", "d", "e", "f", "g", "h",
+	          "i", "j", "k", "l", "m", "n", "o", "p");
+}
+
+static int write_file(const char *name, const void *data, size_t size)
+{
+	FILE *f = fopen(name, "wb");
+
+	if (!f || fwrite(data, 1, size, f) != size || fclose(f)) {
+		perror(name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* A 32-bit big-endian PowerPC image with the format strings in one
+ * loadable segment.
+ */
+static void make_image(void)
+{
+	uint8_t *ph = image + sizeof(Elf32_Ehdr);
+
+	memcpy(image, ELFMAG, SELFMAG);
+	image[EI_CLASS] = ELFCLASS32;
+	image[EI_DATA] = ELFDATA2MSB;
+	image[EI_VERSION] = EV_CURRENT;
+
+	put(image + offsetof(Elf32_Ehdr, e_type), ET_EXEC, 2);
+	put(image + offsetof(Elf32_Ehdr, e_machine), EM_PPC, 2);
+	put(image + offsetof(Elf32_Ehdr, e_version), EV_CURRENT, 4);
+	put(image + offsetof(Elf32_Ehdr, e_phoff), sizeof(Elf32_Ehdr), 4);
+	put(image + offsetof(Elf32_Ehdr, e_ehsize), sizeof(Elf32_Ehdr), 2);
+	put(image + offsetof(Elf32_Ehdr, e_phentsize), sizeof(Elf32_Phdr), 2);
+	put(image + offsetof(Elf32_Ehdr, e_phnum), 1, 2);
+
+	put(ph + offsetof(Elf32_Phdr, p_type), PT_LOAD, 4);
+	put(ph + offsetof(Elf32_Phdr, p_offset), IMAGE_DATA, 4);
+	put(ph + offsetof(Elf32_Phdr, p_vaddr), IMAGE_VADDR + IMAGE_DATA, 4);
+	put(ph + offsetof(Elf32_Phdr, p_filesz), image_used - IMAGE_DATA, 4);
+	put(ph + offsetof(Elf32_Phdr, p_memsz), image_used - IMAGE_DATA, 4);
+}
+
+/* Run logdecode, from the same directory as this program. */
+static void check_decode(const char *argv0)
+{
+	char image_name[] = "/tmp/roundtrip-image.XXXXXX";
+	char dump_name[] = "/tmp/roundtrip-dump.XXXXXX";
+	const char *slash = strrchr(argv0, '/');
+	char cmd[PATH_MAX * 2];
+	char *out = NULL;
+	size_t out_len = 0, n;
+	FILE *f;
+	int fd;
+
+	make_image();
+
+	if ((fd = mkstemp(image_name)) < 0 || close(fd) ||
+	    (fd = mkstemp(dump_name)) < 0 || close(fd) ||
+	    write_file(image_name, image, image_used) ||
+	    write_file(dump_name, dump, DUMP_SIZE)) {
+		failures++;
+		goto out;
+	}
+
+	snprintf(cmd, sizeof(cmd), "%.*slogdecode -s %d %s %s",
+	         slash ? (int)(slash - argv0 + 1) : 0, argv0,
+	         DUMP_START, image_name, dump_name);
+
+	f = popen(cmd, "r");
+	if (!f) {
+		perror("logdecode");
+		failures++;
+		goto out;
+	}
+
+	do {
+		out = realloc(out, out_len + 65536 + 1);
+		n = fread(out + out_len, 1, 65536, f);
+		out_len += n;
+	} while (n);
+
+	out[out_len] = 0;
+
+	if (pclose(f)) {
+		printf("FAIL: %s failed\n", cmd);
+		failures++;
+	} else if (out_len != expect_log_len || strcmp(out, expect_log)) {
+		size_t i = 0;
+
+		while (i < out_len && out[i] == expect_log[i])
+			i++;
+
+		printf("FAIL: logdecode output differs at \"%.40s\", "
+		       "expected \"%.40s\"\n", out + i, expect_log + i);
+		failures++;
+	}
+
+out:
+	unlink(image_name);
+	unlink(dump_name);
+	free(out);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long iters = argc > 1 ? strtoul(argv[1], NULL, 0) : 50000;
+
+	rng_state = argc > 2 ? strtoull(argv[2], NULL, 0) : 1;
+
+	log_text("a text record\n");
+	fixed_cases();
+
+	for (unsigned long i = 0; i < iters; i++)
+		random_case();
+
+	log_text("the last record\n");
+	check_decode(argv[0]);
+
+	if (failures) {
+		printf("%lu failures\n", failures);
+		return 1;
+	}
+
+	printf("%lu random cases round trip, %u records decoded\n",
+	       iters, records);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Cross-thread throughput of queue_t, one producer and one consumer.
+ *
+ * Built twice, as queue-bench and queue-bench-padded, with and without
+ * CONFIG_LIBOS_QUEUE_PADDED.  For a cross-core number, run it where
+ * the two threads get separate cores, e.g. with taskset on a host
+ * with at least two.  Both sides yield when the queue is full or empty,
+ * so on a single cpu this measures context switches, not cache traffic.
+ *
+ * usage: queue-bench [megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <libos/queue.h>
+#include <libos/errors.h>
+
+#include "host.h"
+
+#define QUEUE_SIZE 4096
+#define CHUNK      64
+
+static queue_t queue;
+static unsigned long total;
+static int chunked;
+
+static void *producer(void *arg)
+{
+	uint8_t buf[CHUNK];
+	unsigned long sent = 0;
+	int i;
+
+	host_cpu_init(0);
+
+	while (sent < total) {
+		if (!chunked) {
+			while (queue_writechar(&queue, sent % 251))
+				sched_yield();
+
+			sent++;
+			continue;
+		}
+
+		for (i = 0; i < CHUNK; i++)
+			buf[i] = (sent + i) % 251;
+
+		for (i = 0; i < CHUNK; ) {
+			int len = queue_write(&queue, buf + i, CHUNK - i);
+
+			if (len == 0)
+				sched_yield();
+
+			i += len;
+		}
+
+		sent += CHUNK;
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	uint8_t buf[CHUNK];
+	unsigned long recvd = 0;
+	int i, len;
+
+	host_cpu_init(1);
+
+	while (recvd < total) {
+		if (!chunked) {
+			int c = queue_readchar(&queue, 0);
+
+			if (c == ERR_WOULDBLOCK) {
+				sched_yield();
+				continue;
+			}
+
+			if (c != recvd % 251)
+				goto bad;
+
+			recvd++;
+			continue;
+		}
+
+		len = queue_read(&queue, buf, CHUNK, 0);
+		if (len == 0)
+			sched_yield();
+
+		for (i = 0; i < len; i++)
+			if (buf[i] != (recvd + i) % 251)
+				goto bad;
+
+		recvd += len;
+	}
+
+	return NULL;
+
+bad:
+	fprintf(stderr, "FAIL: bad data at offset %lu\n", recvd);
+	exit(1);
+}
+
+static void run(const char *name)
+{
+	pthread_t prod, cons;
+	uint64_t start, ns;
+
+	start = host_time_ns();
+
+	pthread_create(&prod, NULL, producer, NULL);
+	pthread_create(&cons, NULL, consumer, NULL);
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+
+	ns = host_time_ns() - start;
+	printf("%-24s %8.1f MB/s  %6.2f ns/byte\n", name,
+	       total * 1e3 / ns, (double)ns / total);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+
+	if (queue_init(&queue, QUEUE_SIZE)) {
+		fprintf(stderr, "queue_init failed\n");
+		return 1;
+	}
+
+#ifdef CONFIG_LIBOS_QUEUE_PADDED
+	printf("padded layout, %zu-byte queue_t\n", sizeof(queue_t));
+#else
+	printf("unpadded layout, %zu-byte queue_t\n", sizeof(queue_t));
+#endif
+
+	/* Byte at a time costs more per byte; move less. */
+	total = mb << 16;
+	chunked = 0;
+	run("queue_writechar/readchar");
+
+	total = mb << 20;
+	chunked = 1;
+	run("queue_write/read, 64B");
+
+	return 0;
+}
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Stress test for slab.c.
+ *
+ * Threads, each on its own cpu, allocate and free objects from a set
+ * of caches at random, and pass some objects through a shared exchange
+ * so that they are freed on another cpu than the one that allocated
+ * them.  There are more caches than per-cpu slots, so both the per-cpu
+ * and the shared-only paths run.
+ *
+ * Each object carries a state word that is swapped atomically on
+ * allocation and free, so an object handed out twice, or freed twice,
+ * is caught.  The rest of a live object is filled with a pattern
+ * derived from its owner and checked before it is freed, which catches
+ * overlapping objects.  At the end, every cpu is flushed, and the
+ * shared free list of each cache must hold exactly the objects carved
+ * from its slabs.
+ *
+ * usage: slab-stress [threads [operations per thread]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <libos/slab.h>
+
+#include "host.h"
+
+#define NCACHES  (SLAB_CPU_SLOTS + 2)
+#define MAX_LIVE 64
+#define NXCHG    32
+
+#define STATE_LIVE 0x4c495645
+#define STATE_FREE 0x46524545
+
+/* The first word of a free object is the free list link, so the
+ * header starts after it.
+ */
+typedef struct obj {
+	void *link;
+	uint32_t state;
+	uint16_t cache;
+	uint16_t owner;
+	uint32_t seq;
+	uint8_t fill[];
+} obj_t;
+
+static const struct {
+	size_t size, align;
+} cache_params[NCACHES] = {
+	{ sizeof(obj_t), 8 },
+	{ 24, 8 },
+	{ 40, 16 },
+	{ 64, 64 },
+	{ 100, 8 },
+	{ 200, 32 },
+	{ 256, 128 },
+	{ 520, 8 },
+	{ 32, 8 },
+	{ 1000, 64 },
+};
+
+static slab_cache_t caches[NCACHES];
+static obj_t *exchange[NXCHG];
+
+static int nthreads = 4;
+static unsigned long ops = 200000;
+static unsigned long max_live;
+static int failed;
+
+static void fail(const char *msg, const obj_t *obj)
+{
+	__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+	fprintf(stderr, "FAIL: %s: %p cache %u owner %u seq %u state %#x\n",
+	        msg, obj, obj->cache, obj->owner, obj->seq, obj->state);
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static uint8_t fill_byte(const obj_t *obj, size_t i)
+{
+	return obj->owner * 31 + obj->seq * 7 + i;
+}
+
+static obj_t *get(int c, int owner, uint32_t seq)
+{
+	obj_t *obj = slab_alloc(&caches[c]);
+	size_t i, len = caches[c].objsize - sizeof(obj_t);
+
+	if (!obj) {
+		fprintf(stderr, "FAIL: cache %d: out of memory\n", c);
+		exit(1);
+	}
+
+	if ((uintptr_t)obj & (cache_params[c].align - 1))
+		fail("misaligned", obj);
+
+	if (__atomic_exchange_n(&obj->state, STATE_LIVE,
+	                        __ATOMIC_RELAXED) == STATE_LIVE)
+		fail("allocated twice", obj);
+
+	obj->cache = c;
+	obj->owner = owner;
+	obj->seq = seq;
+
+	for (i = 0; i < len; i++)
+		obj->fill[i] = fill_byte(obj, i);
+
+	return obj;
+}
+
+static void put(obj_t *obj)
+{
+	size_t i, len;
+
+	if (obj->cache >= NCACHES) {
+		fail("bad cache", obj);
+		return;
+	}
+
+	len = caches[obj->cache].objsize - sizeof(obj_t);
+	for (i = 0; i < len; i++) {
+		if (obj->fill[i] != fill_byte(obj, i)) {
+			fail("overwritten", obj);
+			break;
+		}
+	}
+
+	if (__atomic_exchange_n(&obj->state, STATE_FREE,
+	                        __ATOMIC_RELAXED) != STATE_LIVE)
+		fail("freed twice", obj);
+
+	slab_free(&caches[obj->cache], obj);
+}
+
+/* Flush this cpu's lists, which must leave them empty. */
+static void flush_all(void)
+{
+	int i;
+
+	for (i = 0; i < NCACHES; i++)
+		slab_cache_flush(&caches[i]);
+
+	for (i = 0; i < SLAB_CPU_SLOTS; i++) {
+		if (cpu->slab[i].head || cpu->slab[i].count) {
+			fprintf(stderr, "FAIL: cpu %u slot %d: %u objects left "
+			        "after flush\n", cpu->coreid, i, cpu->slab[i].count);
+			__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static void *worker(void *arg)
+{
+	int id = (uintptr_t)arg;
+	uint32_t rand = id * 2654435761U + 1;
+	obj_t *live[MAX_LIVE] = {};
+	unsigned long n;
+	int i;
+
+	host_cpu_init(id);
+
+	for (n = 0; n < ops && !__atomic_load_n(&failed, __ATOMIC_RELAXED); n++) {
+		uint32_t r = next_rand(&rand);
+		obj_t **slot = &live[r % MAX_LIVE];
+		obj_t *obj;
+
+		r >>= 8;
+
+		if (!*slot) {
+			*slot = get(r % NCACHES, id, n);
+		} else if ((r & 7) == 0) {
+			/* Hand the object to whichever thread next
+			 * takes this exchange slot, and free what was
+			 * there.
+			 */
+			obj = __atomic_exchange_n(&exchange[(r >> 3) % NXCHG],
+			                          *slot, __ATOMIC_ACQ_REL);
+			if (obj)
+				put(obj);
+
+			*slot = NULL;
+		} else {
+			put(*slot);
+			*slot = NULL;
+		}
+	}
+
+	for (i = 0; i < MAX_LIVE; i++)
+		if (live[i])
+			put(live[i]);
+
+	flush_all();
+	return NULL;
+}
+
+static void test_init(void)
+{
+	slab_cache_t c;
+	uint8_t *obj;
+	int i;
+
+	slab_cache_init(&c, "odd", 13, 1);
+	if (c.objsize != 16 || c.align != sizeof(void *)) {
+		fprintf(stderr, "FAIL: size 13 align 1 gave size %zu align %zu\n",
+		        c.objsize, c.align);
+		exit(1);
+	}
+
+	slab_cache_init(&c, "zero", 48, 16);
+	obj = slab_alloc(&c);
+	memset(obj, 0xaa, c.objsize);
+	slab_free(&c, obj);
+
+	obj = slab_zalloc(&c);
+	for (i = 0; i < c.objsize; i++) {
+		if (obj[i]) {
+			fprintf(stderr, "FAIL: slab_zalloc byte %d is %#x\n",
+			        i, obj[i]);
+			exit(1);
+		}
+	}
+
+	slab_free(&c, obj);
+	slab_cache_flush(&c);
+}
+
+/* After every cpu has flushed, each object carved so far must be on
+ * the shared free list, exactly once.
+ */
+static void check_cache(int i)
+{
+	slab_cache_t *c = &caches[i];
+	size_t slab_size = c->objsize * SLAB_BATCH;
+	unsigned long carved, n = 0;
+	obj_t *obj;
+
+	if (slab_size < SLAB_SIZE)
+		slab_size = SLAB_SIZE;
+
+	carved = c->slabs * (slab_size / c->objsize) -
+	         (c->carve_end - c->carve) / c->objsize;
+
+	for (obj = c->free; obj && n <= carved; obj = obj->link, n++) {
+		if (obj->state != STATE_FREE)
+			fail("live object on free list", obj);
+
+		obj->state = 0;
+	}
+
+	if (n != carved || n != c->nfree) {
+		fprintf(stderr, "FAIL: cache %d: %lu carved, %lu on free list, "
+		        "nfree %u\n", i, carved, n, c->nfree);
+		failed = 1;
+	}
+
+	/* Free objects can only pile up on the per-cpu lists, so the
+	 * cache must not have grown much past the most objects that
+	 * were ever live at once.
+	 */
+	if (carved > max_live + nthreads * 3 * SLAB_BATCH +
+	             slab_size / c->objsize) {
+		fprintf(stderr, "FAIL: cache %d: %lu objects in %lu slabs\n",
+		        i, carved, c->slabs);
+		failed = 1;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[HOST_MAX_CPUS];
+	uint64_t start;
+	int i, shared = 0;
+
+	if (argc > 1)
+		nthreads = atoi(argv[1]);
+	if (argc > 2)
+		ops = strtoul(argv[2], NULL, 0);
+
+	/* The main thread is the last cpu. */
+	if (nthreads < 1 || nthreads >= HOST_MAX_CPUS) {
+		fprintf(stderr, "usage: %s [threads [operations]]\n", argv[0]);
+		return 2;
+	}
+
+	host_cpu_init(nthreads);
+	test_init();
+
+	for (i = 0; i < NCACHES; i++)
+		slab_cache_init(&caches[i], "stress", cache_params[i].size,
+		                cache_params[i].align);
+
+	max_live = nthreads * MAX_LIVE + NXCHG;
+	start = host_time_ns();
+
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, worker, (void *)(uintptr_t)i);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < NXCHG; i++)
+		if (exchange[i])
+			put(exchange[i]);
+
+	flush_all();
+
+	for (i = 0; i < NCACHES; i++) {
+		check_cache(i);
+
+		if (caches[i].cpu_slot < 0)
+			shared++;
+	}
+
+	/* test_init() took one slot, so three caches have none. */
+	if (shared != NCACHES + 1 - SLAB_CPU_SLOTS) {
+		fprintf(stderr, "FAIL: %d caches without a per-cpu slot\n",
+		        shared);
+		failed = 1;
+	}
+
+	if (failed)
+		return 1;
+
+	printf("%d threads: %lu operations in %.2f s\n",
+	       nthreads, nthreads * ops, (host_time_ns() - start) / 1e9);
+	return 0;
+}
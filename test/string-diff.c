@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Differential test of libos's string routines against the host's.
+ *
+ * strlen(), strnlen(), strcmp(), strncmp(), memcmp() and memchr() are
+ * run at every alignment within two words and every length up to a
+ * few dozen words.  The data includes 0x01 and 0x80 bytes, which the
+ * word-at-a-time zero test is most likely to get wrong, and bytes with
+ * the high bit set, which must compare as unsigned.  Comparisons must
+ * agree in sign.  Strings are also placed against an inaccessible page
+ * to catch reads past the aligned word holding the last byte.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libos-libc.h"
+
+#define MAX_ALIGN 16
+#define MAX_LEN   200
+#define BUF_SIZE  (MAX_ALIGN + MAX_LEN + 64)
+
+static unsigned char buf1[BUF_SIZE], buf2[BUF_SIZE];
+static unsigned long failures, checks;
+
+static void fail(const char *what, int off1, int off2, size_t len, int pos)
+{
+	if (failures++ < 20)
+		printf("FAIL: %s, offsets %d %d, len %zu, pos %d\n",
+		       what, off1, off2, len, pos);
+}
+
+static int sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+/* xorshift64*, so that the data is the same on any host */
+static uint64_t rng_state = 1;
+
+static unsigned int rnd(unsigned int n)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 0x2545f4914f6cdd1dULL >> 32) % n;
+}
+
+/* A nonzero byte, favouring the awkward ones */
+static unsigned char random_byte(void)
+{
+	static const unsigned char awkward[] = { 0x01, 0x80, 0x81, 0xfe, 0xff };
+
+	if (rnd(3) == 0)
+		return awkward[rnd(sizeof(awkward))];
+
+	return 1 + rnd(255);
+}
+
+static void fill(unsigned char *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		p[i] = random_byte();
+}
+
+static void check_strlen(void)
+{
+	for (int off = 0; off < MAX_ALIGN; off++) {
+		for (size_t len = 0; len <= MAX_LEN; len++) {
+			char *s = (char *)buf1 + off;
+
+			fill(buf1, BUF_SIZE);
+			s[len] = 0;
+
+			/* Bytes after the terminator mustn't matter. */
+			if (len + 1 < BUF_SIZE - off)
+				s[len + 1] = rnd(2) ? 0x01 : 0;
+
+			checks++;
+			if (libos_strlen(s) != len)
+				fail("strlen", off, 0, len, -1);
+
+			for (size_t n = len > 9 ? len - 9 : 0; n <= len + 9; n++) {
+				if (libos_strnlen(s, n) != strnlen(s, n))
+					fail("strnlen", off, 0, len, n);
+			}
+		}
+	}
+}
+
+static void check_memchr(void)
+{
+	static const int chars[] = { 0, 0x01, 0x80, 0xff, 0x1ff, -1, 'a' };
+
+	for (int off = 0; off < MAX_ALIGN; off++) {
+		for (size_t len = 0; len <= MAX_LEN; len++) {
+			unsigned char *s = buf1 + off;
+
+			for (int i = 0; i < sizeof(chars) / sizeof(chars[0]); i++) {
+				int c = chars[i];
+				int pos = len ? rnd(len + len / 2 + 1) : 0;
+
+				/* Zeroes too, as memchr() must not stop
+				 * at a NUL.
+				 */
+				for (size_t j = 0; j < BUF_SIZE - off; j++)
+					s[j] = rnd(8) ? random_byte() : 0;
+
+				/* Only the last byte, or beyond it */
+				for (size_t j = 0; j < len; j++)
+					if (s[j] == (unsigned char)c)
+						s[j] ^= 0x40;
+
+				if (pos < BUF_SIZE - off)
+					s[pos] = c;
+
+				checks++;
+				if (libos_memchr(s, c, len) != memchr(s, c, len))
+					fail("memchr", off, c, len, pos);
+			}
+		}
+	}
+}
+
+/* Pairs of buffers equal up to pos, then different or terminated. */
+static void check_compare(void)
+{
+	for (int off1 = 0; off1 < MAX_ALIGN; off1++) {
+		for (int off2 = 0; off2 < MAX_ALIGN; off2++) {
+			for (size_t len = 0; len <= MAX_LEN; len += 1 + len / 16) {
+				char *s1 = (char *)buf1 + off1;
+				char *s2 = (char *)buf2 + off2;
+				int pos = rnd(len + 1);
+
+				fill(buf1, BUF_SIZE);
+				fill(buf2, BUF_SIZE);
+				memcpy(s2, s1, len);
+				s1[len] = s2[len] = 0;
+
+				switch (rnd(4)) {
+				case 0: /* equal */
+					break;
+				case 1:
+					s2[pos] = random_byte();
+					break;
+				case 2: /* one ends first */
+					s2[pos] = 0;
+					break;
+				case 3:
+					s1[pos] = 0;
+					break;
+				}
+
+				checks++;
+				if (sign(libos_memcmp(s1, s2, len)) !=
+				    sign(memcmp(s1, s2, len)))
+					fail("memcmp", off1, off2, len, pos);
+
+				if (sign(libos_strcmp(s1, s2)) !=
+				    sign(strcmp(s1, s2)))
+					fail("strcmp", off1, off2, len, pos);
+
+				for (size_t n = pos > 2 ? pos - 2 : 0; n <= pos + 2; n++) {
+					if (sign(libos_strncmp(s1, s2, n)) !=
+					    sign(strncmp(s1, s2, n)))
+						fail("strncmp", off1, off2, len, n);
+				}
+			}
+		}
+	}
+}
+
+/* Strings and buffers whose last byte is the last of a page. */
+static void check_bounds(void)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	char *pages, *end;
+
+	if (posix_memalign((void **)&pages, page, page * 2)) {
+		printf("FAIL: can't allocate pages\n");
+		failures++;
+		return;
+	}
+
+	end = pages + page;
+	memset(pages, 'x', page);
+
+	if (mprotect(end, page, PROT_NONE)) {
+		perror("mprotect");
+		failures++;
+		return;
+	}
+
+	for (size_t len = 0; len <= MAX_LEN; len++) {
+		char *s = end - len - 1;
+
+		memset(pages, 'x', page);
+		end[-1] = 0;
+
+		checks++;
+		if (libos_strlen(s) != len)
+			fail("strlen at page end", 0, 0, len, -1);
+
+		if (libos_strcmp(s, s) || libos_strncmp(s, s, len + 10))
+			fail("strcmp at page end", 0, 0, len, -1);
+
+		if (libos_memchr(s, 'y', len + 1) ||
+		    libos_memcmp(s, s, len + 1))
+			fail("memchr/memcmp at page end", 0, 0, len, -1);
+	}
+
+	mprotect(end, page, PROT_READ | PROT_WRITE);
+	free(pages);
+}
+
+int main(void)
+{
+	check_strlen();
+	check_memchr();
+	check_compare();
+	check_bounds();
+
+	if (failures) {
+		printf("%lu failures\n", failures);
+		return 1;
+	}
+
+	printf("%lu string cases match the host libc\n", checks);
+	return 0;
+}